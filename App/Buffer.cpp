@@ -14,7 +14,7 @@ Buffer::Buffer(Editor* editor)
 {
 }
 
-std::string Buffer::short_title() const
+std::string_view Buffer::short_title() const
 {
     return title();
 }
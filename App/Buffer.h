@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <optional>
+
 #include <lexer/Token.h>
 #include <Widget/Widget.h>
 
@@ -16,6 +18,12 @@ struct Line {
 
     int start_index {0};
     std::vector<Token> tokens {};
+
+    // Whether the tokens are there, and the states the lexer was in at the
+    // start and the end of the line.
+    bool lexed { false };
+    int lex_start { 0 };
+    int lex_end { 0 };
 };
 
 struct DocumentPosition {
@@ -29,19 +37,34 @@ struct DocumentPosition {
     auto operator<=>(DocumentPosition const& other) const = default;
 };
 
+// What a buffer showed in the editor when it was last rendered. If the
+// buffer reports the same view apart from `top`, the editor can reuse the
+// rendered content and only needs to paint the rows scrolled into view.
+struct ContentView {
+    int top { 0 };
+    int left { 0 };
+    size_t version { 0 };
+    int point { 0 };
+    int mark { 0 };
+
+    bool operator==(ContentView const&) const = default;
+};
+
 class Buffer : public Widget {
 public:
     [[nodiscard]] int rows() const;
     [[nodiscard]] int columns() const;
-    [[nodiscard]] virtual std::string title() const = 0;
-    [[nodiscard]] virtual std::string short_title() const;
-    [[nodiscard]] virtual std::string status() const = 0;
+    [[nodiscard]] virtual std::string_view title() const = 0;
+    [[nodiscard]] virtual std::string_view short_title() const;
+    [[nodiscard]] virtual std::string_view status() const = 0;
     virtual void on_activate() { };
     virtual void on_deactivate() { };
     virtual void mousedown(int, int) { };
     virtual void motion(int, int) { };
     virtual void click(int, int, int) { };
     virtual void wheel(int) { };
+    virtual void prepare() { };
+    [[nodiscard]] virtual std::optional<ContentView> content_view() const { return {}; }
 protected:
     explicit Buffer(Editor*);
     [[nodiscard]] Editor* editor() { return m_editor; }
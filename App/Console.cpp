@@ -6,6 +6,7 @@
 
 #include <App/Console.h>
 #include <App/Editor.h>
+#include <App/Scratch.h>
 #include <Widget/App.h>
 #include <Scribble/Parser.h>
 #include <Scribble/Scribble.h>
@@ -50,7 +51,7 @@ void Console::render()
             auto len = 0u;
             editor()->append(DisplayToken { prompt, prompt_color });
             for (auto const& token : l.tokens) {
-                auto t = token.value();
+                std::string_view t = token.value();
                 if (len + 3 + t.length() < m_screen_left) {
                     len += t.length();
                     continue;
@@ -183,22 +184,45 @@ void Console::wheel(int lines)
 {
 }
 
+// The statement is added to the history right away, and gets its result
+// when the script is done.
 void Console::execute()
 {
     assert(m_current.node && m_current.node->is_complete());
-    auto result = interpret(m_current.node, m_ctx);
-    if (result.is_error()) {
-        m_current.result = result.error().to_string();
-    } else {
-        auto r = std::dynamic_pointer_cast<Interp::ExpressionResult>(result.value());
-        m_current.result = r->value();
-    }
+    auto& runner = Scratch::script_runner();
+    if (runner.is_running())
+        return;
     m_current.line = 0u;
     if (!m_statements.empty())
         m_current.line = m_statements.back().line + 2;
+    auto ix = m_statements.size();
+    auto node = m_current.node;
     m_statements.push_back(m_current);
     m_current = { 0, nullptr, nullptr, Value {}, {} };
     m_cursor_column = 0;
+
+    // The console keeps its variables between statements, so it holds on to
+    // a context for the tree interpreter and a machine for the bytecode. The
+    // builtins look up editor commands, which the worker can't do.
+    ScriptRunner::Step step { nullptr };
+    if (scribble_engine() == ScribbleEngine::Bytecode) {
+        step = [this, node](std::chrono::milliseconds slice) -> std::optional<ProcessResult> {
+            return m_vm.run_slice(node, slice);
+        };
+    }
+    runner.start(
+        [this, node, builtins = Interp::builtins()]() -> ProcessResult {
+            return (scribble_engine() == ScribbleEngine::Tree) ? interpret(node, m_ctx, builtins) : m_vm.execute(node);
+        },
+        [this, ix](ProcessResult const& result) -> void {
+            if (result.is_error()) {
+                m_statements[ix].result = result.error().to_string();
+            } else {
+                auto r = std::dynamic_pointer_cast<Interp::ExpressionResult>(result.value());
+                m_statements[ix].result = r->value();
+            }
+        },
+        step);
 }
 
 } // Scratch
@@ -9,6 +9,7 @@
 #include <App/Buffer.h>
 #include <Commands/Command.h>
 #include <Scribble/Interp/Interpreter.h>
+#include <Scribble/Interp/VirtualMachine.h>
 
 namespace Scratch {
 
@@ -20,8 +21,8 @@ class Console : public Buffer {
 public:
     explicit Console(Editor *);
 
-    std::string title() const override { return "** Console **"; }
-    [[nodiscard]] virtual std::string status() const override { return ""; }
+    std::string_view title() const override { return "** Console **"; }
+    [[nodiscard]] virtual std::string_view status() const override { return ""; }
 
     void execute();
 
@@ -51,6 +52,7 @@ private:
     size_t m_cursor_line { 0 };
     size_t m_cursor_column { 0 };
     InterpreterContext m_ctx;
+    VirtualMachine m_vm;
 
     static ConsoleCommands s_console_commands;
 };
@@ -4,8 +4,10 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
 
 #include <core/Format.h>
 
@@ -205,22 +207,28 @@ fs::path const& Document::path() const
     return m_path;
 }
 
-std::string Document::title() const
+void Document::set_path(fs::path const& path)
 {
-    return m_path;
+    m_path = path;
+    m_title = m_path.string();
+    m_short_title = (m_path.empty()) ? "" : fs::relative(m_path).string();
 }
 
-std::string Document::short_title() const
+std::string_view Document::title() const
 {
-    return fs::relative(path()).string();
+    return m_title;
 }
 
-std::string Document::status() const
+std::string_view Document::short_title() const
 {
-    std::stringstream ss;
-    ss << point_line() + 1 << ":" << point_column() + 1 << " [";
-    ss << screen_top() + 1 << ":" << screen_left() + 1 << "]";
-    return ss.str();
+    return m_short_title;
+}
+
+// The status is rendered every frame, so it's formatted into the frame arena.
+std::string_view Document::status() const
+{
+    return App::instance().frame_arena().printf("%d:%d [%d:%d]",
+        point_line() + 1, point_column() + 1, screen_top() + 1, screen_left() + 1);
 }
 
 std::string Document::line(size_t line_no) const
@@ -251,12 +259,12 @@ int Document::line_count() const
 
 bool Document::empty() const
 {
-    return m_lines.empty() || (m_lines.size() == 1 && m_lines[0].tokens.empty());
+    return m_text.empty();
 }
 
-size_t Document::parsed() const
+bool Document::parsed() const
 {
-    return !m_parser->tokens().empty();
+    return !m_changed;
 }
 
 void Document::split_line()
@@ -271,7 +279,7 @@ void Document::join_lines()
         ;
     if (ix > 0) {
         add_edit_action(EditAction::delete_text(ix, m_text.substr(ix, 1)));
-        m_text.erase(ix, 1);
+        erase(ix, 1);
         m_point = ix - 1;
         update_internals(false);
     }
@@ -318,8 +326,9 @@ void Document::insert_text(std::string const& str, int point)
         return;
     if (point < 0)
         point = m_point;
+    mark_edited(point, "", str);
     m_text.insert(point, str);
-    m_changed = true;
+    m_changed = m_dirty = true;
     m_point += static_cast<int>(str.length());
 }
 
@@ -401,9 +410,49 @@ std::string Document::selected_text()
 
 void Document::erase(int point, int len)
 {
+    mark_edited(point, std::string_view(m_text).substr(point, len), "");
     m_text.erase(point, len);
     m_mark = m_point = point;
-    m_changed = true;
+    m_changed = m_dirty = true;
+}
+
+// Keeps the edit state of the lines in step with the text when `removed` at
+// `point` is replaced with `inserted`. This runs before the edit. m_lines is
+// stale if there was an earlier edit that wasn't followed by split_lines(),
+// and then the line is found by counting the newlines between `point` and
+// the end of that earlier edit.
+void Document::mark_edited(int point, std::string_view removed, std::string_view inserted)
+{
+    size_t line;
+    if (!m_changed)
+        line = static_cast<size_t>(find_line_number(point));
+    else if (point >= m_edit_point)
+        line = m_edit_line + static_cast<size_t>(std::count(m_text.begin() + m_edit_point, m_text.begin() + point, '\n'));
+    else
+        line = m_edit_line - static_cast<size_t>(std::count(m_text.begin() + point, m_text.begin() + m_edit_point, '\n'));
+    auto removed_lines = static_cast<size_t>(std::count(removed.begin(), removed.end(), '\n'));
+    auto inserted_lines = static_cast<size_t>(std::count(inserted.begin(), inserted.end(), '\n'));
+    if (m_line_states.size() <= line + removed_lines)
+        m_line_states.resize(line + removed_lines + 1, LineState::None);
+    m_line_states.erase(m_line_states.begin() + line + 1, m_line_states.begin() + line + 1 + removed_lines);
+    m_line_states.insert(m_line_states.begin() + line + 1, inserted_lines, LineState::Edited);
+    m_line_states[line] = LineState::Edited;
+    ++m_line_states_version;
+    m_line_edits.push_back({ 0, static_cast<int>(line), static_cast<int>(removed_lines) + 1, static_cast<int>(inserted_lines) + 1 });
+    m_edit_point = point + static_cast<int>(inserted.length());
+    m_edit_line = line + inserted_lines;
+}
+
+PaletteIndex Document::token_color(Token const& token)
+{
+    return m_parser->colorize(token.code(), token.value()).color;
+}
+
+LineState Document::line_state(int line) const
+{
+    if (line < 0 || static_cast<size_t>(line) >= m_line_states.size())
+        return LineState::None;
+    return m_line_states[line];
 }
 
 void Document::erase_selection()
@@ -521,6 +570,8 @@ void Document::move_to(int line, int column, bool select)
 
 void Document::update_internals(bool select, int line)
 {
+    if (m_changed)
+        split_lines();
     if (line < 0)
         line = find_line_number(m_point);
     int column = m_point - m_lines[line].start_index;
@@ -528,12 +579,6 @@ void Document::update_internals(bool select, int line)
     m_screen_left = clamp(m_screen_left, std::max(0, column - editor()->columns() + 1), column);
     if (!select)
         m_mark = m_point;
-    if (m_changed) {
-        m_parser->assign(m_text);
-        m_lines.clear();
-        m_lines.emplace_back();
-        m_parser->invalidate();
-    }
 }
 
 void Document::move_point(int point)
@@ -723,14 +768,23 @@ void Document::clear()
 
 std::string Document::load(std::string const& file_name)
 {
-    m_path = fs::absolute(file_name);
+    set_path(fs::absolute(file_name));
     m_filetype = get_filetype(m_path);
     m_parser = std::unique_ptr<ScratchParser>(m_filetype.parser_builder());
-    if (auto error_maybe = m_parser->read_file(m_path.string()); error_maybe.is_error())
-        return error_maybe.error().message();
+    std::ifstream s(m_path, std::ios::binary);
+    if (!s.is_open())
+        return format("Error opening '{}'", m_path.string());
+    m_text.assign(std::istreambuf_iterator<char>(s), std::istreambuf_iterator<char>());
+    if (s.bad())
+        return format("Error reading '{}'", m_path.string());
     m_point = m_mark = 0;
+    m_screen_top = m_screen_left = 0;
     m_dirty = false;
-    m_changed = true;
+    m_lines.clear();
+    m_line_edits.clear();
+    split_lines();
+    m_line_states.clear();
+    ++m_line_states_version;
     return "";
 }
 
@@ -745,49 +799,206 @@ std::string Document::save()
     if (s.fail() || s.bad())
         return format("Error saving '{}'", m_path.string());
     m_dirty = false;
+    for (auto& state : m_line_states) {
+        if (state == LineState::Edited)
+            state = LineState::EditedSaved;
+    }
+    ++m_line_states_version;
     return "";
 }
 
 std::string Document::save_as(std::string const& new_file_name)
 {
-    m_path = new_file_name;
+    set_path(new_file_name);
     m_filetype = get_filetype(m_path);
     m_parser = std::unique_ptr<ScratchParser>(m_filetype.parser_builder());
+    reset_chunks();
     return save();
 }
 
-void Document::render()
+// Finds the lines in the text. That's cheap compared to lexing, so the
+// document knows its geometry right away, and the lines can be lexed later
+// in chunks. Lines that weren't touched by the edits made since the last
+// time keep their tokens.
+void Document::split_lines()
 {
-    if (!parsed()) {
-        m_text.clear();
-        m_lines.clear();
-        m_lines.emplace_back();
-        m_lines.back().start_index = 0;
-        auto start = std::chrono::steady_clock::now();
-        bool done { false };
-        while (!done) {
-            auto& token = lex();
-            if (token.code() == TokenCode::EndOfFile)
-                break;
-            switch (token.code()) {
-            case TokenCode::NewLine:
-                m_text += "\n";
-                m_lines.emplace_back();
-                m_lines.back().start_index = text_length();
-                break;
-            case TokenCode::EndOfFile:
-                done = true;
-                break;
-            default:
-                m_lines.back().tokens.push_back(token);
-                m_text += token.string_value();
-                break;
+    std::vector<int> starts { 0 };
+    for (auto pos = m_text.find('\n'); pos != std::string::npos; pos = m_text.find('\n', pos + 1))
+        starts.push_back(static_cast<int>(pos + 1));
+
+    for (auto const& edit : m_line_edits) {
+        if (static_cast<size_t>(edit.line + edit.removed) > m_lines.size()) {
+            m_lines.clear();
+            break;
+        }
+        m_lines.erase(m_lines.begin() + edit.line, m_lines.begin() + edit.line + edit.removed);
+        m_lines.insert(m_lines.begin() + edit.line, edit.inserted, Line {});
+        lines_changed(edit.line, edit.removed, edit.inserted);
+    }
+    m_line_edits.clear();
+    if (m_lines.size() != starts.size()) {
+        m_lines.assign(starts.size(), Line {});
+        all_lines_changed();
+    }
+    for (auto ix = 0u; ix < starts.size(); ++ix)
+        m_lines[ix].start_index = starts[ix];
+    update_chunks();
+    m_changed = false;
+    ++m_text_version;
+    ++m_parse_generation;
+}
+
+// Forgets all tokens, for when the parser changed.
+void Document::reset_chunks()
+{
+    for (auto& line : m_lines) {
+        line.tokens.clear();
+        line.lexed = false;
+    }
+    update_chunks();
+    all_lines_changed();
+    ++m_parse_generation;
+}
+
+// A chunk needs lexing when one of its lines does, or when one of its lines
+// was lexed starting in another state than the line before it ended in.
+void Document::update_chunks()
+{
+    m_chunks_lexed.assign((m_lines.size() + SCRATCH_LEX_CHUNK_LINES - 1) / SCRATCH_LEX_CHUNK_LINES, true);
+    for (auto ix = 0u; ix < m_lines.size(); ++ix) {
+        auto const& line = m_lines[ix];
+        if (!line.lexed || (ix > 0 && m_lines[ix - 1].lexed && line.lex_start != m_lines[ix - 1].lex_end))
+            m_chunks_lexed[ix / SCRATCH_LEX_CHUNK_LINES] = false;
+    }
+}
+
+void Document::lines_changed(int line, int removed, int inserted)
+{
+    ++m_token_version;
+    if (m_line_changes.size() >= SCRATCH_LINE_CHANGES) {
+        m_line_changes_base = m_line_changes.front().version;
+        m_line_changes.erase(m_line_changes.begin());
+    }
+    m_line_changes.push_back({ m_token_version, line, removed, inserted });
+}
+
+void Document::all_lines_changed()
+{
+    ++m_token_version;
+    m_line_changes.clear();
+    m_line_changes_base = m_token_version;
+}
+
+// The changes since the given token version, oldest first. Nothing if the
+// document doesn't remember that far back.
+std::optional<std::vector<LineChange>> Document::line_changes(size_t since) const
+{
+    if (since < m_line_changes_base)
+        return {};
+    std::vector<LineChange> ret;
+    for (auto const& change : m_line_changes) {
+        if (change.version > since)
+            ret.push_back(change);
+    }
+    return ret;
+}
+
+// Lexes one chunk of SCRATCH_LEX_CHUNK_LINES lines. The chunk is lexed
+// starting in the state the line before it ended in, if that one is lexed
+// already. If the state this chunk ends in is not the one the next chunk
+// was lexed from, the next chunk is lexed again.
+void Document::lex_chunk(size_t chunk)
+{
+    auto first = static_cast<int>(chunk * SCRATCH_LEX_CHUNK_LINES);
+    auto last = std::min(first + SCRATCH_LEX_CHUNK_LINES, line_count());
+    auto start = m_lines[first].start_index;
+    auto end = (last < line_count()) ? m_lines[last].start_index : text_length();
+    for (auto ix = first; ix < last; ++ix)
+        m_lines[ix].tokens.clear();
+
+    auto state = (first > 0 && m_lines[first - 1].lexed) ? m_lines[first - 1].lex_end : ScratchParser::LexStateNormal;
+    auto prefix = m_parser->resume(state);
+    auto skip = prefix.length();
+    m_parser->assign(prefix + m_text.substr(start, end - start));
+    m_parser->invalidate();
+    auto line = first;
+    while (true) {
+        auto const& token = lex();
+        if (token.code() == TokenCode::EndOfFile)
+            break;
+        if (token.code() == TokenCode::NewLine) {
+            if (line < last)
+                m_lines[line].lex_end = m_parser->lex_state();
+            ++line;
+            continue;
+        }
+        if (line >= last)
+            continue;
+        if (skip == 0) {
+            m_lines[line].tokens.push_back(token);
+        } else if (token.value().length() <= skip) {
+            skip -= token.value().length();
+        } else {
+            m_lines[line].tokens.emplace_back(token.location(), token.code(), token.value().substr(skip));
+            skip = 0;
+        }
+    }
+    if (line < last)
+        m_lines[line].lex_end = m_parser->lex_state();
+    for (auto ix = first; ix < last; ++ix) {
+        m_lines[ix].lexed = true;
+        m_lines[ix].lex_start = (ix == first) ? state : m_lines[ix - 1].lex_end;
+    }
+    m_chunks_lexed[chunk] = true;
+    if (last < line_count() && m_lines[last].lexed && m_lines[last].lex_start != m_lines[last - 1].lex_end) {
+        m_lines[last].lexed = false;
+        m_chunks_lexed[chunk + 1] = false;
+    }
+    lines_changed(first, last - first, last - first);
+    if (last > m_screen_top && first < m_screen_top + editor()->content_rows())
+        ++m_parse_generation;
+}
+
+// Lexes the chunks that are on screen, and then as many of the other
+// chunks as fit in the lexing budget, nearest to the screen first. When the
+// screen jumps, the lexing follows it.
+void Document::prepare()
+{
+    if (m_changed)
+        split_lines();
+    auto chunks = m_chunks_lexed.size();
+    if (chunks == 0)
+        return;
+    auto start = std::chrono::steady_clock::now();
+    auto first_visible = static_cast<size_t>(m_screen_top) / SCRATCH_LEX_CHUNK_LINES;
+    auto last_visible = std::min(static_cast<size_t>(m_screen_top + editor()->content_rows()) / SCRATCH_LEX_CHUNK_LINES, chunks - 1);
+    bool lexed { false };
+    for (auto chunk = first_visible; chunk <= last_visible && chunk < chunks; ++chunk) {
+        if (!m_chunks_lexed[chunk]) {
+            lex_chunk(chunk);
+            lexed = true;
+        }
+    }
+
+    auto budget = std::chrono::milliseconds(SCRATCH_LEX_BUDGET_MS);
+    for (size_t distance = 1; distance < chunks && std::chrono::steady_clock::now() - start < budget; ++distance) {
+        for (auto chunk : { last_visible + distance, first_visible - distance }) {
+            if (chunk < chunks && !m_chunks_lexed[chunk] && std::chrono::steady_clock::now() - start < budget) {
+                lex_chunk(chunk);
+                lexed = true;
             }
         }
-        m_changed = false;
-        m_last_parse_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
     }
 
+    if (lexed) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        m_last_parse_time = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+        App::instance().profiler().add(ProfilePhase::Lexing, elapsed);
+    }
+}
+
+void Document::render()
+{
     auto point_line = find_line_number(m_point);
     auto point_column = m_point - m_lines[point_line].start_index;
     editor()->mark_current_line(point_line - m_screen_top);
@@ -795,7 +1006,11 @@ void Document::render()
     bool has_selection = m_point != m_mark;
     int start_selection = std::min(m_point, m_mark);
     int end_selection = std::max(m_point, m_mark);
-    for (auto ix = m_screen_top; ix < line_count() && ix < m_screen_top + editor()->rows(); ++ix) {
+    for (auto ix = m_screen_top; ix < line_count() && ix < m_screen_top + editor()->content_rows(); ++ix) {
+        if (!editor()->needs_repaint(ix - m_screen_top)) {
+            editor()->newline();
+            continue;
+        }
         auto const& line = m_lines[ix];
         auto line_len = line_length(ix);
         auto line_end = line.start_index + line_len;
@@ -820,7 +1035,7 @@ void Document::render()
 
         auto len = 0u;
         for (auto const& token : line.tokens) {
-            auto t = token.value();
+            std::string_view t = token.value();
             if (len + t.length() < static_cast<size_t>(m_screen_left)) {
                 len += t.length();
                 continue;
@@ -929,6 +1144,13 @@ void Document::wheel(int lines)
     m_screen_top = clamp(m_screen_top + lines, 0, line_count() - 1);
 }
 
+std::optional<ContentView> Document::content_view() const
+{
+    if (!parsed())
+        return {};
+    return ContentView { m_screen_top, m_screen_left, m_parse_generation, m_point, m_mark };
+}
+
 void Document::handle_text_input()
 {
     insert(App::instance().input_buffer());
@@ -8,6 +8,7 @@
 
 #include <deque>
 #include <filesystem>
+#include <string_view>
 
 #include <SDL.h>
 
@@ -18,6 +19,18 @@
 #include <Parser/CPlusPlus.h>
 #include <Widget/Widget.h>
 
+#ifndef SCRATCH_LEX_CHUNK_LINES
+#define SCRATCH_LEX_CHUNK_LINES 1024
+#endif /* SCRATCH_LEX_CHUNK_LINES */
+
+#ifndef SCRATCH_LEX_BUDGET_MS
+#define SCRATCH_LEX_BUDGET_MS 4
+#endif /* SCRATCH_LEX_BUDGET_MS */
+
+#ifndef SCRATCH_LINE_CHANGES
+#define SCRATCH_LINE_CHANGES 256
+#endif /* SCRATCH_LINE_CHANGES */
+
 namespace Scratch {
 
 namespace fs=std::filesystem;
@@ -63,6 +76,16 @@ private:
     std::string m_text;
 };
 
+// The lines from `line` up to `line + removed` were replaced by `inserted`
+// lines, making the token version `version`. Lines that were lexed again
+// are reported as replaced by the same number of lines.
+struct LineChange {
+    size_t version { 0 };
+    int line { 0 };
+    int removed { 0 };
+    int inserted { 0 };
+};
+
 class Document : public Buffer {
 public:
     explicit Document(Editor *);
@@ -73,11 +96,16 @@ public:
     [[nodiscard]] int line_length(size_t) const;
     [[nodiscard]] int line_count() const;
     [[nodiscard]] bool empty() const;
-    [[nodiscard]] size_t parsed() const;
+    [[nodiscard]] bool parsed() const;
+    [[nodiscard]] size_t version() const { return m_token_version; }
+    [[nodiscard]] size_t text_version() const { return m_text_version; }
+    [[nodiscard]] std::vector<Line> const& lines() const { return m_lines; }
+    [[nodiscard]] std::optional<std::vector<LineChange>> line_changes(size_t since) const;
+    [[nodiscard]] PaletteIndex token_color(Token const&);
     [[nodiscard]] fs::path const& path() const;
-    [[nodiscard]] std::string title() const override;
-    [[nodiscard]] std::string short_title() const override;
-    [[nodiscard]] std::string status() const override;
+    [[nodiscard]] std::string_view title() const override;
+    [[nodiscard]] std::string_view short_title() const override;
+    [[nodiscard]] std::string_view status() const override;
 
     [[nodiscard]] int screen_top() const { return m_screen_top; }
     [[nodiscard]] int screen_left() const { return m_screen_left; }
@@ -139,6 +167,9 @@ public:
     std::string save();
     std::string save_as(std::string const&);
     [[nodiscard]] bool dirty() const { return m_dirty; }
+    [[nodiscard]] LineState line_state(int) const;
+    [[nodiscard]] size_t line_states_version() const { return m_line_states_version; }
+    [[nodiscard]] std::string const& find_term() const { return m_find_term; }
 
     void render() override;
     bool dispatch(SDL_Keysym) override;
@@ -147,6 +178,8 @@ public:
     void click(int, int, int) override;
     void wheel(int) override;
     void handle_text_input() override;
+    void prepare() override;
+    [[nodiscard]] std::optional<ContentView> content_view() const override;
 
     Token const& lex();
     void rewind();
@@ -162,8 +195,18 @@ private:
     void move_point(int);
     void update_internals(bool, int = -1);
     void add_edit_action(EditAction);
+    void mark_edited(int, std::string_view, std::string_view);
+    void set_path(fs::path const&);
+    void split_lines();
+    void reset_chunks();
+    void update_chunks();
+    void lex_chunk(size_t);
+    void lines_changed(int, int, int);
+    void all_lines_changed();
 
     fs::path m_path {};
+    std::string m_title {};
+    std::string m_short_title {};
     bool m_dirty { false };
     FileType m_filetype;
     std::unique_ptr<Parser::ScratchParser> m_parser;
@@ -171,6 +214,10 @@ private:
     std::string m_text;
     bool m_changed { false };
     std::vector<Line> m_lines {};
+    std::vector<LineState> m_line_states {};
+    size_t m_line_states_version { 0 };
+    int m_edit_point { 0 };
+    size_t m_edit_line { 0 };
 
     int m_screen_top {0};
     int m_screen_left {0};
@@ -181,6 +228,13 @@ private:
     std::vector<EditAction> m_edits;
     int m_undo_pointer { -1 };
     std::chrono::milliseconds m_last_parse_time { 0 };
+    size_t m_parse_generation { 0 };
+    size_t m_token_version { 0 };
+    size_t m_text_version { 0 };
+    std::vector<bool> m_chunks_lexed {};
+    std::vector<LineChange> m_line_edits {};
+    std::vector<LineChange> m_line_changes {};
+    size_t m_line_changes_base { 0 };
     static DocumentCommands s_document_commands;
 
     friend EditAction;
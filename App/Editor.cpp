@@ -68,11 +68,21 @@ Editor::Editor()
     m_commands = &s_editor_commands;
 }
 
+Editor::~Editor()
+{
+    invalidate_content();
+}
+
 int Editor::rows() const
 {
     return m_rows;
 }
 
+int Editor::content_rows() const
+{
+    return m_rows + 2;
+}
+
 int Editor::columns() const
 {
     return m_columns;
@@ -108,25 +118,157 @@ int Editor::column_width()
     return App::instance().context()->character_width();
 }
 
+// While the buffer is rendered into the content texture, the texture is
+// the widget's window:
+
+int Editor::top() const
+{
+    return (m_offscreen) ? 0 : WindowedWidget::top();
+}
+
+int Editor::left() const
+{
+    return (m_offscreen) ? 0 : WindowedWidget::left();
+}
+
+int Editor::height() const
+{
+    return (m_offscreen) ? content_rows() * line_height() : WindowedWidget::height();
+}
+
+bool Editor::needs_repaint(int row) const
+{
+    return row >= m_repaint_from && row < m_repaint_to;
+}
+
 void Editor::resize(const Box& outline)
 {
     WindowedWidget::resize(outline);
     m_line_height = (int)(App::instance().context()->character_height() * 1.2);
     m_rows = height() / m_line_height;
     m_columns = width() / App::instance().context()->character_width();
+    invalidate_content();
+}
+
+void Editor::invalidate_content()
+{
+    if (m_content != nullptr)
+        SDL_DestroyTexture(m_content);
+    if (m_scratch != nullptr)
+        SDL_DestroyTexture(m_scratch);
+    m_content = m_scratch = nullptr;
+    m_content_view.reset();
+    m_pixel_offset = 0;
+}
+
+void Editor::prepare_content(std::optional<ContentView> const& view)
+{
+    m_repaint_from = 0;
+    m_repaint_to = content_rows();
+    auto wheel_lines = m_wheel_lines;
+    m_wheel_lines = 0;
+    if (!view.has_value() || !m_content_view.has_value() || m_content_buffer != buffer()) {
+        m_pixel_offset = 0;
+        return;
+    }
+
+    auto lines = view->top - m_content_view->top;
+
+    // If the buffer didn't scroll the way the wheel asked it to, we hit the
+    // start or end of the buffer, or something else moved the view. Either
+    // way the partial line at the top has to go:
+    if (lines != wheel_lines)
+        m_pixel_offset = 0;
+
+    if (view->left != m_content_view->left || view->version != m_content_view->version || view->point != m_content_view->point || view->mark != m_content_view->mark)
+        return;
+    if (lines == 0) {
+        m_repaint_to = 0;
+        return;
+    }
+    if (std::abs(lines) >= content_rows())
+        return;
+    shift_content(lines);
+    if (lines > 0) {
+        m_repaint_from = content_rows() - lines;
+    } else {
+        m_repaint_to = -lines;
+    }
+}
+
+// Moves the rendered content up (lines > 0) or down (lines < 0). The rows
+// that scroll into view are left for the buffer to paint.
+void Editor::shift_content(int lines)
+{
+    auto* renderer = App::instance().renderer();
+    auto h = content_rows() * line_height();
+    auto shift = std::abs(lines) * line_height();
+    SDL_Rect src { 0, (lines > 0) ? shift : 0, width(), h - shift };
+    SDL_Rect dest { 0, (lines > 0) ? 0 : shift, width(), h - shift };
+    SDL_SetRenderTarget(renderer, m_scratch);
+    SDL_RenderCopy(renderer, m_content, &src, &dest);
+    std::swap(m_content, m_scratch);
 }
 
 void Editor::render()
 {
-    box(SDL_Rect { 0, 0, 0, 0 }, SDL_Color { 0x2c, 0x2c, 0x2c, 0xff });
+    if (width() <= 0 || line_height() <= 0)
+        return;
+    auto* renderer = App::instance().renderer();
+    if (m_content == nullptr) {
+        auto h = content_rows() * line_height();
+        m_content = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width(), h);
+        m_scratch = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width(), h);
+        if (m_content == nullptr || m_scratch == nullptr)
+            fatal("Could not create editor render target: {}", SDL_GetError());
+        m_content_view.reset();
+    }
+
+    buffer()->prepare();
+    prepare_content(buffer()->content_view());
+    SDL_SetRenderTarget(renderer, m_content);
+    m_offscreen = true;
+    if (m_repaint_to > m_repaint_from) {
+        box(SDL_Rect { 0, line_top(m_repaint_from), 0, (m_repaint_to - m_repaint_from) * line_height() },
+            SDL_Color { 0x2c, 0x2c, 0x2c, 0xff });
+    }
     m_line = 0;
     m_column = 0;
+    m_cursor.reset();
     buffer()->render();
+    m_offscreen = false;
+    SDL_SetRenderTarget(renderer, nullptr);
+    m_content_buffer = buffer();
+    m_content_view = buffer()->content_view();
+
+    SDL_Rect src { 0, m_pixel_offset, width(), height() };
+    SDL_Rect dest { left(), top(), width(), height() };
+    SDL_RenderCopy(renderer, m_content, &src, &dest);
+
+    // The cursor blinks, so it's drawn on top of the content instead of
+    // being part of it:
+    if (m_cursor.has_value() && App::instance().modal() == nullptr) {
+        static auto time_start = std::chrono::system_clock::now();
+        auto time_end = std::chrono::system_clock::now();
+        const long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
+        if (elapsed > 400) {
+            SDL_Rect r {
+                column_left(m_cursor->column),
+                line_top(m_cursor->line) - m_pixel_offset,
+                1,
+                line_height()
+            };
+            if (r.y >= 0)
+                box(r, App::instance().color(PaletteIndex::Cursor));
+            if (elapsed > 800)
+                time_start = time_end;
+        }
+    }
 }
 
 void Editor::mark_current_line(int line)
 {
-    if (line < 0 || line >= rows())
+    if (line < 0 || line >= content_rows() || !needs_repaint(line))
         return;
     SDL_Rect r {
         0,
@@ -140,24 +282,9 @@ void Editor::mark_current_line(int line)
 
 void Editor::text_cursor(int line, int column)
 {
-    if (line < 0 || line >= rows() || column < 0 || column >= columns() || App::instance().modal() != nullptr)
+    if (line < 0 || line >= content_rows() || column < 0 || column >= columns())
         return;
-    static auto time_start = std::chrono::system_clock::now();
-    auto time_end = std::chrono::system_clock::now();
-    const long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_start).count();
-    if (elapsed > 400) {
-        //        Clipper clipCode(App::instance().renderer(), rectCode);
-
-        SDL_Rect r {
-            column_left(column),
-            line_top(line),
-            1,
-            line_height()
-        };
-        box(r, App::instance().color(PaletteIndex::Cursor));
-        if (elapsed > 800)
-            time_start = time_end;
-    }
+    m_cursor = DocumentPosition { line, column };
 }
 
 void Editor::append(DisplayToken const& token)
@@ -184,7 +311,7 @@ void Editor::handle_mousedown(SDL_MouseButtonEvent const& event)
     auto offset_x = event.x - left();
     auto offset_y = event.y - top();
     auto column = offset_x / App::instance().context()->character_width();
-    auto line = offset_y / line_height();
+    auto line = mouse_line(offset_y);
     m_mouse_down_at = { column, line };
     buffer()->mousedown(line, column);
 }
@@ -195,7 +322,7 @@ void Editor::handle_motion(SDL_MouseMotionEvent const& event)
         auto offset_x = event.x - left();
         auto offset_y = event.y - top();
         auto column = offset_x / App::instance().context()->character_width();
-        auto line = offset_y / line_height();
+        auto line = mouse_line(offset_y);
         if (column != m_mouse_down_at->left() || line != m_mouse_down_at->top()) {
             buffer()->motion(line, column);
         }
@@ -213,14 +340,33 @@ void Editor::handle_click(SDL_MouseButtonEvent const& event)
     auto offset_x = event.x - left();
     auto offset_y = event.y - top();
     auto column = offset_x / App::instance().context()->character_width();
-    auto line = offset_y / line_height();
+    auto line = mouse_line(offset_y);
     buffer()->click(line, column, event.clicks);
     m_mouse_down_at = {};
 }
 
+int Editor::mouse_line(int offset_y) const
+{
+    return (offset_y + m_pixel_offset) / line_height();
+}
+
 void Editor::handle_wheel(SDL_MouseWheelEvent const& event)
 {
-    buffer()->wheel(-event.y);
+    if (line_height() <= 0)
+        return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    m_pixel_offset -= static_cast<int>(event.preciseY * static_cast<float>(line_height()));
+#else
+    m_pixel_offset -= event.y * line_height();
+#endif
+    auto lines = m_pixel_offset / line_height();
+    if (m_pixel_offset < 0 && m_pixel_offset % line_height() != 0)
+        --lines;
+    m_pixel_offset -= lines * line_height();
+    if (lines != 0) {
+        m_wheel_lines += lines;
+        buffer()->wheel(lines);
+    }
 }
 
 void Editor::handle_text_input()
@@ -324,7 +470,7 @@ std::vector<BufferId> Editor::buffer_ids() const
     ret.resize(m_buffers.size());
     for (auto ix = 0u; ix < m_buffers.size(); ++ix) {
         auto const& buf = m_buffers[ix];
-        ret[ix] = { ix, buf->title(), buf->short_title() };
+        ret[ix] = { ix, std::string(buf->title()), std::string(buf->short_title()) };
     }
     std::sort(ret.begin(), ret.end(),
         [](auto const& id1, auto const& id2) {
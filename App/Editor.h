@@ -50,6 +50,7 @@ struct BufferId {
 class Editor : public WindowedWidget {
 public:
     Editor();
+    ~Editor() override;
 
     [[nodiscard]] Buffer* buffer() const;
     [[nodiscard]] Document* document() const;
@@ -67,6 +68,7 @@ public:
     std::string save_all() const;
 
     [[nodiscard]] int rows() const;
+    [[nodiscard]] int content_rows() const;
     [[nodiscard]] int columns() const;
     [[nodiscard]] int line_top(int line) const;
     [[nodiscard]] int line_bottom(int line) const;
@@ -74,9 +76,15 @@ public:
     [[nodiscard]] static int column_right(int column);
     [[nodiscard]] int line_height() const;
     [[nodiscard]] static int column_width();
+    [[nodiscard]] bool needs_repaint(int row) const;
+    [[nodiscard]] int pixel_offset() const { return m_pixel_offset; }
+    [[nodiscard]] int top() const override;
+    [[nodiscard]] int left() const override;
+    [[nodiscard]] int height() const override;
 
     void resize(Box const&) override;
     void render() override;
+    void invalidate_content();
     void text_cursor(int line, int column);
     void mark_current_line(int line);
     bool dispatch(SDL_Keysym) override;
@@ -103,6 +111,10 @@ public:
     }
 
 private:
+    void prepare_content(std::optional<ContentView> const&);
+    void shift_content(int);
+    [[nodiscard]] int mouse_line(int) const;
+
     std::vector<std::unique_ptr<Buffer>> m_buffers {};
     Buffer* m_current_buffer { nullptr };
     int m_line { 0 };
@@ -111,6 +123,20 @@ private:
     int m_columns { -1 };
     int m_line_height { 0 };
     std::optional<Position> m_mouse_down_at;
+
+    // The buffer is rendered into m_content, which is a couple of rows
+    // taller than the editor so it can be shown at a pixel offset for
+    // smooth scrolling. m_scratch is used to shift the content on scrolls.
+    SDL_Texture* m_content { nullptr };
+    SDL_Texture* m_scratch { nullptr };
+    Buffer const* m_content_buffer { nullptr };
+    std::optional<ContentView> m_content_view {};
+    int m_repaint_from { 0 };
+    int m_repaint_to { 0 };
+    int m_pixel_offset { 0 };
+    int m_wheel_lines { 0 };
+    bool m_offscreen { false };
+    std::optional<DocumentPosition> m_cursor {};
     static EditorCommands s_editor_commands;
 };
 
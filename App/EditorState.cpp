@@ -9,6 +9,12 @@
 
 namespace Scratch {
 
+DisplayToken::DisplayToken(std::string const& t, PaletteIndex c)
+    : text(App::instance().frame_arena().store(t))
+    , color(c)
+{
+}
+
 Glyph::Glyph(Char ch, PaletteIndex idx)
     : character(ch)
     , colorIndex(idx)
@@ -69,14 +69,10 @@ struct DisplayToken {
     {
     }
 
-    explicit DisplayToken(std::string t, PaletteIndex c = PaletteIndex::Default)
-        : text_string(std::move(t))
-        , text(text_string.value())
-        , color(c)
-    {
-    }
+    // The text is copied into the frame arena, so it's only valid until
+    // the next frame is rendered.
+    explicit DisplayToken(std::string const& t, PaletteIndex c = PaletteIndex::Default);
 
-    std::optional<std::string> text_string {};
     std::string_view text;
     PaletteIndex color;
 };
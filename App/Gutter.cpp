@@ -4,7 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <core/Format.h>
+#include <cstdlib>
 
 #include "Widget/SDLContext.h"
 #include <App/Gutter.h>
@@ -15,23 +15,38 @@ namespace Scratch {
 Gutter::Gutter()
     : WindowedWidget(SizePolicy::Characters, 10)
 {
-    set_renderer([](WindowedWidget* gutter) -> void {
+    set_renderer([this](WindowedWidget* gutter) -> void {
         auto *doc = Scratch::editor()->document();
         if (doc == nullptr)
             return;
         auto screen_top = doc->screen_top();
         auto lines = doc->line_count();
         auto rows = Scratch::editor()->rows();
-        for (auto row = 0; row < rows && screen_top + row < lines; ++row) {
-            auto x = 24;
-            auto y = Scratch::editor()->line_top(row);
+        auto point_line = doc->point_line();
+        auto line_number_color = App::instance().color(PaletteIndex::LineNumber);
+        auto point_line_color = App::instance().color(PaletteIndex::ANSIBrightYellow);
+        for (auto row = 0; row <= rows && screen_top + row < lines; ++row) {
+            auto y = Scratch::editor()->line_top(row) - Scratch::editor()->pixel_offset();
+            if (y < 0)
+                continue;
 
             auto line = screen_top + row;
-            auto color = PaletteIndex::LineNumber;
-            if (line == doc->point_line())
-                color = PaletteIndex::ANSIBrightYellow;
-            gutter->render_fixed(x, (int)y, Obelix::format("{>4}", line + 1),
-                App::instance().color(color));
+            switch (doc->line_state(line)) {
+            case LineState::Edited:
+                gutter->box(SDL_Rect { 4, y, 4, Scratch::editor()->line_height() }, App::instance().color(PaletteIndex::LineEdited));
+                break;
+            case LineState::EditedSaved:
+                gutter->box(SDL_Rect { 4, y, 4, Scratch::editor()->line_height() }, App::instance().color(PaletteIndex::LineEditedSaved));
+                break;
+            default:
+                break;
+            }
+            if (line == point_line) {
+                gutter->render_number(24, y, line + 1, 4, point_line_color);
+            } else {
+                auto number = (m_relative_line_numbers) ? std::abs(line - point_line) : line + 1;
+                gutter->render_number(24, y, number, 4, line_number_color);
+            }
         }
     });
 }
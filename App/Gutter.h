@@ -12,6 +12,12 @@ namespace Scratch {
 class Gutter : public WindowedWidget {
 public:
     Gutter();
+
+    [[nodiscard]] bool relative_line_numbers() const { return m_relative_line_numbers; }
+    void relative_line_numbers(bool relative) { m_relative_line_numbers = relative; }
+
+private:
+    bool m_relative_line_numbers { false };
 };
 
 }
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <cctype>
+
+#include <App/Minimap.h>
+#include <App/Scratch.h>
+
+namespace Scratch {
+
+extern_logging_category(scratch);
+
+static uint32_t argb(SDL_Color color)
+{
+    return (static_cast<uint32_t>(color.a) << 24) | (static_cast<uint32_t>(color.r) << 16) | (static_cast<uint32_t>(color.g) << 8) | color.b;
+}
+
+Minimap::Minimap()
+    : WindowedWidget(SizePolicy::Absolute, SCRATCH_MINIMAP_WIDTH)
+{
+}
+
+Minimap::~Minimap()
+{
+    if (m_texture != nullptr)
+        SDL_DestroyTexture(m_texture);
+}
+
+int Minimap::bucket(int line) const
+{
+    auto it = std::upper_bound(m_bucket_starts.begin(), m_bucket_starts.end(), line);
+    return std::max(static_cast<int>(it - m_bucket_starts.begin()) - 1, 0);
+}
+
+int Minimap::bucket_end(int b) const
+{
+    return (b + 1 < static_cast<int>(m_bucket_starts.size())) ? m_bucket_starts[b + 1] : m_line_count;
+}
+
+// Colors the pixels of one bucket. For every column, the first line in the
+// bucket that has something other than whitespace in that column wins.
+void Minimap::paint_bucket(Document* doc, int b, std::vector<uint32_t>& pixels) const
+{
+    pixels.assign(SCRATCH_MINIMAP_WIDTH, 0u);
+    auto const& lines = doc->lines();
+    auto last = std::min(bucket_end(b), static_cast<int>(lines.size()));
+    for (auto ix = m_bucket_starts[b]; ix < last; ++ix) {
+        auto column = 0;
+        for (auto const& token : lines[ix].tokens) {
+            if (column >= SCRATCH_MINIMAP_WIDTH)
+                break;
+            auto color = argb(App::instance().color(doc->token_color(token)));
+            for (auto ch : token.value()) {
+                if (column >= SCRATCH_MINIMAP_WIDTH)
+                    break;
+                if (!isspace(static_cast<unsigned char>(ch)) && pixels[column] == 0u)
+                    pixels[column] = color;
+                ++column;
+            }
+        }
+    }
+}
+
+// Splits the lines into buckets of the same size, as many as fit.
+void Minimap::layout(int line_count)
+{
+    m_lines_per_bucket = std::max(1, (line_count + rows() - 1) / rows());
+    m_line_count = line_count;
+    m_bucket_starts.clear();
+    for (auto start = 0; start < std::max(line_count, 1); start += m_lines_per_bucket)
+        m_bucket_starts.push_back(start);
+}
+
+// Moves the bucket boundaries for a change of the document's lines, and
+// marks the buckets that have changed lines. Returns false when a bucket
+// ended up empty or too large, and the buckets need to be laid out again.
+// With one line per bucket, every bucket has to stay at one line.
+bool Minimap::apply(LineChange const& change, std::vector<bool>& dirty)
+{
+    auto end = change.line + change.removed;
+    auto delta = change.inserted - change.removed;
+    for (auto& start : m_bucket_starts) {
+        if (start <= change.line)
+            continue;
+        start = (start >= end) ? start + delta : change.line + change.inserted;
+    }
+    m_line_count += delta;
+
+    auto max_size = (m_lines_per_bucket > 1) ? 2 * m_lines_per_bucket : 1;
+    for (auto b = 0; b < static_cast<int>(m_bucket_starts.size()); ++b) {
+        auto size = bucket_end(b) - m_bucket_starts[b];
+        if (size < 1 || size > max_size)
+            return false;
+    }
+    auto first = bucket(std::max(change.line - 1, 0));
+    auto last = bucket(std::clamp(change.line + change.inserted, 0, m_line_count - 1));
+    for (auto b = first; b <= last; ++b)
+        dirty[b] = true;
+    return true;
+}
+
+void Minimap::update(Document* doc)
+{
+    std::optional<std::vector<LineChange>> changes;
+    if (m_texture != nullptr && m_document == doc && m_height == height())
+        changes = doc->line_changes(m_version);
+    std::vector<bool> dirty(m_bucket_starts.size(), false);
+    auto full = !changes.has_value();
+    for (auto ix = 0u; !full && ix < changes->size(); ++ix)
+        full = !apply((*changes)[ix], dirty);
+    full = full || m_line_count != doc->line_count();
+
+    if (full) {
+        if (m_texture == nullptr || m_height != height()) {
+            if (m_texture != nullptr)
+                SDL_DestroyTexture(m_texture);
+            m_height = height();
+            m_texture = SDL_CreateTexture(App::instance().renderer(), SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                SCRATCH_MINIMAP_WIDTH, rows());
+            if (m_texture == nullptr) {
+                log_error("Could not create minimap texture: {}", SDL_GetError());
+                return;
+            }
+            SDL_SetTextureBlendMode(m_texture, SDL_BLENDMODE_BLEND);
+        }
+        layout(doc->line_count());
+        dirty.assign(m_bucket_starts.size(), true);
+    }
+
+    // Runs of changed buckets are uploaded in one go:
+    std::vector<uint32_t> pixels;
+    std::vector<uint32_t> bucket_pixels;
+    auto buckets = static_cast<int>(m_bucket_starts.size());
+    for (auto from = 0; from < buckets;) {
+        if (!dirty[from]) {
+            ++from;
+            continue;
+        }
+        auto to = from;
+        pixels.clear();
+        for (; to < buckets && dirty[to]; ++to) {
+            paint_bucket(doc, to, bucket_pixels);
+            pixels.insert(pixels.end(), bucket_pixels.begin(), bucket_pixels.end());
+        }
+        SDL_Rect rect { 0, from, SCRATCH_MINIMAP_WIDTH, to - from };
+        SDL_UpdateTexture(m_texture, &rect, pixels.data(), SCRATCH_MINIMAP_WIDTH * static_cast<int>(sizeof(uint32_t)));
+        from = to;
+    }
+    m_document = doc;
+}
+
+void Minimap::render()
+{
+    auto* doc = Scratch::editor()->document();
+    if (doc == nullptr || !doc->parsed())
+        return;
+    if (m_texture == nullptr || doc != m_document || doc->version() != m_version || height() != m_height) {
+        update(doc);
+        m_version = doc->version();
+    }
+    if (m_texture == nullptr)
+        return;
+
+    auto buckets = static_cast<int>(m_bucket_starts.size());
+    box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(PaletteIndex::Background));
+    SDL_Rect src { 0, 0, SCRATCH_MINIMAP_WIDTH, buckets };
+    SDL_Rect dest { left(), top(), SCRATCH_MINIMAP_WIDTH, buckets * SCRATCH_MINIMAP_ROW_HEIGHT };
+    SDL_RenderCopy(App::instance().renderer(), m_texture, &src, &dest);
+
+    auto view_top = bucket(doc->screen_top()) * SCRATCH_MINIMAP_ROW_HEIGHT;
+    auto view_bottom = (bucket(doc->screen_top() + Scratch::editor()->rows() - 1) + 1) * SCRATCH_MINIMAP_ROW_HEIGHT;
+    box(SDL_Rect { 0, view_top, width(), std::max(view_bottom - view_top, SCRATCH_MINIMAP_ROW_HEIGHT) }, SDL_Color { 0xff, 0xff, 0xff, 0x30 });
+}
+
+void Minimap::jump_to(int y)
+{
+    auto* doc = Scratch::editor()->document();
+    if (doc == nullptr)
+        return;
+    if (m_bucket_starts.empty())
+        return;
+    auto row = std::min(std::max(y - top(), 0) / SCRATCH_MINIMAP_ROW_HEIGHT, static_cast<int>(m_bucket_starts.size()) - 1);
+    doc->move_to(m_bucket_starts[row], 0, false);
+}
+
+void Minimap::handle_mousedown(SDL_MouseButtonEvent const& event)
+{
+    m_mouse_down = true;
+    jump_to(event.y);
+}
+
+void Minimap::handle_motion(SDL_MouseMotionEvent const& event)
+{
+    if (m_mouse_down && (event.state & SDL_BUTTON_LMASK))
+        jump_to(event.y);
+    else
+        m_mouse_down = false;
+}
+
+void Minimap::handle_click(SDL_MouseButtonEvent const& event)
+{
+    m_mouse_down = false;
+    jump_to(event.y);
+}
+
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <SDL.h>
+
+#include <Widget/Widget.h>
+
+#ifndef SCRATCH_MINIMAP_WIDTH
+#define SCRATCH_MINIMAP_WIDTH 120
+#endif /* SCRATCH_MINIMAP_WIDTH */
+
+#ifndef SCRATCH_MINIMAP_ROW_HEIGHT
+#define SCRATCH_MINIMAP_ROW_HEIGHT 2
+#endif /* SCRATCH_MINIMAP_ROW_HEIGHT */
+
+namespace Scratch {
+
+struct LineChange;
+class Document;
+
+// Shows the whole current document as one pixel per column, and one row
+// per bucket of lines, with the visible part highlighted. The overview is
+// kept in a texture, and the document reports which lines changed, so only
+// the rows of those buckets are repainted and uploaded. Lines inserted or
+// deleted make their bucket grow or shrink, instead of moving all the
+// lines after them to another bucket. The buckets are laid out again when
+// one gets empty or twice its size.
+class Minimap : public WindowedWidget {
+public:
+    Minimap();
+    ~Minimap() override;
+
+    void render() override;
+    void handle_mousedown(SDL_MouseButtonEvent const&) override;
+    void handle_motion(SDL_MouseMotionEvent const&) override;
+    void handle_click(SDL_MouseButtonEvent const&) override;
+
+private:
+    void update(Document*);
+    void layout(int);
+    bool apply(LineChange const&, std::vector<bool>&);
+    void paint_bucket(Document*, int, std::vector<uint32_t>&) const;
+    void jump_to(int);
+    [[nodiscard]] int bucket(int line) const;
+    [[nodiscard]] int bucket_end(int b) const;
+    [[nodiscard]] int rows() const { return std::max(1, m_height / SCRATCH_MINIMAP_ROW_HEIGHT); }
+
+    SDL_Texture* m_texture { nullptr };
+    Document const* m_document { nullptr };
+    size_t m_version { 0 };
+    int m_height { 0 };
+    int m_lines_per_bucket { 1 };
+    int m_line_count { 0 };
+    std::vector<int> m_bucket_starts {};
+    bool m_mouse_down { false };
+};
+
+}
@@ -10,7 +10,10 @@
 #include <core/Logging.h>
 
 #include <App/Console.h>
+#include <App/Minimap.h>
 #include <App/Scratch.h>
+#include <App/Scrollbar.h>
+#include <Scribble/Interp/Interpreter.h>
 #include <Widget/SDLContext.h>
 
 #ifndef WINDOW_WIDTH
@@ -29,6 +32,16 @@ logging_category(scratch);
 
 Scratch::ScratchCommands::ScratchCommands()
 {
+    register_command({ "dump-profile", "Write frame profile to CSV file",
+        {
+            { "CSV file name", CommandParameterType::String }
+        },
+        [](Widget&, strings const& args) -> void {
+            if (auto err = App::instance().profiler().dump(args[0]); !err.empty())
+                log_error("{}", err);
+        }
+    });
+
     register_command({ "enlarge-font", "Enlarge editor font", {},
         [](Widget&, strings const&) -> void {
             App::instance().enlarge_font();
@@ -76,6 +89,19 @@ Scratch::ScratchCommands::ScratchCommands()
         }
     }, { SDLK_MINUS, KMOD_GUI });
 
+    register_command({ "toggle-profiler", "Show or hide frame profiler", {},
+        [](Widget&, strings const&) -> void {
+            auto& app = App::instance();
+            app.show_profiler(!app.profiler_visible());
+        }
+    }, { SDLK_p, KMOD_CTRL | KMOD_SHIFT });
+
+    register_command({ "toggle-relative-line-numbers", "Show line numbers relative to the cursor line", {},
+        [](Widget&, strings const&) -> void {
+            auto* gutter = Scratch::gutter();
+            gutter->relative_line_numbers(!gutter->relative_line_numbers());
+        }
+    });
 }
 
 Scratch::ScratchCommands Scratch::s_scratch_commands;
@@ -120,16 +146,34 @@ Scratch::Scratch(Config& config, SDLContext *ctx)
     m_commands = &s_scratch_commands;
 }
 
+// The editor keeps the rendered lines in a target texture, which the
+// renderer may have dropped:
+void Scratch::render_targets_reset()
+{
+    if (m_editor != nullptr)
+        m_editor->invalidate_content();
+}
+
 Editor* Scratch::editor()
 {
     return scratch().m_editor;
 }
 
+Gutter* Scratch::gutter()
+{
+    return scratch().m_gutter;
+}
+
 StatusBar* Scratch::status_bar()
 {
     return scratch().m_status_bar;
 }
 
+Interp::ScriptRunner& Scratch::script_runner()
+{
+    return scratch().m_script_runner;
+}
+
 void Scratch::add_status_bar_applet(int size, Renderer renderer)
 {
     status_bar()->add_applet(size, std::move(renderer));
@@ -145,8 +189,51 @@ void Scratch::run_app(int argc, char const** argv)
     Config config(argc, argv);
     debug(scratch, "The logger works!");
 
-    auto ctx = new SDLContext(WINDOW_WIDTH, WINDOW_HEIGHT);
-    Scratch app(config, ctx);
+    auto app = create(config);
+    app->event_loop();
+}
+
+std::unique_ptr<Scratch> Scratch::create(Config& config)
+{
+    auto ctx = new SDLContext(WINDOW_WIDTH, WINDOW_HEIGHT, config.cmdline_flag<bool>("headless", false));
+    std::unique_ptr<Scratch> app_ptr(new Scratch(config, ctx));
+    auto& app = *app_ptr;
+    if (auto pacing = config.cmdline_flag<std::string>("pacing"); !pacing.empty()) {
+        if (pacing == "fixed") {
+            app.frame_pacing(FramePacing::Fixed);
+        } else if (pacing == "adaptive") {
+            app.frame_pacing(FramePacing::Adaptive);
+        } else if (pacing == "deadline") {
+            app.frame_pacing(FramePacing::Deadline);
+        } else {
+            log_error("Unknown frame pacing '{}'", pacing);
+        }
+    }
+    if (auto engine_name = config.cmdline_flag<std::string>("scribble-engine"); !engine_name.empty()) {
+        if (auto engine = Interp::ScribbleEngine_by_name(engine_name); engine.has_value())
+            Interp::set_scribble_engine(*engine);
+        else
+            log_error("Unknown Scribble engine '{}'", engine_name);
+    }
+    if (auto mode_name = config.cmdline_flag<std::string>("scribble-mode"); !mode_name.empty()) {
+        if (auto mode = Interp::ScriptMode_by_name(mode_name); mode.has_value())
+            app.m_script_runner.mode(*mode);
+        else
+            log_error("Unknown Scribble mode '{}'", mode_name);
+    }
+    // A script running on the event loop keeps it from seeing the Esc key,
+    // so it has to ask SDL directly. The key press is thrown away so it
+    // doesn't also close whatever has the focus. Scripts on the worker
+    // thread leave this to the runner.
+    Interp::ExecutionBudget::set_cancel_poll([]() -> bool {
+        if (Interp::ScriptRunner::on_worker_thread())
+            return false;
+        SDL_PumpEvents();
+        if (SDL_GetKeyboardState(nullptr)[SDL_SCANCODE_ESCAPE] == 0)
+            return false;
+        SDL_FlushEvents(SDL_KEYDOWN, SDL_KEYUP);
+        return true;
+    });
     auto main_area = new Layout(ContainerOrientation::Horizontal);
     app.add_component(main_area);
     app.add_component(app.m_status_bar = new StatusBar());
@@ -166,6 +253,19 @@ void Scratch::run_app(int argc, char const** argv)
         applet->box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(box_color));
         applet->render_fixed_centered(2, "fps", SDL_Color { 0xff, 0xff, 0xff, 0xff });
     });
+    app.add_status_bar_applet(8, [](WindowedWidget* applet) -> void {
+        PaletteIndex box_color;
+        auto latency = App::instance().input_latency();
+        if (latency <= 17) {
+            box_color = PaletteIndex::ANSIGreen;
+        } else if (latency <= 34) {
+            box_color = PaletteIndex::ANSIYellow;
+        } else {
+            box_color = PaletteIndex::ANSIBrightRed;
+        }
+        applet->box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(box_color));
+        applet->render_fixed_centered(2, App::instance().frame_arena().printf("%dms", static_cast<int>(latency)), SDL_Color { 0xff, 0xff, 0xff, 0xff });
+    });
     app.add_status_bar_applet(7, [](WindowedWidget* applet) -> void {
         PaletteIndex box_color;
         auto *doc = Scratch::scratch().editor()->document();
@@ -182,20 +282,29 @@ void Scratch::run_app(int argc, char const** argv)
         applet->box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(box_color));
         applet->render_fixed_centered(2, "parse", SDL_Color { 0xff, 0xff, 0xff, 0xff });
     });
+    app.add_status_bar_applet(8, [](WindowedWidget* applet) -> void {
+        auto& runner = Scratch::script_runner();
+        if (!runner.is_running())
+            return;
+        static char const spinner[] = { '|', '/', '-', '\\' };
+        auto elapsed = runner.elapsed().count();
+        applet->box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(PaletteIndex::ANSIBlue));
+        applet->render_fixed_centered(2, App::instance().frame_arena().printf("%c %d.%ds", spinner[(elapsed / 100) % countof(spinner)], static_cast<int>(elapsed / 1000), static_cast<int>(elapsed % 1000 / 100)), SDL_Color { 0xff, 0xff, 0xff, 0xff });
+    });
+    if (config.cmdline_flag<bool>("profile", false))
+        app.show_profiler(true);
     main_area->add_component(app.m_gutter = new Gutter());
+    app.m_gutter->relative_line_numbers(config.cmdline_flag<bool>("relative-line-numbers", false));
     main_area->add_component(app.m_editor = new Editor());
+    if (config.cmdline_flag<bool>("minimap", false))
+        main_area->add_component(new Minimap());
+    main_area->add_component(new ScrollBar(app.m_editor));
     app.m_editor->add_buffer<Console>();
     app.m_editor->add_buffer<Document>();
     if (!app.m_config.filename.empty())
         app.m_editor->open_file(app.m_config.filename);
     app.focus(app.m_editor);
-    app.event_loop();
+    return app_ptr;
 }
 
 }
-
-int main(int argc, char const** argv)
-{
-    Scratch::Scratch::run_app(argc, argv);
-    return 0;
-}
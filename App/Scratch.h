@@ -10,6 +10,7 @@
 #include <App/Editor.h>
 #include <App/Gutter.h>
 #include <App/StatusBar.h>
+#include <Scribble/Interp/ScriptRunner.h>
 
 namespace Scratch {
 
@@ -40,8 +41,11 @@ private:
 class Scratch : public App {
 public:
     static void run_app(int, char const**);
+    static std::unique_ptr<Scratch> create(Config&);
     [[nodiscard]] static Editor* editor();
+    [[nodiscard]] static Gutter* gutter();
     [[nodiscard]] static StatusBar* status_bar();
+    [[nodiscard]] static Interp::ScriptRunner& script_runner();
     static void add_status_bar_applet(int, Renderer);
     static Scratch& scratch();
 
@@ -50,12 +54,16 @@ public:
         ScratchCommands();
     };
 
+protected:
+    void render_targets_reset() override;
+
 private:
     Scratch(Config& config, SDLContext *ctx);
     Config& m_config;
     Editor* m_editor { nullptr };
     Gutter* m_gutter { nullptr };
     StatusBar* m_status_bar { nullptr };
+    Interp::ScriptRunner m_script_runner {};
 
     static ScratchCommands s_scratch_commands;
 };
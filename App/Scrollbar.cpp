@@ -4,39 +4,227 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include "Widget/App.h"
-#include <Scrollbar.h>
+#include <algorithm>
+#include <optional>
+#include <string_view>
+
+#include <App/Editor.h>
+#include <App/Scrollbar.h>
+#include <Widget/App.h>
 
 namespace Scratch {
 
-ScrollBar::ScrollBar(Widget* scrolls, ScrollDirection direction)
-    : m_scrolls(scrolls)
-    , m_direction(direction)
+// -- OverviewSummary -------------------------------------------------------
+
+int OverviewSummary::bucket(int line) const
 {
+    auto it = std::upper_bound(starts.begin(), starts.end(), line);
+    return std::max(static_cast<int>(it - starts.begin()) - 1, 0);
 }
 
-void ScrollBar::release_mouse_down(App* app)
+int OverviewSummary::bucket_end(int b) const
 {
-    m_mouse_down = false;
-    App::instance().active(0);
+    return (b + 1 < static_cast<int>(starts.size())) ? starts[b + 1] : line_count;
 }
 
-void ScrollBar::check_mouse_down(App* app, Vec2 const& pos, float offset)
+// Splits the lines into buckets of the same size, as many as fit.
+void OverviewSummary::layout(int lines)
 {
-    if (m_mouse_down)
+    lines_per_bucket = std::max(1, (lines + bucket_count - 1) / bucket_count);
+    line_count = lines;
+    starts.clear();
+    for (auto start = 0; start < std::max(lines, 1); start += lines_per_bucket)
+        starts.push_back(start);
+    hits.assign(starts.size(), 0u);
+    changes.assign(starts.size(), LineState::None);
+}
+
+// Moves the bucket boundaries for a change of the document's lines, and
+// marks the buckets that have changed lines. Returns false when a bucket
+// ended up empty or too large, and the buckets need to be laid out again.
+bool OverviewSummary::apply(LineChange const& change, std::vector<bool>& dirty)
+{
+    auto end = change.line + change.removed;
+    auto delta = change.inserted - change.removed;
+    for (auto& start : starts) {
+        if (start <= change.line)
+            continue;
+        start = (start >= end) ? start + delta : change.line + change.inserted;
+    }
+    line_count += delta;
+
+    auto max_size = (lines_per_bucket > 1) ? 2 * lines_per_bucket : 1;
+    for (auto b = 0; b < static_cast<int>(starts.size()); ++b) {
+        auto size = bucket_end(b) - starts[b];
+        if (size < 1 || size > max_size)
+            return false;
+    }
+    auto first = bucket(std::max(change.line - 1, 0));
+    auto last = bucket(std::clamp(change.line + change.inserted, 0, line_count - 1));
+    for (auto b = first; b <= last; ++b)
+        dirty[b] = true;
+    return true;
+}
+
+// Counts the hits starting in the lines of the bucket. Only the text of
+// those lines is searched.
+void OverviewSummary::count_hits(Document const* doc, int b)
+{
+    hits[b] = 0;
+    auto const& lines = doc->lines();
+    auto first = starts[b];
+    auto last = std::min(bucket_end(b), static_cast<int>(lines.size()));
+    if (find_term.empty() || first >= last)
         return;
-    if (App::instance().active())
+    std::string_view text { doc->text() };
+    auto begin = static_cast<size_t>(lines[first].start_index);
+    auto end = (last < static_cast<int>(lines.size())) ? static_cast<size_t>(lines[last].start_index) : text.length();
+    auto range = text.substr(begin, std::min(end - begin + find_term.length() - 1, text.length() - begin));
+    for (auto pos = range.find(find_term); pos != std::string_view::npos && begin + pos < end; pos = range.find(find_term, pos + find_term.length()))
+        ++hits[b];
+}
+
+// Unsaved edits win over saved ones.
+void OverviewSummary::collect_changes(Document const* doc, int b)
+{
+    changes[b] = LineState::None;
+    for (auto line = starts[b]; line < bucket_end(b); ++line) {
+        auto state = doc->line_state(line);
+        if (state != LineState::None && changes[b] != LineState::Edited)
+            changes[b] = state;
+    }
+}
+
+void OverviewSummary::update(Document const* doc, int count)
+{
+    if (document == doc && version == doc->version() && line_states_version == doc->line_states_version()
+        && find_term == doc->find_term() && bucket_count == count)
         return;
-    if (intersects(pos.x, pos.y, m_point0.x, m_point0.y, m_point1.x, m_point1.y)) {
-        m_mouse_down_offset = offset;
-        m_mouse_down_pos = Vec2(pos.x, pos.y);
-        m_mouse_down = true;
-        App::instance().active((intptr_t)this);
+
+    std::optional<std::vector<LineChange>> line_changes;
+    if (document == doc && find_term == doc->find_term() && bucket_count == count)
+        line_changes = doc->line_changes(version);
+    std::vector<bool> dirty(starts.size(), false);
+    auto full = !line_changes.has_value();
+    for (auto ix = 0u; !full && ix < line_changes->size(); ++ix)
+        full = !apply((*line_changes)[ix], dirty);
+    full = full || line_count != doc->line_count();
+
+    // Saving turns edited lines into saved ones without changing any line:
+    auto all_states = !full && line_changes->empty() && line_states_version != doc->line_states_version();
+
+    document = doc;
+    version = doc->version();
+    line_states_version = doc->line_states_version();
+    find_term = doc->find_term();
+    bucket_count = count;
+    if (full) {
+        layout(doc->line_count());
+        dirty.assign(starts.size(), true);
     }
+    for (auto b = 0; b < static_cast<int>(starts.size()); ++b) {
+        if (dirty[b])
+            count_hits(doc, b);
+        if (dirty[b] || all_states)
+            collect_changes(doc, b);
+    }
+}
+
+// -- ScrollBar -------------------------------------------------------------
+
+ScrollBar::ScrollBar(Editor* editor)
+    : WindowedWidget(SizePolicy::Absolute, SCRATCH_SCROLLBAR_WIDTH)
+    , m_editor(editor)
+{
+}
+
+SDL_Rect ScrollBar::thumb(Document const* doc) const
+{
+    auto lines = std::max(doc->line_count(), 1);
+    auto visible = std::min(m_editor->rows(), lines);
+    auto h = std::max(height() * visible / lines, 8);
+    auto y = (height() - h) * doc->screen_top() / std::max(lines - visible, 1);
+    return SDL_Rect { 2, std::clamp(y, 0, height() - h), width() - 4, h };
 }
 
 void ScrollBar::render()
 {
+    auto* doc = m_editor->document();
+    if (doc == nullptr || !doc->parsed())
+        return;
+    m_summary.update(doc, std::max(1, height() / SCRATCH_SCROLLBAR_BUCKET_HEIGHT));
+
+    box(SDL_Rect { 0, 0, 0, 0 }, App::instance().color(PaletteIndex::Background));
+    box(thumb(doc), SDL_Color { 0x80, 0x80, 0x80, 0x80 });
+
+    // Buckets can hold fewer lines than a bucket has pixels, when the
+    // document is shorter than the track:
+    auto lines = std::max(doc->line_count(), 1);
+    auto edited = App::instance().color(PaletteIndex::LineEdited);
+    auto saved = App::instance().color(PaletteIndex::LineEditedSaved);
+    auto hit = App::instance().color(PaletteIndex::ANSIBrightYellow);
+    for (auto b = 0; b < static_cast<int>(m_summary.buckets()); ++b) {
+        auto first_line = m_summary.starts[b];
+        if (first_line >= doc->line_count())
+            break;
+        auto y = height() * first_line / lines;
+        auto bucket_height = std::max(SCRATCH_SCROLLBAR_BUCKET_HEIGHT, height() * (m_summary.bucket_end(b) - first_line) / lines);
+        switch (m_summary.changes[b]) {
+        case LineState::Edited:
+            box(SDL_Rect { 0, y, 3, bucket_height }, edited);
+            break;
+        case LineState::EditedSaved:
+            box(SDL_Rect { 0, y, 3, bucket_height }, saved);
+            break;
+        default:
+            break;
+        }
+        if (m_summary.hits[b] > 0)
+            box(SDL_Rect { 4, y, width() - 6, bucket_height }, hit);
+    }
+}
+
+void ScrollBar::scroll_to(int y)
+{
+    auto* doc = m_editor->document();
+    if (doc == nullptr)
+        return;
+    auto t = thumb(doc);
+    auto lines = std::max(doc->line_count(), 1);
+    auto visible = std::min(m_editor->rows(), lines);
+    auto track = std::max(height() - t.h, 1);
+    auto top = std::clamp(y - m_mouse_down_offset, 0, track) * std::max(lines - visible, 0) / track;
+    doc->wheel(top - doc->screen_top());
+}
+
+void ScrollBar::handle_mousedown(SDL_MouseButtonEvent const& event)
+{
+    auto* doc = m_editor->document();
+    if (doc == nullptr)
+        return;
+    auto y = event.y - top();
+    auto t = thumb(doc);
+    m_mouse_down = true;
+    if (y >= t.y && y < t.y + t.h) {
+        m_mouse_down_offset = y - t.y;
+    } else {
+        // Clicking the track centers the thumb on the mouse:
+        m_mouse_down_offset = t.h / 2;
+        scroll_to(y);
+    }
+}
+
+void ScrollBar::handle_motion(SDL_MouseMotionEvent const& event)
+{
+    if (m_mouse_down && (event.state & SDL_BUTTON_LMASK))
+        scroll_to(event.y - top());
+    else
+        m_mouse_down = false;
+}
+
+void ScrollBar::handle_click(SDL_MouseButtonEvent const&)
+{
+    m_mouse_down = false;
 }
 
 }
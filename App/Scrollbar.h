@@ -6,42 +6,78 @@
 
 #pragma once
 
-#include <Geometry.h>
-#include <Widget.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <App/EditorState.h>
+#include <Widget/Widget.h>
+
+#ifndef SCRATCH_SCROLLBAR_WIDTH
+#define SCRATCH_SCROLLBAR_WIDTH 14
+#endif /* SCRATCH_SCROLLBAR_WIDTH */
+
+#ifndef SCRATCH_SCROLLBAR_BUCKET_HEIGHT
+#define SCRATCH_SCROLLBAR_BUCKET_HEIGHT 2
+#endif /* SCRATCH_SCROLLBAR_BUCKET_HEIGHT */
 
 namespace Scratch {
 
-enum class ScrollDirection {
-    Horizontal,
-    Vertical,
-};
+class Document;
+class Editor;
+struct LineChange;
+
+// Where the search hits and changed lines of a document are, per bucket of
+// lines. One bucket is one marker slot in the scroll bar track, so drawing
+// the markers costs the same no matter how large the document is. Like the
+// minimap, it follows the lines the document reports as changed: only the
+// buckets holding those are counted again, and lines inserted or deleted
+// make their bucket grow or shrink. The buckets are laid out and counted
+// again when one gets empty or twice its size, or when the search term
+// changes.
+struct OverviewSummary {
+    Document const* document { nullptr };
+    size_t version { 0 };
+    size_t line_states_version { 0 };
+    std::string find_term {};
+    int bucket_count { 0 };
+    int lines_per_bucket { 1 };
+    int line_count { 0 };
+    std::vector<int> starts {};
+    std::vector<uint32_t> hits {};
+    std::vector<LineState> changes {};
 
+    [[nodiscard]] size_t buckets() const { return starts.size(); }
+    [[nodiscard]] int bucket(int line) const;
+    [[nodiscard]] int bucket_end(int b) const;
+    void update(Document const*, int);
 
-class ScrollBar : public Widget {
+private:
+    void layout(int);
+    bool apply(LineChange const&, std::vector<bool>&);
+    void count_hits(Document const*, int);
+    void collect_changes(Document const*, int);
+};
+
+// Vertical scroll bar for the editor. Next to the thumb, the track shows
+// markers for search hits and changed lines.
+class ScrollBar : public WindowedWidget {
 public:
-    ScrollBar(Widget *scrolls, ScrollDirection);
-    [[nodiscard]] Vec2 const& point0() const { return m_point0; }
-    void point0(Vec2 const& val) { m_point0 = val; }
-    [[nodiscard]] Vec2 const& point1() const { return m_point1; }
-    void point1(Vec2 const& val) { m_point1 = val; }
-
-    [[nodiscard]] Vec2 const& mouse_down_pos() const { return m_mouse_down_pos; }
-    [[nodiscard]] float mouse_down_offset() const { return m_mouse_down_offset; }
-    [[nodiscard]] bool is_mouse_down() const { return m_mouse_down; }
-    void release_mouse_down(class App*);
-    void check_mouse_down(class App*, Vec2 const&, float);
+    explicit ScrollBar(Editor*);
 
     void render() override;
+    void handle_mousedown(SDL_MouseButtonEvent const&) override;
+    void handle_motion(SDL_MouseMotionEvent const&) override;
+    void handle_click(SDL_MouseButtonEvent const&) override;
 
 private:
-    Widget *m_scrolls;
-    ScrollDirection m_direction;
-    Vec2 m_point0;
-    Vec2 m_point1;
-
-    bool m_mouse_down = false;
-    float m_mouse_down_offset = 0.0f;
-    Vec2 m_mouse_down_pos;
+    [[nodiscard]] SDL_Rect thumb(Document const*) const;
+    void scroll_to(int y);
+
+    Editor* m_editor;
+    OverviewSummary m_summary {};
+    bool m_mouse_down { false };
+    int m_mouse_down_offset { 0 };
 };
 
 }
@@ -0,0 +1,13 @@
+/*
+ * Copyright (c) 2022, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <App/Scratch.h>
+
+int main(int argc, char const** argv)
+{
+    Scratch::Scratch::run_app(argc, argv);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+#include <core/Format.h>
+
+#include <App/Scratch.h>
+
+using namespace Obelix;
+using namespace Scratch;
+
+// Renders a file offscreen while scrolling through it, and reports frame
+// rate and frame time statistics. Usage:
+//
+//   scratch_render_bench [--frames=N] [--step=N] <file>
+//
+// --frames is the number of frames to render (default 1000), --step is the
+// number of lines scrolled per frame (default 1). Scrolling reverses
+// direction at either end of the file.
+int main(int argc, char const** argv)
+{
+    std::vector<char const*> args { argv[0], "--headless" };
+    for (auto ix = 1; ix < argc; ++ix)
+        args.push_back(argv[ix]);
+    Config config(static_cast<int>(args.size()), args.data());
+    if (config.filename.empty()) {
+        fprintf(stderr, "Usage: %s [--frames=N] [--step=N] <file>\n", argv[0]);
+        return 1;
+    }
+    auto frames = try_to_long<std::string>()(config.cmdline_flag<std::string>("frames", "1000")).value_or(1000);
+    auto step = static_cast<int>(try_to_long<std::string>()(config.cmdline_flag<std::string>("step", "1")).value_or(1));
+    if (frames <= 0 || step <= 0) {
+        fprintf(stderr, "--frames and --step must be positive\n");
+        return 1;
+    }
+
+    auto app = Scratch::Scratch::create(config);
+    app->fit_to_renderer();
+    auto* doc = Scratch::Scratch::editor()->document();
+    if (doc == nullptr) {
+        fprintf(stderr, "Could not open '%s'\n", config.filename.c_str());
+        return 1;
+    }
+
+    // The first frame lexes the file. That's not what we're measuring:
+    app->render();
+
+    // The bench scrolls down and back up again. That needs more lines than
+    // fit in the editor, or it just jumps back and forth every frame:
+    auto scroll_range = doc->line_count() - Scratch::Scratch::editor()->rows();
+    if (scroll_range < step) {
+        fprintf(stderr, "'%s' has %d lines, and %d rows fit in the editor. Scrolling by %d needs at least %d lines\n",
+            config.filename.c_str(), doc->line_count(), Scratch::Scratch::editor()->rows(), step,
+            Scratch::Scratch::editor()->rows() + step);
+        return 1;
+    }
+
+    std::vector<double> times;
+    times.reserve(frames);
+    auto direction = step;
+    auto allocations_start = heap_allocations();
+    auto bench_start = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < frames; ++frame) {
+        auto top = doc->screen_top() + direction;
+        if (top < 0 || top > scroll_range)
+            direction = -direction;
+        doc->wheel(direction);
+        auto start = std::chrono::steady_clock::now();
+        app->render();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - bench_start;
+    auto allocations = heap_allocations() - allocations_start;
+
+    std::sort(times.begin(), times.end());
+    auto percentile = [&times](double p) -> double {
+        return times[static_cast<size_t>(p / 100.0 * static_cast<double>(times.size() - 1) + 0.5)];
+    };
+    printf("file:        %s (%d lines)\n", config.filename.c_str(), doc->line_count());
+    printf("frames:      %zu in %.3f s\n", times.size(), elapsed.count());
+    printf("fps:         %.1f\n", static_cast<double>(times.size()) / elapsed.count());
+    printf("frame time:  mean %.3f ms  p50 %.3f ms  p95 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+        std::accumulate(times.begin(), times.end(), 0.0) / static_cast<double>(times.size()),
+        percentile(50), percentile(95), percentile(99), times.back());
+    printf("allocations: %zu (%.2f per frame)\n", allocations, static_cast<double>(allocations) / static_cast<double>(times.size()));
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <core/Format.h>
+
+#include <App/Scratch.h>
+#include <Scribble/Interp/Interpreter.h>
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Interp/VirtualMachine.h>
+#include <Scribble/Parser.h>
+
+using namespace Obelix;
+using namespace Scratch;
+using namespace Scratch::Interp;
+
+// Runs a Scribble script with the tree interpreter and with the bytecode
+// virtual machine, with and without quickening, and reports the time per
+// run for each, and the number of heap allocations per expression node
+// evaluated by the tree interpreter. It also times a built-in loop doing
+// nothing but integer arithmetic and comparisons, which is where quickening
+// matters most. Usage:
+//
+//   scratch_scribble_bench [--runs=N] <script>
+//
+// --runs is the number of times the script is run by each engine (default
+// 10). Parsing the script is not part of the measurement, compiling it to
+// bytecode is.
+struct RunStats {
+    double time;
+    size_t allocations;
+    size_t nodes;
+};
+
+static RunStats run(ScribbleEngine engine, std::shared_ptr<Project> const& project, long runs, std::string& result)
+{
+    set_scribble_engine(engine);
+    auto allocations_start = heap_allocations();
+    auto nodes_start = evaluated_nodes();
+    auto start = std::chrono::steady_clock::now();
+    for (auto ix = 0; ix < runs; ++ix) {
+        auto res = interpret(project);
+        if (res.is_error()) {
+            result = res.error().to_string();
+        } else if (auto r = std::dynamic_pointer_cast<ExpressionResult>(res.value()); r != nullptr) {
+            result = r->value().to_string();
+        }
+    }
+    return {
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(runs),
+        (heap_allocations() - allocations_start) / static_cast<size_t>(runs),
+        (evaluated_nodes() - nodes_start) / static_cast<size_t>(runs),
+    };
+}
+
+// Evaluates 'a + b * c' with integer variables, to check that evaluating
+// numeric expressions doesn't allocate.
+static double allocations_per_node(long runs)
+{
+    InterpreterContext ctx;
+    for (auto const& [name, value] : std::vector<std::pair<std::string, long>> { { "a", 1 }, { "b", 2 }, { "c", 3 } })
+        (void) ctx.globals().define(name, Value(value));
+    auto project_maybe = ::Scratch::Scribble::compile_project("bench", std::make_shared<StringBuffer>(std::string("a + b * c")));
+    if (project_maybe.is_error())
+        return -1.0;
+    auto resolved = resolve(project_maybe.value(), ctx.globals());
+    if (resolved.is_error())
+        return -1.0;
+    auto module = std::dynamic_pointer_cast<Project>(resolved.value())->modules().back();
+    auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(module->statements().back());
+    if (stmt == nullptr)
+        return -1.0;
+
+    auto allocations_start = heap_allocations();
+    auto nodes_start = evaluated_nodes();
+    for (auto ix = 0; ix < runs * 1000; ++ix)
+        (void) evaluate(*stmt->expression(), ctx);
+    return static_cast<double>(heap_allocations() - allocations_start) / static_cast<double>(evaluated_nodes() - nodes_start);
+}
+
+static char const* integer_loop_script = R"(
+func sum(n) {
+    var s = 0
+    var i = 0
+    while (i < n) {
+        s = s + i * 3 - i % 7
+        i = i + 1
+    }
+    return s
+}
+sum(100000)
+)";
+
+// Times the integer loop on the virtual machine, without and with
+// quickening.
+static std::pair<double, double> integer_loop(long runs)
+{
+    auto project_maybe = ::Scratch::Scribble::compile_project("integer_loop", std::make_shared<StringBuffer>(std::string(integer_loop_script)));
+    if (project_maybe.is_error())
+        return { -1.0, -1.0 };
+    auto project = std::dynamic_pointer_cast<Project>(project_maybe.value());
+    std::string generic_result;
+    std::string quickened_result;
+    set_vm_quickening(false);
+    auto generic = run(ScribbleEngine::Bytecode, project, runs, generic_result);
+    set_vm_quickening(true);
+    auto quickened = run(ScribbleEngine::Bytecode, project, runs, quickened_result);
+    if (generic_result != quickened_result)
+        return { -1.0, -1.0 };
+    return { generic.time, quickened.time };
+}
+
+int main(int argc, char const** argv)
+{
+    std::vector<char const*> args { argv[0], "--headless" };
+    for (auto ix = 1; ix < argc; ++ix)
+        args.push_back(argv[ix]);
+    Config config(static_cast<int>(args.size()), args.data());
+    if (config.filename.empty()) {
+        fprintf(stderr, "Usage: %s [--runs=N] <script>\n", argv[0]);
+        return 1;
+    }
+    auto runs = try_to_long<std::string>()(config.cmdline_flag<std::string>("runs", "10")).value_or(10);
+    if (runs <= 0) {
+        fprintf(stderr, "--runs must be positive\n");
+        return 1;
+    }
+
+    // The builtins need the application to be there:
+    auto app = Scratch::Scratch::create(config);
+
+    // The bench runs on the main thread, where scripts are stopped after
+    // SCRATCH_SCRIPT_MAX_MILLIS. A long script would then be interrupted
+    // on the slower engine only:
+    ExecutionBudget::set_limits(0, std::chrono::milliseconds { 0 });
+
+    auto project_maybe = ::Scratch::Scribble::compile_project(config.filename);
+    if (project_maybe.is_error()) {
+        fprintf(stderr, "%s\n", project_maybe.error().to_string().c_str());
+        return 1;
+    }
+    auto project = std::dynamic_pointer_cast<Project>(project_maybe.value());
+
+    std::string tree_result;
+    std::string vm_result;
+    auto tree = run(ScribbleEngine::Tree, project, runs, tree_result);
+    std::string generic_result;
+    set_vm_quickening(false);
+    auto generic = run(ScribbleEngine::Bytecode, project, runs, generic_result);
+    set_vm_quickening(true);
+    auto vm = run(ScribbleEngine::Bytecode, project, runs, vm_result);
+    auto [loop_generic, loop_quickened] = integer_loop(runs);
+
+    printf("script:      %s (%ld runs)\n", config.filename.c_str(), runs);
+    printf("tree:        %.3f ms/run  %zu allocations/run  %zu nodes/run  %.2f allocations/node  result %s\n",
+        tree.time, tree.allocations, tree.nodes,
+        (tree.nodes > 0) ? static_cast<double>(tree.allocations) / static_cast<double>(tree.nodes) : 0.0,
+        tree_result.c_str());
+    printf("unquickened: %.3f ms/run  %zu allocations/run  result %s\n", generic.time, generic.allocations, generic_result.c_str());
+    printf("bytecode:    %.3f ms/run  %zu allocations/run  result %s\n", vm.time, vm.allocations, vm_result.c_str());
+    printf("speedup:     %.2fx over tree, %.2fx from quickening\n", tree.time / vm.time, generic.time / vm.time);
+    printf("int loop:    %.3f ms/run unquickened  %.3f ms/run quickened  %.2fx\n", loop_generic, loop_quickened, loop_generic / loop_quickened);
+    printf("a + b * c:   %.2f allocations/node\n", allocations_per_node(runs));
+    if (tree_result != vm_result || generic_result != vm_result) {
+        fprintf(stderr, "The engines returned different results\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <core/Logging.h>
+
+// Additions to the obelix logging macros, shared by the widgets, the editor
+// and the Scribble syntax tree alike.
+
+// Set to 0 to compile all lazy_debug messages out of the binary. Their
+// arguments are still type checked, but never evaluated.
+#ifndef SCRATCH_DEBUG_LOGGING
+#define SCRATCH_DEBUG_LOGGING 1
+#endif /* SCRATCH_DEBUG_LOGGING */
+
+// True if debug messages for the category will be emitted. Use it to skip
+// building a message, or the values that go in it, when they would be
+// thrown away anyway.
+#define debug_enabled(module) (SCRATCH_DEBUG_LOGGING && module##_logger.enabled())
+
+// Like debug(), but the arguments are only evaluated and the message only
+// formatted if the category is enabled. A disabled category costs a single
+// branch. Use this instead of debug() on hot paths, and for messages with
+// arguments that are expensive to compute, like to_string() of a subtree.
+#define lazy_debug(module, ...)             \
+    do {                                    \
+        if (debug_enabled(module))          \
+            debug(module, __VA_ARGS__);     \
+    } while (0)
@@ -83,13 +83,37 @@ DisplayToken CPlusPlusParser::colorize(TokenCode code, std::string_view const& t
     return DisplayToken { text, color };
 }
 
-Token const& CPlusPlusParser::next_token()
+// A block comment is lexed a line at a time, so the parser keeps track of
+// whether the comment ended on the line or goes on.
+Token const& CPlusPlusParser::pop_pending()
 {
-    if (!m_pending.empty()) {
-        auto const& token = m_pending.front();
-        m_pending.pop_front();
-        return token;
+    m_token = m_pending.front();
+    m_pending.pop_front();
+    if (m_token->code() == TokenCode::Comment) {
+        std::string_view text = m_token->value();
+        if (m_lex_state == LexStateNormal && text.starts_with("/*")) {
+            text.remove_prefix(2);
+            m_lex_state = LexStateBlockComment;
+        }
+        if (m_lex_state == LexStateBlockComment && text.ends_with("*/"))
+            m_lex_state = LexStateNormal;
     }
+    return *m_token;
+}
+
+std::string CPlusPlusParser::resume(LexState state)
+{
+    m_pending.clear();
+    m_lex_state = LexStateNormal;
+    if (state == LexStateBlockComment)
+        return "/*";
+    return {};
+}
+
+Token const& CPlusPlusParser::next_token()
+{
+    if (!m_pending.empty())
+        return pop_pending();
 
     while (m_pending.empty()) {
         auto const& token = lex();
@@ -166,10 +190,7 @@ Token const& CPlusPlusParser::next_token()
             break;
         }
     }
-
-    auto const& token = m_pending.front();
-    m_pending.pop_front();
-    return token;
+    return pop_pending();
 }
 
 void CPlusPlusParser::parse_include()
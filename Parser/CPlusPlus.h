@@ -7,6 +7,8 @@
 #pragma once
 
 #include <deque>
+#include <optional>
+#include <string>
 
 #include <App/EditorState.h>
 #include <Parser/ScratchParser.h>
@@ -60,9 +62,13 @@ public:
     constexpr static TokenCode TokenOperator = TokenCode::Keyword88;
     constexpr static TokenCode TokenConstant = TokenCode::Keyword89;
 
+    constexpr static LexState LexStateBlockComment = 1;
+
     CPlusPlusParser();
     Token const& next_token() override;
     DisplayToken colorize(TokenCode, std::string_view const& text) override;
+    [[nodiscard]] LexState lex_state() const override { return m_lex_state; }
+    std::string resume(LexState) override;
 
 private:
     void parse_include();
@@ -71,8 +77,11 @@ private:
     void parse_ifdef();
     Token const& lex_whitespace();
     Token const& get_next(TokenCode = TokenCode::Unknown);
+    Token const& pop_pending();
 
     std::deque<Token> m_pending;
+    std::optional<Token> m_token {};
+    LexState m_lex_state { LexStateNormal };
 };
 
 }
@@ -16,7 +16,19 @@ namespace Scratch::Parser {
 
 class ScratchParser : public BasicParser {
 public:
+    // State of the lexer at the end of a line. Documents are lexed in
+    // chunks, and a token that spans lines, like a block comment, only comes
+    // out right if a chunk starts in the state the one before it ended in.
+    using LexState = int;
+    constexpr static LexState LexStateNormal = 0;
+
     [[nodiscard]] virtual Token const& next_token() = 0;
+    [[nodiscard]] virtual LexState lex_state() const { return LexStateNormal; }
+
+    // Gets ready to lex text that starts in the given state. Returns text
+    // that has to be lexed ahead of it to get the lexer into that state;
+    // its characters are to be cut from the tokens that come back.
+    virtual std::string resume(LexState) { return {}; }
     [[nodiscard]] virtual DisplayToken colorize(TokenCode, std::string_view const&) = 0;
     [[nodiscard]] virtual std::vector<Command> commands() const;
     [[nodiscard]] virtual std::optional<ScheduledCommand> command(std::string const&) const;
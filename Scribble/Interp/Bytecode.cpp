@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+
+#include <Scribble/Interp/Bytecode.h>
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Interp/VirtualMachine.h>
+#include <Scribble/Scribble.h>
+#include <Scribble/Syntax/Literal.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+constexpr static TokenCode KeywordRange = ::Scratch::Scribble::Scribble::KeywordRange;
+
+// -- BytecodeFunction ------------------------------------------------------
+
+BytecodeFunction::BytecodeFunction(std::string name, VirtualMachine& vm, uint16_t arity)
+    : Function(std::move(name))
+    , m_vm(vm)
+    , m_arity(arity)
+{
+}
+
+Value BytecodeFunction::execute(std::vector<Value> const& arguments, InterpreterContext&) const
+{
+    return m_vm.call(*this, arguments);
+}
+
+Span const& BytecodeFunction::location(size_t ip) const
+{
+    static Span s_unknown {};
+    auto it = std::upper_bound(m_locations.begin(), m_locations.end(), ip, [](size_t ip, auto const& entry) {
+        return ip < entry.first;
+    });
+    if (it == m_locations.begin())
+        return s_unknown;
+    return (--it)->second;
+}
+
+// The text of the expression called by the Call instruction at ip, for
+// error messages.
+std::string BytecodeFunction::callee(size_t ip) const
+{
+    auto it = std::lower_bound(m_callees.begin(), m_callees.end(), ip, [](auto const& entry, size_t ip) {
+        return entry.first < ip;
+    });
+    if (it == m_callees.end() || it->first != ip)
+        return {};
+    return it->second;
+}
+
+// -- Compiler --------------------------------------------------------------
+
+Compiler::Compiler(VirtualMachine& vm)
+    : m_vm(vm)
+{
+}
+
+ErrorOr<pBytecodeFunction, SyntaxError> Compiler::compile(pModule const& module)
+{
+    m_functions.push_back({ std::make_shared<BytecodeFunction>(module->name(), m_vm, 0) });
+    auto const& statements = module->statements();
+    if (statements.empty())
+        emit(OpCode::PushNull);
+    for (auto ix = 0u; ix < statements.size(); ++ix) {
+        TRY_RETURN(compile_statement(statements[ix]));
+        if (ix < statements.size() - 1)
+            emit(OpCode::Pop);
+    }
+    emit(OpCode::Return);
+    auto ret = current().function;
+    m_functions.pop_back();
+    return ret;
+}
+
+// Every statement leaves exactly one value on the stack, the value the
+// tree interpreter would return for it.
+ErrorOr<void, SyntaxError> Compiler::compile_statement(pStatement const& statement)
+{
+    switch (statement->node_type()) {
+    case SyntaxNodeType::Block:
+        return compile_block(std::dynamic_pointer_cast<Block>(statement));
+    case SyntaxNodeType::FunctionDef:
+        return compile_function(std::dynamic_pointer_cast<FunctionDef>(statement));
+    case SyntaxNodeType::VariableDeclaration:
+        return compile_variable_declaration(std::dynamic_pointer_cast<VariableDeclaration>(statement));
+    case SyntaxNodeType::ExpressionStatement:
+        return compile_expression(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expression());
+    case SyntaxNodeType::IfStatement:
+        return compile_if(std::dynamic_pointer_cast<IfStatement>(statement));
+    case SyntaxNodeType::SwitchStatement:
+        return compile_switch(std::dynamic_pointer_cast<SwitchStatement>(statement));
+    case SyntaxNodeType::TableSwitch: {
+        auto switch_stmt = std::dynamic_pointer_cast<TableSwitch>(statement);
+        return compile_table_switch(switch_stmt, switch_stmt->table());
+    }
+    case SyntaxNodeType::WhileStatement:
+        return compile_while(std::dynamic_pointer_cast<WhileStatement>(statement));
+    case SyntaxNodeType::ForStatement:
+        return compile_for(std::dynamic_pointer_cast<ForStatement>(statement));
+    case SyntaxNodeType::Break:
+        return compile_loop_exit(statement, true);
+    case SyntaxNodeType::Continue:
+        return compile_loop_exit(statement, false);
+    case SyntaxNodeType::Return: {
+        auto ret = std::dynamic_pointer_cast<Return>(statement);
+        if (ret->expression() != nullptr)
+            TRY_RETURN(compile_expression(ret->expression()));
+        else
+            emit(OpCode::PushNull);
+        emit(OpCode::Return);
+        return {};
+    }
+    case SyntaxNodeType::Yield: {
+        auto yield_stmt = std::dynamic_pointer_cast<Yield>(statement);
+        if (yield_stmt->expression() != nullptr)
+            TRY_RETURN(compile_expression(yield_stmt->expression()));
+        else
+            emit(OpCode::PushNull);
+        emit(OpCode::Yield);
+        return {};
+    }
+    case SyntaxNodeType::Pass:
+    case SyntaxNodeType::Import:
+        emit(OpCode::PushNull);
+        return {};
+    default:
+        return SyntaxError { statement->location(), ErrorCode::InternalError, format("Cannot compile {}", statement->node_type()) };
+    }
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_block(pBlock const& block)
+{
+    begin_scope();
+    auto const& statements = block->statements();
+    if (statements.empty())
+        emit(OpCode::PushNull);
+    for (auto ix = 0u; ix < statements.size(); ++ix) {
+        TRY_RETURN(compile_statement(statements[ix]));
+        if (ix < statements.size() - 1)
+            emit(OpCode::Pop);
+    }
+    end_scope();
+    return {};
+}
+
+// The bodies of branches and loops get a scope of their own, so a variable
+// declared by a bare statement doesn't end up in the enclosing scope on one
+// path and not on the other.
+ErrorOr<void, SyntaxError> Compiler::compile_scoped(pStatement const& statement)
+{
+    begin_scope();
+    TRY_RETURN(compile_statement(statement));
+    end_scope();
+    return {};
+}
+
+// A function declared inside another one is a local of that function. Its
+// slot is reserved before the body is compiled, so the name is in scope for
+// the calls the function makes to itself.
+ErrorOr<void, SyntaxError> Compiler::compile_function(pFunctionDef const& def)
+{
+    auto const& address = std::dynamic_pointer_cast<ResolvedVariable>(def->identifier())->address();
+    std::optional<uint16_t> slot {};
+    if (address.is_local()) {
+        emit(OpCode::PushNull);
+        slot = add_local(address);
+    }
+
+    auto const& params = def->parameters();
+    auto function = std::make_shared<BytecodeFunction>(def->name(), m_vm, static_cast<uint16_t>(params.size()));
+    m_functions.push_back({ function });
+    current().scope_depth = 1;
+    for (auto const& param : params) {
+        ++current().height;
+        add_local(std::dynamic_pointer_cast<ResolvedVariable>(param)->address());
+    }
+    if (def->statement() != nullptr) {
+        auto ret = compile_scoped(def->statement());
+        if (ret.is_error()) {
+            m_functions.pop_back();
+            return ret.error();
+        }
+    } else {
+        emit(OpCode::PushNull);
+    }
+    emit(OpCode::Return);
+    m_functions.pop_back();
+
+    emit(OpCode::PushConstant, 0, add_constant(Value { std::static_pointer_cast<Function>(function) }));
+    if (slot.has_value()) {
+        emit(OpCode::StoreLocal, *slot);
+    } else {
+        locate(def->location());
+        emit(OpCode::DefineGlobal, 0, address.index);
+    }
+    emit(OpCode::Pop);
+    emit(OpCode::PushNull);
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_variable_declaration(pVariableDeclaration const& decl)
+{
+    auto const& address = std::dynamic_pointer_cast<ResolvedVariable>(decl->identifier())->address();
+    if (decl->expression() != nullptr)
+        TRY_RETURN(compile_expression(decl->expression()));
+    else
+        emit(OpCode::PushNull);
+    if (!address.is_local()) {
+        locate(decl->location());
+        emit(OpCode::DefineGlobal, 0, address.index);
+        return {};
+    }
+    emit(OpCode::LoadLocal, add_local(address));
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_if(pIfStatement const& if_stmt)
+{
+    auto height = current().height;
+    std::vector<size_t> ends;
+    for (auto const& branch : if_stmt->branches()) {
+        TRY_RETURN(compile_expression(branch->condition()));
+        locate(if_stmt->location());
+        auto next = emit(OpCode::JumpIfFalse);
+        TRY_RETURN(compile_scoped(branch->statement()));
+        ends.push_back(emit(OpCode::Jump));
+        patch(next, here());
+        current().height = height;
+    }
+    if (if_stmt->else_stmt() != nullptr)
+        TRY_RETURN(compile_scoped(if_stmt->else_stmt()));
+    else
+        emit(OpCode::PushNull);
+    for (auto end : ends)
+        patch(end, here());
+    return {};
+}
+
+// The switch expression is evaluated once and kept in a hidden slot while
+// the cases are compared against it. A switch with constant labels has been
+// turned into a TableSwitch by the resolver.
+ErrorOr<void, SyntaxError> Compiler::compile_switch(pSwitchStatement const& switch_stmt)
+{
+    TRY_RETURN(compile_expression(switch_stmt->expression()));
+    auto subject = static_cast<uint16_t>(current().height - 1);
+    auto height = current().height;
+    std::vector<size_t> ends;
+    for (auto const& case_stmt : switch_stmt->cases()) {
+        emit(OpCode::LoadLocal, subject);
+        TRY_RETURN(compile_expression(case_stmt->condition()));
+        emit(OpCode::EqualsTo);
+        locate(case_stmt->location());
+        auto next = emit(OpCode::JumpIfFalse);
+        TRY_RETURN(compile_scoped(case_stmt->statement()));
+        ends.push_back(emit(OpCode::Jump));
+        patch(next, here());
+        current().height = height;
+    }
+    if (switch_stmt->default_case() != nullptr)
+        TRY_RETURN(compile_scoped(switch_stmt->default_case()->statement()));
+    else
+        emit(OpCode::PushNull);
+    for (auto end : ends)
+        patch(end, here());
+    emit(OpCode::Slide, 1);
+    return {};
+}
+
+// A switch with constant labels jumps straight to the case that matches,
+// leaving the switch expression in its hidden slot like the comparing
+// version does.
+ErrorOr<void, SyntaxError> Compiler::compile_table_switch(pSwitchStatement const& switch_stmt, JumpTable table)
+{
+    TRY_RETURN(compile_expression(switch_stmt->expression()));
+    auto& tables = current().function->m_switch_tables;
+    auto index = static_cast<uint32_t>(tables.size());
+    tables.push_back({ std::move(table) });
+    locate(switch_stmt->location());
+    emit(OpCode::Switch, 0, index);
+    auto height = current().height;
+    std::vector<size_t> ends;
+    for (auto const& case_stmt : switch_stmt->cases()) {
+        current().function->m_switch_tables[index].targets.push_back(static_cast<uint32_t>(here()));
+        TRY_RETURN(compile_scoped(case_stmt->statement()));
+        ends.push_back(emit(OpCode::Jump));
+        current().height = height;
+    }
+    current().function->m_switch_tables[index].default_target = static_cast<uint32_t>(here());
+    if (switch_stmt->default_case() != nullptr)
+        TRY_RETURN(compile_scoped(switch_stmt->default_case()->statement()));
+    else
+        emit(OpCode::PushNull);
+    for (auto end : ends)
+        patch(end, here());
+    emit(OpCode::Slide, 1);
+    return {};
+}
+
+// Loops keep the value of the last iteration in a hidden slot. That's the
+// value of the loop statement.
+ErrorOr<void, SyntaxError> Compiler::compile_while(pWhileStatement const& while_stmt)
+{
+    emit(OpCode::PushNull);
+    auto result_slot = static_cast<uint16_t>(current().height - 1);
+    auto start = here();
+    TRY_RETURN(compile_expression(while_stmt->condition()));
+    locate(while_stmt->location());
+    auto exit = emit(OpCode::JumpIfFalse);
+    current().loops.push_back({ start, result_slot });
+    TRY_RETURN(compile_scoped(while_stmt->statement()));
+    emit(OpCode::Slide, 1);
+    emit(OpCode::Jump, 0, start);
+    patch(exit, here());
+    for (auto e : current().loops.back().exits)
+        patch(e, here());
+    current().loops.pop_back();
+    return {};
+}
+
+// Stack layout of a for loop: the counter, the upper bound, the loop
+// variable and the result. ForIter copies the counter into the loop
+// variable and increments it, or jumps out when the counter reaches the
+// upper bound.
+ErrorOr<void, SyntaxError> Compiler::compile_for(pForStatement const& for_stmt)
+{
+    auto range = std::dynamic_pointer_cast<BinaryExpression>(for_stmt->range());
+    if (range == nullptr || range->op().code() != KeywordRange)
+        return SyntaxError { for_stmt->location(), ErrorCode::TypeMismatch };
+    begin_scope();
+    TRY_RETURN(compile_expression(range->lhs()));
+    TRY_RETURN(compile_expression(range->rhs()));
+    locate(range->location());
+    emit(OpCode::Range);
+    auto counter = static_cast<uint16_t>(current().height - 2);
+    emit(OpCode::PushNull);
+    add_local(std::dynamic_pointer_cast<ResolvedVariable>(for_stmt->variable())->address());
+    emit(OpCode::PushNull);
+    auto result_slot = static_cast<uint16_t>(current().height - 1);
+    auto start = here();
+    auto exit = emit(OpCode::ForIter, counter);
+    current().loops.push_back({ start, result_slot });
+    TRY_RETURN(compile_scoped(for_stmt->statement()));
+    emit(OpCode::Slide, 1);
+    emit(OpCode::Jump, 0, start);
+    patch(exit, here());
+    for (auto e : current().loops.back().exits)
+        patch(e, here());
+    current().loops.pop_back();
+    end_scope(2);
+    return {};
+}
+
+// The resolver only lets break and continue through inside a loop.
+ErrorOr<void, SyntaxError> Compiler::compile_loop_exit(pStatement const& statement, bool is_break)
+{
+    if (current().loops.empty())
+        return SyntaxError { statement->location(), ErrorCode::InternalError, format("'{}' outside of a loop", statement->to_string()) };
+    auto height = current().height;
+    auto const& loop = current().loops.back();
+    if (auto drop = height - (loop.result_slot + 1); drop > 0)
+        emit(OpCode::PopN, static_cast<uint16_t>(drop));
+    if (is_break)
+        current().loops.back().exits.push_back(emit(OpCode::Jump));
+    else
+        emit(OpCode::Jump, 0, current().loops.back().start);
+
+    // Code following the break or continue is unreachable, but is compiled
+    // as if the statement left a value like any other:
+    current().height = height + 1;
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_expression(pExpression const& expr)
+{
+    switch (expr->node_type()) {
+    case SyntaxNodeType::Constant:
+        emit(OpCode::PushConstant, 0, add_constant(std::dynamic_pointer_cast<Constant>(expr)->value()));
+        return {};
+    case SyntaxNodeType::IntLiteral: {
+        auto literal = std::dynamic_pointer_cast<IntLiteral>(expr);
+        emit(OpCode::PushConstant, 0, add_constant(Value(token_value<long>(literal->token()).value())));
+        return {};
+    }
+    case SyntaxNodeType::StringLiteral: {
+        auto literal = std::dynamic_pointer_cast<StringLiteral>(expr);
+        emit(OpCode::PushConstant, 0, add_constant(Value(literal->string())));
+        return {};
+    }
+    case SyntaxNodeType::ResolvedVariable: {
+        auto const& address = std::dynamic_pointer_cast<ResolvedVariable>(expr)->address();
+        if (address.is_local())
+            emit(OpCode::LoadLocal, slot(address));
+        else
+            emit(OpCode::LoadGlobal, 0, address.index);
+        return {};
+    }
+    case SyntaxNodeType::ResolvedCall:
+        return compile_call(std::dynamic_pointer_cast<ResolvedCall>(expr));
+    case SyntaxNodeType::BinaryExpression:
+        return compile_binary_expression(std::dynamic_pointer_cast<BinaryExpression>(expr));
+    default:
+        return SyntaxError { expr->location(), ErrorCode::InternalError, format("Cannot compile {}", expr->node_type()) };
+    }
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_binary_expression(pBinaryExpression const& expr)
+{
+    OpCode op;
+    switch (expr->op().code()) {
+    case TokenCode::Equals:
+        return compile_assignment(expr);
+    case TokenCode::Plus:
+        op = OpCode::Add;
+        break;
+    case TokenCode::Minus:
+        op = OpCode::Subtract;
+        break;
+    case TokenCode::Asterisk:
+        op = OpCode::Multiply;
+        break;
+    case TokenCode::Slash:
+        op = OpCode::Divide;
+        break;
+    case TokenCode::Percent:
+        op = OpCode::Modulo;
+        break;
+    case TokenCode::EqualsTo:
+        op = OpCode::EqualsTo;
+        break;
+    case TokenCode::NotEqualTo:
+        op = OpCode::NotEqualTo;
+        break;
+    case TokenCode::GreaterThan:
+        op = OpCode::GreaterThan;
+        break;
+    case TokenCode::GreaterEqualThan:
+        op = OpCode::GreaterEqualThan;
+        break;
+    case TokenCode::LessThan:
+        op = OpCode::LessThan;
+        break;
+    case TokenCode::LessEqualThan:
+        op = OpCode::LessEqualThan;
+        break;
+    case KeywordRange:
+        // A range is only a value in the head of a for loop:
+        return SyntaxError { expr->location(), ErrorCode::TypeMismatch };
+    default:
+        return SyntaxError { expr->location(), ErrorCode::InternalError, format("Unimplemented operator {}", expr->op().value()) };
+    }
+    TRY_RETURN(compile_expression(expr->lhs()));
+    TRY_RETURN(compile_expression(expr->rhs()));
+    locate(expr->location());
+    emit(op);
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_call(std::shared_ptr<ResolvedCall> const& expr)
+{
+    TRY_RETURN(compile_expression(expr->lhs()));
+    uint16_t argc = 0;
+    if (auto args = std::dynamic_pointer_cast<ExpressionList>(expr->rhs()); args != nullptr) {
+        for (auto const& arg : args->expressions()) {
+            TRY_RETURN(compile_expression(arg));
+            ++argc;
+        }
+    } else {
+        TRY_RETURN(compile_expression(expr->rhs()));
+        argc = 1;
+    }
+    locate(expr->location());
+    current().function->m_callees.emplace_back(here(), expr->lhs()->to_string());
+    emit(OpCode::Call, argc, call_site(expr->call_site()));
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Compiler::compile_assignment(pBinaryExpression const& expr)
+{
+    auto variable = std::dynamic_pointer_cast<ResolvedVariable>(expr->lhs());
+    if (variable == nullptr)
+        return SyntaxError { expr->location(), ErrorCode::CannotAssignToRValue, expr->lhs() };
+    TRY_RETURN(compile_expression(expr->rhs()));
+    if (auto const& address = variable->address(); address.is_local())
+        emit(OpCode::StoreLocal, slot(address));
+    else
+        emit(OpCode::StoreGlobal, 0, address.index);
+    return {};
+}
+
+size_t Compiler::emit(OpCode op, uint16_t a, uint32_t b)
+{
+    auto& state = current();
+    switch (op) {
+    case OpCode::PushConstant:
+    case OpCode::PushNull:
+    case OpCode::LoadLocal:
+    case OpCode::LoadGlobal:
+        ++state.height;
+        break;
+    case OpCode::Pop:
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Modulo:
+    case OpCode::EqualsTo:
+    case OpCode::NotEqualTo:
+    case OpCode::GreaterThan:
+    case OpCode::GreaterEqualThan:
+    case OpCode::LessThan:
+    case OpCode::LessEqualThan:
+    case OpCode::JumpIfFalse:
+        --state.height;
+        break;
+    case OpCode::PopN:
+    case OpCode::Slide:
+    case OpCode::Call:
+        state.height -= a;
+        break;
+    default:
+        break;
+    }
+    state.function->m_code.push_back({ op, a, b });
+    return state.function->m_code.size() - 1;
+}
+
+void Compiler::patch(size_t ix, size_t target)
+{
+    current().function->m_code[ix].b = static_cast<uint32_t>(target);
+}
+
+uint32_t Compiler::add_constant(Value value)
+{
+    auto& constants = current().function->m_constants;
+    constants.push_back(std::move(value));
+    return static_cast<uint32_t>(constants.size() - 1);
+}
+
+// Records the source location of the next instruction, for error messages.
+void Compiler::locate(Span const& location)
+{
+    current().function->m_locations.emplace_back(here(), location);
+}
+
+void Compiler::begin_scope()
+{
+    ++current().scope_depth;
+}
+
+// Drops the locals of the scope, plus any hidden slots the construct that
+// opened the scope left below the result, while keeping the result on top.
+void Compiler::end_scope(uint16_t hidden)
+{
+    auto& state = current();
+    uint16_t count = hidden;
+    while (!state.locals.empty() && state.locals.back().depth == state.scope_depth) {
+        state.locals.pop_back();
+        ++count;
+    }
+    if (count > 0)
+        emit(OpCode::Slide, count);
+    --state.scope_depth;
+}
+
+// Gives the local the resolver declared the slot of the value on top of
+// the stack. The resolver numbers the locals of a function in the order
+// they're declared, reusing the numbers of locals that went out of scope,
+// so a number stands for the local declared with it most recently.
+uint16_t Compiler::add_local(VariableAddress const& address)
+{
+    auto& state = current();
+    auto slot = static_cast<uint16_t>(state.height - 1);
+    state.locals.push_back({ state.scope_depth, slot });
+    if (state.slots.size() <= address.index)
+        state.slots.resize(address.index + 1);
+    state.slots[address.index] = slot;
+    return slot;
+}
+
+uint16_t Compiler::slot(VariableAddress const& address)
+{
+    return current().slots[address.index];
+}
+
+// Translates the locals in scope at a call from the resolver's numbers to
+// stack slots. Calls made one after the other usually see the same locals,
+// so they share an entry.
+uint32_t Compiler::call_site(CallSite const& resolved)
+{
+    CallSite site;
+    for (auto const& [global, local] : resolved.locals())
+        site.add(global, current().slots[local]);
+    auto& sites = current().function->m_call_sites;
+    if (sites.empty() || !(sites.back() == site))
+        sites.push_back(std::move(site));
+    return static_cast<uint32_t>(sites.size() - 1);
+}
+
+}
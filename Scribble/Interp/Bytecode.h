@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <core/Error.h>
+
+#include <Scribble/Interp/Function.h>
+#include <Scribble/Interp/JumpTable.h>
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Interp/Value.h>
+#include <Scribble/Syntax/ControlFlow.h>
+#include <Scribble/Syntax/Function.h>
+#include <Scribble/Syntax/Statement.h>
+#include <Scribble/Syntax/Variable.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+// Operands: 'a' is a stack slot or a count, 'b' is a constant index, a
+// global index, a switch table index, a call site index or a jump target.
+// The compiler doesn't emit the opcodes
+// following Return; they are the quickened forms the virtual machine
+// rewrites arithmetic and comparisons into once it has seen the types of
+// their operands.
+#define ENUMERATE_OPCODES(S) \
+    S(PushConstant)          \
+    S(PushNull)              \
+    S(Pop)                   \
+    S(PopN)                  \
+    S(Slide)                 \
+    S(LoadLocal)             \
+    S(StoreLocal)            \
+    S(LoadGlobal)            \
+    S(StoreGlobal)           \
+    S(DefineGlobal)          \
+    S(Add)                   \
+    S(Subtract)              \
+    S(Multiply)              \
+    S(Divide)                \
+    S(Modulo)                \
+    S(EqualsTo)              \
+    S(NotEqualTo)            \
+    S(GreaterThan)           \
+    S(GreaterEqualThan)      \
+    S(LessThan)              \
+    S(LessEqualThan)         \
+    S(Range)                 \
+    S(Jump)                  \
+    S(JumpIfFalse)           \
+    S(ForIter)               \
+    S(Switch)                \
+    S(Call)                  \
+    S(Yield)                 \
+    S(Return)                \
+    S(AddInt)                \
+    S(SubtractInt)           \
+    S(MultiplyInt)           \
+    S(ModuloInt)             \
+    S(AddText)               \
+    S(EqualsToInt)           \
+    S(NotEqualToInt)         \
+    S(GreaterThanInt)        \
+    S(GreaterEqualThanInt)   \
+    S(LessThanInt)           \
+    S(LessEqualThanInt)
+
+enum class OpCode : uint8_t {
+#undef ENUM_OPCODE
+#define ENUM_OPCODE(op) op,
+    ENUMERATE_OPCODES(ENUM_OPCODE)
+#undef ENUM_OPCODE
+};
+
+constexpr char const* OpCode_name(OpCode op)
+{
+    switch (op) {
+#undef ENUM_OPCODE
+#define ENUM_OPCODE(op) \
+    case OpCode::op:    \
+        return #op;
+        ENUMERATE_OPCODES(ENUM_OPCODE)
+#undef ENUM_OPCODE
+    default:
+        fatal("Unknown OpCode value '{}'", (int)op);
+    }
+}
+
+struct Instruction {
+    OpCode op;
+    uint16_t a { 0 };
+    uint32_t b { 0 };
+};
+
+static_assert(sizeof(Instruction) == 8);
+
+class VirtualMachine;
+
+// The jump table of a switch with constant labels, and where the code of
+// each case, and of the default, starts.
+struct SwitchTable {
+    JumpTable table;
+    std::vector<uint32_t> targets {};
+    uint32_t default_target { 0 };
+};
+
+// A function compiled to bytecode. Every module is compiled to one of these
+// as well, taking no arguments. Locals live in stack slots relative to the
+// frame base; the arguments are slots 0 up to the arity.
+class BytecodeFunction : public Function {
+public:
+    BytecodeFunction(std::string, VirtualMachine&, uint16_t arity);
+    [[nodiscard]] Value execute(std::vector<Value> const&, InterpreterContext&) const override;
+
+    [[nodiscard]] uint16_t arity() const { return m_arity; }
+    [[nodiscard]] std::vector<Instruction> const& code() const { return m_code; }
+    [[nodiscard]] Values const& constants() const { return m_constants; }
+    [[nodiscard]] std::vector<SwitchTable> const& switch_tables() const { return m_switch_tables; }
+    [[nodiscard]] std::vector<CallSite> const& call_sites() const { return m_call_sites; }
+    [[nodiscard]] Span const& location(size_t ip) const;
+    [[nodiscard]] std::string callee(size_t ip) const;
+
+    // Replaces the opcode of an instruction by a quickened, or generic,
+    // form with the same operands. Doesn't change what the function does,
+    // which is why it's allowed on a const function.
+    void quicken(size_t ip, OpCode op) const { m_code[ip].op = op; }
+
+private:
+    friend class Compiler;
+
+    VirtualMachine& m_vm;
+    uint16_t m_arity;
+    mutable std::vector<Instruction> m_code {};
+    Values m_constants {};
+    std::vector<SwitchTable> m_switch_tables {};
+    std::vector<CallSite> m_call_sites {};
+    std::vector<std::pair<size_t, Span>> m_locations {};
+    std::vector<std::pair<size_t, std::string>> m_callees {};
+};
+
+using pBytecodeFunction = std::shared_ptr<BytecodeFunction>;
+
+// Compiles a resolved module to a BytecodeFunction. The resolver has
+// decided which variables are globals and which are locals, and what every
+// name refers to, for both engines. The compiler keeps track of the height
+// of the stack so every local, loop counter and statement result has a
+// known slot.
+class Compiler {
+public:
+    explicit Compiler(VirtualMachine&);
+    ErrorOr<pBytecodeFunction, SyntaxError> compile(pModule const&);
+
+private:
+    struct Local {
+        int depth;
+        uint16_t slot;
+    };
+
+    struct Loop {
+        size_t start;
+        uint16_t result_slot;
+        std::vector<size_t> exits {};
+    };
+
+    struct FunctionState {
+        pBytecodeFunction function;
+        std::vector<Local> locals {};
+        std::vector<uint16_t> slots {};
+        std::vector<Loop> loops {};
+        int scope_depth { 0 };
+        uint16_t height { 0 };
+    };
+
+    ErrorOr<void, SyntaxError> compile_statement(pStatement const&);
+    ErrorOr<void, SyntaxError> compile_block(pBlock const&);
+    ErrorOr<void, SyntaxError> compile_scoped(pStatement const&);
+    ErrorOr<void, SyntaxError> compile_function(pFunctionDef const&);
+    ErrorOr<void, SyntaxError> compile_variable_declaration(pVariableDeclaration const&);
+    ErrorOr<void, SyntaxError> compile_if(pIfStatement const&);
+    ErrorOr<void, SyntaxError> compile_switch(pSwitchStatement const&);
+    ErrorOr<void, SyntaxError> compile_table_switch(pSwitchStatement const&, JumpTable);
+    ErrorOr<void, SyntaxError> compile_while(pWhileStatement const&);
+    ErrorOr<void, SyntaxError> compile_for(pForStatement const&);
+    ErrorOr<void, SyntaxError> compile_loop_exit(pStatement const&, bool);
+    ErrorOr<void, SyntaxError> compile_expression(pExpression const&);
+    ErrorOr<void, SyntaxError> compile_binary_expression(pBinaryExpression const&);
+    ErrorOr<void, SyntaxError> compile_call(std::shared_ptr<ResolvedCall> const&);
+    ErrorOr<void, SyntaxError> compile_assignment(pBinaryExpression const&);
+
+    [[nodiscard]] FunctionState& current() { return m_functions.back(); }
+    size_t emit(OpCode, uint16_t a = 0, uint32_t b = 0);
+    void patch(size_t, size_t);
+    [[nodiscard]] size_t here() { return current().function->m_code.size(); }
+    uint32_t add_constant(Value);
+    void locate(Span const&);
+    void begin_scope();
+    void end_scope(uint16_t hidden = 0);
+    uint16_t add_local(VariableAddress const&);
+    [[nodiscard]] uint16_t slot(VariableAddress const&);
+    uint32_t call_site(CallSite const&);
+
+    VirtualMachine& m_vm;
+    std::vector<FunctionState> m_functions {};
+};
+
+}
@@ -9,9 +9,9 @@
 
 namespace Scratch::Interp {
 
-CommandAdapter::CommandAdapter(std::string function, ScheduledCommand const& command)
+CommandAdapter::CommandAdapter(std::string function, ScheduledCommand command)
     : Function(std::move(function))
-    , m_command(command)
+    , m_command(std::move(command))
 {
 }
 
@@ -23,8 +23,11 @@ Value CommandAdapter::execute(std::vector<Value> const& arguments, InterpreterCo
     for (auto const& a : arguments) {
         args.push_back(a.to_string());
     }
-    m_command.command.function(m_command.owner, args);
-    return Value {};
+    // Commands work on widgets, which only the event loop gets to touch:
+    return Scratch::script_runner().on_main_thread([this, &args]() -> Value {
+        m_command.command.function(m_command.owner, args);
+        return Value {};
+    });
 }
 
 } // Scratch::Interp
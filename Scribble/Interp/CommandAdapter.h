@@ -12,12 +12,15 @@
 
 namespace Scratch::Interp {
 
+// Runs an editor command as a Scribble function. Keeps its own copy of the
+// command: the adapter lives as long as the globals holding it, like those
+// of the Console.
 class CommandAdapter : public Function {
 public:
-    CommandAdapter(std::string, ScheduledCommand const&);
+    CommandAdapter(std::string, ScheduledCommand);
     Value execute(std::vector<Value> const&, InterpreterContext&) const override;
 private:
-    ScheduledCommand const& m_command;
+    ScheduledCommand m_command;
 };
 
 } // Scratch::Interp
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <thread>
+
+#include <Scribble/Interp/ExecutionBudget.h>
+#include <Scribble/Interp/ScriptRunner.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+static std::atomic<uint64_t> s_max_ticks { SCRATCH_SCRIPT_MAX_TICKS };
+static std::atomic<int64_t> s_max_millis { SCRATCH_SCRIPT_MAX_MILLIS };
+static std::atomic<bool> s_cancelled { false };
+static ExecutionBudget::CancelPoll s_cancel_poll {};
+
+void ExecutionBudget::set_limits(uint64_t max_ticks, std::chrono::milliseconds max_time)
+{
+    s_max_ticks = max_ticks;
+    s_max_millis = max_time.count();
+}
+
+std::chrono::milliseconds ExecutionBudget::max_time()
+{
+    return std::chrono::milliseconds { s_max_millis.load() };
+}
+
+void ExecutionBudget::cancel()
+{
+    s_cancelled = true;
+}
+
+bool ExecutionBudget::cancelled()
+{
+    return s_cancelled;
+}
+
+void ExecutionBudget::set_cancel_poll(CancelPoll poll)
+{
+    s_cancel_poll = std::move(poll);
+}
+
+// A script on the worker thread doesn't keep the editor from running, and
+// can be cancelled with Esc, so it doesn't get a time limit.
+void ExecutionBudget::start()
+{
+    s_cancelled = false;
+    m_ticks = 0;
+    m_max_ticks = s_max_ticks;
+    m_status = BudgetStatus::Running;
+    m_start = std::chrono::steady_clock::now();
+    if (auto max_millis = s_max_millis.load(); max_millis > 0 && !ScriptRunner::on_worker_thread())
+        m_deadline = m_start + std::chrono::milliseconds { max_millis };
+    else
+        m_deadline = std::chrono::steady_clock::time_point::max();
+    m_slice_end = std::chrono::steady_clock::time_point::max();
+}
+
+void ExecutionBudget::start_slice(std::chrono::milliseconds slice)
+{
+    if (m_status == BudgetStatus::SliceEnded)
+        m_status = BudgetStatus::Running;
+    m_deadline = std::chrono::steady_clock::time_point::max();
+    m_slice_end = std::chrono::steady_clock::now() + slice;
+
+    // The script may have been cancelled while it was put aside. Waiting
+    // for the next clock check would let it run for another
+    // SCRATCH_SCRIPT_CLOCK_INTERVAL ticks, or a slice per yield:
+    (void) check();
+}
+
+bool ExecutionBudget::sleep(std::chrono::milliseconds delay)
+{
+    auto until = std::chrono::steady_clock::now() + delay;
+    while (true) {
+        if (m_status == BudgetStatus::SliceEnded)
+            continue_slice();
+        if (!check())
+            return false;
+        auto now = std::chrono::steady_clock::now();
+        if (now >= until)
+            return true;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - now, std::chrono::milliseconds { SCRATCH_SCRIPT_NAP_MILLIS }));
+    }
+}
+
+bool ExecutionBudget::check()
+{
+    if (m_status != BudgetStatus::Running)
+        return false;
+    if (m_max_ticks != 0 && m_ticks >= m_max_ticks)
+        m_status = BudgetStatus::OutOfTicks;
+    else if (s_cancelled || (s_cancel_poll && s_cancel_poll()))
+        m_status = BudgetStatus::Cancelled;
+    else if (auto now = std::chrono::steady_clock::now(); now >= m_deadline)
+        m_status = BudgetStatus::OutOfTime;
+    else if (now >= m_slice_end)
+        m_status = BudgetStatus::SliceEnded;
+    return m_status == BudgetStatus::Running;
+}
+
+SyntaxError ExecutionBudget::error(Span const& location) const
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start);
+    switch (m_status) {
+    case BudgetStatus::OutOfTicks:
+        return SyntaxError { location, ErrorCode::ExecutionError, format("Script interrupted after {} steps", m_ticks) };
+    case BudgetStatus::OutOfTime:
+        return SyntaxError { location, ErrorCode::ExecutionError, format("Script interrupted after running for {} ms", elapsed.count()) };
+    case BudgetStatus::Cancelled:
+        return SyntaxError { location, ErrorCode::ExecutionError, format("Script cancelled after {} ms", elapsed.count()) };
+    default:
+        fatal("Budget of running script is not exhausted");
+    }
+}
+
+}
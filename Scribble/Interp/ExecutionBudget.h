@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include <Scribble/Syntax/Syntax.h>
+
+#ifndef SCRATCH_SCRIPT_MAX_TICKS
+#define SCRATCH_SCRIPT_MAX_TICKS 1000000000
+#endif /* SCRATCH_SCRIPT_MAX_TICKS */
+
+#ifndef SCRATCH_SCRIPT_MAX_MILLIS
+#define SCRATCH_SCRIPT_MAX_MILLIS 5000
+#endif /* SCRATCH_SCRIPT_MAX_MILLIS */
+
+// Longest a yield sleeps before it looks whether the script is cancelled.
+#ifndef SCRATCH_SCRIPT_NAP_MILLIS
+#define SCRATCH_SCRIPT_NAP_MILLIS 10
+#endif /* SCRATCH_SCRIPT_NAP_MILLIS */
+
+// Must be a power of two.
+#ifndef SCRATCH_SCRIPT_CLOCK_INTERVAL
+#define SCRATCH_SCRIPT_CLOCK_INTERVAL 1024
+#endif /* SCRATCH_SCRIPT_CLOCK_INTERVAL */
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+enum class BudgetStatus {
+    Running,
+    OutOfTicks,
+    OutOfTime,
+    Cancelled,
+    SliceEnded,
+};
+
+// Limits how long a script runs. Both engines call tick() at every loop back
+// edge and every call of a script function, so no script can keep running
+// without passing one. A tick is counted against the tick limit. Looking at
+// the clock, and asking whether the user wants the script cancelled, costs
+// more, so that is done once every SCRATCH_SCRIPT_CLOCK_INTERVAL ticks.
+//
+// Once the budget is exhausted it stays exhausted. A script function that
+// fails because of it evaluates to an ExecutionError value, and the next
+// check in the code that called it fails again, until the error reaches
+// the top of the script.
+class ExecutionBudget {
+public:
+    using CancelPoll = std::function<bool()>;
+
+    void start();
+
+    // Limits the time the script runs before it's put aside, for a script
+    // that runs in slices on the event loop. Such a script doesn't keep the
+    // editor from running, so it doesn't get a time limit.
+    void start_slice(std::chrono::milliseconds);
+
+    // Carries on with the slice that ended, for when the script can't be
+    // put aside at the point where that was noticed.
+    void continue_slice() { m_status = BudgetStatus::Running; }
+
+    [[nodiscard]] bool tick()
+    {
+        if (m_status != BudgetStatus::Running)
+            return false;
+        if ((++m_ticks & (SCRATCH_SCRIPT_CLOCK_INTERVAL - 1)) != 0)
+            return true;
+        return check();
+    }
+
+    // Waits for a yield of a script that can't be put aside. The wait is cut
+    // in naps of SCRATCH_SCRIPT_NAP_MILLIS, and stops when the script is
+    // cancelled or runs out of time. Returns false if it did.
+    [[nodiscard]] bool sleep(std::chrono::milliseconds);
+
+    [[nodiscard]] BudgetStatus status() const { return m_status; }
+
+    // Whether the script ran out of ticks or time, or was cancelled. A
+    // script function failing because of that only evaluates to an
+    // ExecutionError value, so the engines check this when the script is
+    // done.
+    [[nodiscard]] bool exhausted() const { return m_status != BudgetStatus::Running && m_status != BudgetStatus::SliceEnded; }
+    [[nodiscard]] SyntaxError error(Span const&) const;
+
+    // A limit of zero means no limit.
+    static void set_limits(uint64_t max_ticks, std::chrono::milliseconds max_time);
+    [[nodiscard]] static std::chrono::milliseconds max_time();
+
+    // Cancels the script running now, if any. Can be called from any
+    // thread.
+    static void cancel();
+    [[nodiscard]] static bool cancelled();
+
+    // Called every SCRATCH_SCRIPT_CLOCK_INTERVAL ticks; the script is
+    // cancelled when it returns true. The application uses this to look
+    // for the Esc key while a script keeps its event loop from running.
+    static void set_cancel_poll(CancelPoll);
+
+private:
+    bool check();
+
+    uint64_t m_ticks { 0 };
+    uint64_t m_max_ticks { 0 };
+    std::chrono::steady_clock::time_point m_start {};
+    std::chrono::steady_clock::time_point m_deadline {};
+    std::chrono::steady_clock::time_point m_slice_end {};
+    BudgetStatus m_status { BudgetStatus::Running };
+};
+
+}
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <Scribble/Interp/Folder.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+ProcessResult fold(pSyntaxNode const& tree)
+{
+    FolderContext ctx;
+    return process(tree, ctx);
+}
+
+}
+
+namespace Scratch::Scribble {
+
+using namespace Scratch::Interp;
+
+INIT_NODE_PROCESSOR(FolderContext)
+
+static std::shared_ptr<Constant> as_constant(pExpression const& expr)
+{
+    if (expr == nullptr || expr->node_type() != SyntaxNodeType::Constant)
+        return nullptr;
+    return std::static_pointer_cast<Constant>(expr);
+}
+
+// Only the operators the interpreter knows about are folded, using the same
+// Value operations, so a folded expression has the value it would have had
+// at run time.
+static std::optional<Value> fold_unary(TokenCode op, Value const& operand)
+{
+    Value ret;
+    switch (op) {
+    case TokenCode::Minus:
+        ret = operand.negate();
+        break;
+    case TokenCode::Plus:
+        if (operand.type() != ValueType::Integer && operand.type() != ValueType::Float)
+            return {};
+        ret = operand;
+        break;
+    case TokenCode::Tilde:
+        ret = operand.bitwise_not();
+        break;
+    case TokenCode::ExclamationPoint: {
+        auto value = operand.to_bool();
+        if (!value.has_value())
+            return {};
+        ret = Value(!*value);
+        break;
+    }
+    default:
+        return {};
+    }
+    if (ret.is_error())
+        return {};
+    return ret;
+}
+
+static std::optional<Value> fold_binary(TokenCode op, Value const& lhs, Value const& rhs)
+{
+    Value ret;
+    switch (op) {
+    case TokenCode::Plus:
+        ret = lhs.add(rhs);
+        break;
+    case TokenCode::Minus:
+        ret = lhs.subtract(rhs);
+        break;
+    case TokenCode::Asterisk:
+        ret = lhs.multiply(rhs);
+        break;
+    case TokenCode::Slash:
+        ret = lhs.divide(rhs);
+        break;
+    case TokenCode::Percent:
+        ret = lhs.modulo(rhs);
+        break;
+    case TokenCode::EqualsTo:
+        ret = Value(lhs == rhs);
+        break;
+    case TokenCode::NotEqualTo:
+        ret = Value(lhs != rhs);
+        break;
+    case TokenCode::GreaterThan:
+        ret = Value(lhs > rhs);
+        break;
+    case TokenCode::GreaterEqualThan:
+        ret = Value(lhs >= rhs);
+        break;
+    case TokenCode::LessThan:
+        ret = Value(lhs < rhs);
+        break;
+    case TokenCode::LessEqualThan:
+        ret = Value(lhs <= rhs);
+        break;
+    default:
+        return {};
+    }
+    if (ret.is_error())
+        return {};
+    return ret;
+}
+
+// The statements of branches and cases have a scope of their own. When one
+// replaces the statement it's part of, it's put in a block to keep it that
+// way.
+static pStatement scoped(pStatement const& statement)
+{
+    if (statement->node_type() == SyntaxNodeType::Block)
+        return statement;
+    return std::make_shared<Block>(statement->location(), Statements { statement });
+}
+
+static ErrorOr<Statements, SyntaxError> fold_statements(Statements const& statements, FolderContext& ctx, ProcessResult& result)
+{
+    Statements ret;
+    for (auto ix = 0u; ix < statements.size(); ++ix) {
+        auto statement = TRY(try_and_cast<Statement>(statements[ix], ctx, result));
+        if (statement->node_type() == SyntaxNodeType::Pass && ix < statements.size() - 1)
+            continue;
+        ret.push_back(statement);
+    }
+    return ret;
+}
+
+NODE_PROCESSOR(Module)
+{
+    auto module = std::dynamic_pointer_cast<Module>(tree);
+    auto statements = TRY(fold_statements(module->statements(), ctx, result));
+    return std::make_shared<Module>(module, statements, module->tokens());
+}
+
+NODE_PROCESSOR(Block)
+{
+    auto block = std::dynamic_pointer_cast<Block>(tree);
+    auto statements = TRY(fold_statements(block->statements(), ctx, result));
+    return std::make_shared<Block>(block->location(), statements);
+}
+
+// The default processor forgets that a declaration is a constant.
+NODE_PROCESSOR(VariableDeclaration)
+{
+    auto decl = std::dynamic_pointer_cast<VariableDeclaration>(tree);
+    std::shared_ptr<Expression> expr;
+    if (decl->expression() != nullptr)
+        expr = TRY_AND_CAST(Expression, decl->expression(), ctx);
+    return std::make_shared<VariableDeclaration>(decl->location(), decl->identifier(), expr, decl->is_const());
+}
+
+NODE_PROCESSOR(IntLiteral)
+{
+    auto literal = std::dynamic_pointer_cast<IntLiteral>(tree);
+    return std::make_shared<Constant>(literal->location(), Value(token_value<long>(literal->token()).value()));
+}
+
+NODE_PROCESSOR(StringLiteral)
+{
+    auto literal = std::dynamic_pointer_cast<StringLiteral>(tree);
+    return std::make_shared<Constant>(literal->location(), Value(literal->string()));
+}
+
+NODE_PROCESSOR(UnaryExpression)
+{
+    auto expr = std::dynamic_pointer_cast<UnaryExpression>(tree);
+    auto operand = TRY_AND_CAST(Expression, expr->operand(), ctx);
+    if (auto constant = as_constant(operand); constant != nullptr) {
+        if (auto value = fold_unary(expr->op().code(), constant->value()); value.has_value())
+            return std::make_shared<Constant>(expr->location(), *value);
+    }
+    return std::make_shared<UnaryExpression>(expr->op(), operand);
+}
+
+NODE_PROCESSOR(BinaryExpression)
+{
+    auto expr = std::dynamic_pointer_cast<BinaryExpression>(tree);
+    auto lhs = TRY_AND_CAST(Expression, expr->lhs(), ctx);
+    auto rhs = TRY_AND_CAST(Expression, expr->rhs(), ctx);
+    auto lhs_constant = as_constant(lhs);
+    auto rhs_constant = as_constant(rhs);
+    if (lhs_constant != nullptr && rhs_constant != nullptr) {
+        if (auto value = fold_binary(expr->op().code(), lhs_constant->value(), rhs_constant->value()); value.has_value())
+            return std::make_shared<Constant>(expr->location(), *value);
+    }
+    return std::make_shared<BinaryExpression>(lhs, expr->op(), rhs);
+}
+
+// Branches with a condition that is known to be false are dropped. A branch
+// with a condition known to be true becomes the else of the statement; if
+// no branches are left before it, it replaces the statement.
+NODE_PROCESSOR(IfStatement)
+{
+    auto if_stmt = std::dynamic_pointer_cast<IfStatement>(tree);
+    Branches branches;
+    pStatement else_stmt { nullptr };
+    bool taken = false;
+    for (auto const& branch : if_stmt->branches()) {
+        auto condition = TRY_AND_CAST(Expression, branch->condition(), ctx);
+        std::optional<bool> condition_value {};
+        if (auto constant = as_constant(condition); constant != nullptr)
+            condition_value = constant->value().to_bool();
+        if (condition_value.has_value() && !*condition_value)
+            continue;
+        auto statement = TRY_AND_CAST(Statement, branch->statement(), ctx);
+        if (condition_value.has_value()) {
+            else_stmt = statement;
+            taken = true;
+            break;
+        }
+        branches.push_back(std::make_shared<Branch>(branch, condition, statement));
+    }
+    if (!taken && if_stmt->else_stmt() != nullptr)
+        else_stmt = TRY_AND_CAST(Statement, if_stmt->else_stmt(), ctx);
+    if (branches.empty()) {
+        if (else_stmt == nullptr)
+            return std::make_shared<Pass>(if_stmt);
+        return scoped(else_stmt);
+    }
+    if (else_stmt != nullptr)
+        branches.push_back(std::make_shared<Branch>(else_stmt->location(), else_stmt));
+    return std::make_shared<IfStatement>(if_stmt->location(), branches);
+}
+
+// If the switch expression is a constant, cases with a different constant
+// are dropped, and the first case with the same constant becomes the
+// default. The statement is only replaced by a case if the switch
+// expression is a constant, because otherwise evaluating it could have
+// side effects.
+NODE_PROCESSOR(SwitchStatement)
+{
+    auto switch_stmt = std::dynamic_pointer_cast<SwitchStatement>(tree);
+    auto expr = TRY_AND_CAST(Expression, switch_stmt->expression(), ctx);
+    auto subject = as_constant(expr);
+    CaseStatements cases;
+    std::shared_ptr<DefaultCase> default_case { nullptr };
+    bool matched = false;
+    for (auto const& case_stmt : switch_stmt->cases()) {
+        auto condition = TRY_AND_CAST(Expression, case_stmt->condition(), ctx);
+        auto constant = as_constant(condition);
+        if (subject != nullptr && constant != nullptr && subject->value() != constant->value())
+            continue;
+        auto statement = TRY_AND_CAST(Statement, case_stmt->statement(), ctx);
+        if (subject != nullptr && constant != nullptr) {
+            default_case = std::make_shared<DefaultCase>(case_stmt, statement);
+            matched = true;
+            break;
+        }
+        cases.push_back(std::make_shared<CaseStatement>(case_stmt, condition, statement));
+    }
+    if (!matched && switch_stmt->default_case() != nullptr) {
+        auto statement = TRY_AND_CAST(Statement, switch_stmt->default_case()->statement(), ctx);
+        default_case = std::make_shared<DefaultCase>(switch_stmt->default_case(), statement);
+    }
+    if (cases.empty() && subject != nullptr) {
+        if (default_case == nullptr)
+            return std::make_shared<Pass>(switch_stmt);
+        return scoped(default_case->statement());
+    }
+    return std::make_shared<SwitchStatement>(switch_stmt->location(), expr, cases, default_case);
+}
+
+NODE_PROCESSOR(WhileStatement)
+{
+    auto while_stmt = std::dynamic_pointer_cast<WhileStatement>(tree);
+    auto condition = TRY_AND_CAST(Expression, while_stmt->condition(), ctx);
+    if (auto constant = as_constant(condition); constant != nullptr) {
+        if (auto value = constant->value().to_bool(); value.has_value() && !*value)
+            return std::make_shared<Pass>(while_stmt);
+    }
+    auto statement = TRY_AND_CAST(Statement, while_stmt->statement(), ctx);
+    return std::make_shared<WhileStatement>(while_stmt->location(), condition, statement);
+}
+
+}
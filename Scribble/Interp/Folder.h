@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Processor.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+// The folder doesn't keep track of anything while it walks the tree.
+class FolderContext {
+public:
+    [[nodiscard]] FolderContext& make_subcontext() { return *this; }
+};
+
+// Returns a copy of the tree where:
+//  - literals are replaced by Constant nodes;
+//  - unary and binary expressions with constant operands are replaced by
+//    their value, unless evaluating them is an error. Those are left alone
+//    so the error is reported when the expression is executed;
+//  - if branches and switch cases that can't be taken are removed, and if
+//    and switch statements of which the branch taken is known are replaced
+//    by that branch;
+//  - empty statements are removed, unless they are the last statement of a
+//    block and therefore provide its value.
+// Runs on the tree as it comes out of the parser, before the resolver or
+// the bytecode compiler get to it.
+[[nodiscard]] ProcessResult fold(pSyntaxNode const&);
+
+}
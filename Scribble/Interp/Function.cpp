@@ -34,13 +34,10 @@ Value ScribbleFunction::execute(std::vector<Value> const& arguments, Interpreter
     auto params = m_function->parameters();
     if (arguments.size() < params.size())
         return Value {};
-    InterpreterContext function_ctx(ctx);
-    for (auto ix = 0u; ix < params.size(); ++ix) {
-        auto const& arg = arguments[ix];
-        auto const& param = params[ix];
-        if (auto err = function_ctx.declare(param->name(), arg); err.is_error())
-            return Value(ErrorCode::InternalError); // FIXME
-    }
+    // The resolver gave the parameters the first slots of the frame:
+    auto function_ctx = ctx.make_frame();
+    for (auto ix = 0u; ix < params.size(); ++ix)
+        function_ctx.declare_local(ix, arguments[ix]);
     ProcessResult result;
     auto ret_maybe = try_and_cast<ExpressionResult>(m_function->statement(), function_ctx, result);
     if (ret_maybe.is_error())
@@ -42,7 +42,7 @@ public:
     BuiltIn(std::string, BuiltInImpl const&);
     [[nodiscard]] Value execute(std::vector<Value> const&, InterpreterContext&) const override;
 private:
-    BuiltInImpl const& m_impl;
+    BuiltInImpl m_impl;
 };
 
 }
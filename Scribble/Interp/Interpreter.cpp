@@ -8,7 +8,10 @@
 #include <Scribble/Interp/CommandAdapter.h>
 #include <Scribble/Interp/Interpreter.h>
 #include <Scribble/Interp/Value.h>
+#include <Scribble/Interp/Folder.h>
 #include <Scribble/Interp/Function.h>
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Interp/VirtualMachine.h>
 #include <Scribble/Scribble.h>
 
 namespace Scratch::Interp {
@@ -16,35 +19,236 @@ namespace Scratch::Interp {
 using namespace Obelix;
 using namespace Scratch::Scribble;
 
-ErrorOr<void, SyntaxError> register_builtin(InterpreterContext& ctx, std::string const& name, BuiltInImpl const& impl)
+// -- Globals ---------------------------------------------------------------
+
+uint32_t Globals::index(std::string const& name)
+{
+    if (auto it = m_indexes.find(name); it != m_indexes.end())
+        return it->second;
+    auto ix = static_cast<uint32_t>(m_globals.size());
+    m_globals.push_back({ name });
+    m_indexes[name] = ix;
+    return ix;
+}
+
+std::optional<uint32_t> Globals::find(std::string const& name) const
 {
-    TRY_RETURN(ctx.declare(name, Value { std::make_shared<BuiltIn>(name, impl) } ));
+    if (auto it = m_indexes.find(name); it != m_indexes.end())
+        return it->second;
     return {};
 }
 
-ProcessResult interpret(std::shared_ptr<Project> const& project)
+// Assigning to a variable that isn't defined does nothing.
+bool Globals::set(uint32_t ix, Value value)
 {
-    InterpreterContext ctx;
-    return interpret(project, ctx);
+    auto& g = m_globals[ix];
+    if (!g.defined)
+        return false;
+    g.value = std::move(value);
+    return true;
 }
 
-ProcessResult interpret(std::shared_ptr<Project> const& project, InterpreterContext& ctx)
+ErrorOr<void, SyntaxError> Globals::define(uint32_t ix, Value value)
 {
-    ProcessResult result;
+    auto& g = m_globals[ix];
+    if (g.defined)
+        return SyntaxError { {}, ErrorCode::VariableAlreadyDeclared, g.name };
+    g.value = std::move(value);
+    g.defined = true;
+    return {};
+}
+
+ErrorOr<void, SyntaxError> Globals::define(std::string const& name, Value value)
+{
+    return define(index(name), std::move(value));
+}
+
+// -- CallSite --------------------------------------------------------------
+
+// A name declared in a nested scope hides the one declared before it, so
+// the search starts at the back.
+std::optional<uint32_t> CallSite::slot(uint32_t name) const
+{
+    for (auto it = m_locals.rbegin(); it != m_locals.rend(); ++it) {
+        if (it->first == name)
+            return it->second;
+    }
+    return {};
+}
+
+// -- InterpreterContext ----------------------------------------------------
+
+InterpreterContext::InterpreterContext()
+    : m_globals(std::make_shared<Globals>())
+    , m_budget(std::make_shared<ExecutionBudget>())
+{
+}
+
+InterpreterContext::InterpreterContext(std::shared_ptr<Globals> globals, std::shared_ptr<ExecutionBudget> budget, InterpreterContext* caller)
+    : m_globals(std::move(globals))
+    , m_budget(std::move(budget))
+    , m_caller(caller)
+{
+}
+
+InterpreterContext InterpreterContext::make_frame()
+{
+    return InterpreterContext(m_globals, m_budget, this);
+}
+
+Value* InterpreterContext::find_caller_local(uint32_t name)
+{
+    for (auto* frame = m_caller; frame != nullptr; frame = frame->m_caller) {
+        if (frame->m_call_site == nullptr)
+            continue;
+        if (auto slot = frame->m_call_site->slot(name); slot.has_value())
+            return &frame->local(*slot);
+    }
+    return nullptr;
+}
+
+// -- Engines ---------------------------------------------------------------
+
+static ScribbleEngine s_engine { ScribbleEngine::Tree };
+
+std::optional<ScribbleEngine> ScribbleEngine_by_name(std::string const& name)
+{
+#undef ENUM_SCRIBBLE_ENGINE
+#define ENUM_SCRIBBLE_ENGINE(engine)                  \
+    if (stricmp(name.c_str(), #engine) == 0)          \
+        return ScribbleEngine::engine;
+    ENUMERATE_SCRIBBLE_ENGINES(ENUM_SCRIBBLE_ENGINE)
+#undef ENUM_SCRIBBLE_ENGINE
+    return {};
+}
+
+ScribbleEngine scribble_engine()
+{
+    return s_engine;
+}
+
+void set_scribble_engine(ScribbleEngine engine)
+{
+    s_engine = engine;
+}
+
+// The names of the builtins running an editor command of the same name.
+static std::vector<std::string> const s_command_builtins {
+    "set-fixed-width-font",
+};
 
-    TRY_RETURN(ctx.declare("set-fixed-width-font", Value { std::make_shared<CommandAdapter>("set-fixed-width-font", *Scratch::scratch().command("set-fixed-width-font")) } ));
-    TRY_RETURN(register_builtin(ctx, "string-length", [](Values const& args, InterpreterContext&) -> Value {
-        if (args.empty() && args.size() > 1)
+static Builtins make_builtins(bool stub_commands)
+{
+    Builtins ret;
+    for (auto const& name : s_command_builtins) {
+        if (stub_commands) {
+            ret.emplace_back(name, Value { std::make_shared<BuiltIn>(name, [](Values const&, InterpreterContext&) -> Value {
+                return Value {};
+            }) });
+        } else {
+            ret.emplace_back(name, Value { std::make_shared<CommandAdapter>(name, *Scratch::scratch().command(name)) });
+        }
+    }
+    ret.emplace_back("string-length", Value { std::make_shared<BuiltIn>("string-length", [](Values const& args, InterpreterContext&) -> Value {
+        if (args.empty() || args.size() > 1)
             return Value { ErrorCode::ArgumentCountMismatch };
         if (args[0].type() != ValueType::Text)
             return Value { ErrorCode::ArgumentTypeMismatch };
         return Value { args[0].to_string().length() };
-    }));
+    }) });
+    return ret;
+}
+
+Builtins builtins()
+{
+    return make_builtins(false);
+}
+
+Builtins stub_builtins()
+{
+    return make_builtins(true);
+}
+
+bool same_result(ProcessResult const& r1, ProcessResult const& r2)
+{
+    if (r1.is_error() || r2.is_error())
+        return r1.is_error() && r2.is_error() && r1.error().to_string() == r2.error().to_string();
+    auto v1 = std::dynamic_pointer_cast<ExpressionResult>(r1.value());
+    auto v2 = std::dynamic_pointer_cast<ExpressionResult>(r2.value());
+    if (v1 == nullptr || v2 == nullptr)
+        return v1 == v2;
+    return v1->value().type() == v2->value().type() && v1->value().to_string() == v2->value().to_string();
+}
+
+std::string result_to_string(ProcessResult const& result)
+{
+    if (result.is_error())
+        return result.error().to_string();
+    if (auto r = std::dynamic_pointer_cast<ExpressionResult>(result.value()); r != nullptr)
+        return r->value().to_string();
+    return "(no result)";
+}
+
+// Defines the builtins that aren't defined yet, and runs the project with
+// the tree interpreter.
+static ProcessResult run_tree(std::shared_ptr<Project> const& project, InterpreterContext& ctx, Builtins const& builtins)
+{
+    ProcessResult result;
 
-    process(project, ctx, result);
+    auto& globals = ctx.globals();
+    for (auto const& [name, value] : builtins) {
+        if (auto ix = globals.find(name); ix.has_value() && globals.is_defined(*ix))
+            continue;
+        TRY_RETURN(globals.define(name, value));
+    }
+    auto folded = fold(project);
+    if (folded.is_error())
+        return folded;
+    auto resolved = resolve(folded.value(), globals);
+    if (resolved.is_error())
+        return resolved;
+    ctx.budget().start();
+    process(resolved.value(), ctx, result);
+    if (ctx.budget().exhausted())
+        return ctx.budget().error(project->location());
     return result;
 }
 
+ProcessResult interpret(std::shared_ptr<Project> const& project)
+{
+    return interpret(project, s_engine, builtins());
+}
+
+ProcessResult interpret(std::shared_ptr<Project> const& project, ScribbleEngine engine, Builtins const& builtins)
+{
+    switch (engine) {
+    case ScribbleEngine::Tree: {
+        InterpreterContext ctx;
+        return run_tree(project, ctx, builtins);
+    }
+    case ScribbleEngine::Bytecode: {
+        VirtualMachine vm(builtins);
+        return vm.execute(project);
+    }
+    case ScribbleEngine::Validate: {
+        VirtualMachine vm(builtins);
+        auto result = vm.execute(project);
+        InterpreterContext ctx;
+        auto tree_result = run_tree(project, ctx, stub_builtins());
+        if (!same_result(result, tree_result))
+            log_error("Scribble engines disagree: bytecode returned '{}', tree returned '{}'", result_to_string(result), result_to_string(tree_result));
+        return result;
+    }
+    default:
+        fatal("Unreachable");
+    }
+}
+
+ProcessResult interpret(std::shared_ptr<Project> const& project, InterpreterContext& ctx, Builtins const& builtins)
+{
+    return run_tree(project, ctx, builtins);
+}
+
 }
 
 namespace Scratch::Scribble {
@@ -74,12 +278,11 @@ NODE_PROCESSOR(Block)
     std::shared_ptr<Block> block = std::dynamic_pointer_cast<Block>(tree);
 
     std::shared_ptr<ExpressionResult> res;
-    InterpreterContext block_ctx(ctx);
     for (auto const& statement : block->statements()) {
-        res = TRY_AND_CAST(ExpressionResult, statement, block_ctx);
-        switch ((*block_ctx).type) {
+        res = TRY_AND_CAST(ExpressionResult, statement, ctx);
+        switch ((*ctx).type) {
         case StatementResult::StatementResultType::Return:
-            return std::make_shared<ExpressionResult>(block->location(), (*block_ctx).payload);
+            return std::make_shared<ExpressionResult>(block->location(), (*ctx).payload);
         case StatementResult::StatementResultType::Break:
         case StatementResult::StatementResultType::Continue:
             return res;
@@ -95,150 +298,75 @@ ALIAS_NODE_PROCESSOR(Module, Block);
 NODE_PROCESSOR(FunctionDef)
 {
     auto func_def = std::dynamic_pointer_cast<FunctionDef>(tree);
-    if (auto decl_maybe = ctx.declare(func_def->name(), Value { std::make_shared<ScribbleFunction>(func_def->name(), func_def) } ); decl_maybe.is_error())
-        return decl_maybe.error();
+    auto const& address = std::dynamic_pointer_cast<ResolvedVariable>(func_def->identifier())->address();
+    Value function { std::make_shared<ScribbleFunction>(func_def->name(), func_def) };
+    if (address.is_local()) {
+        ctx.declare_local(address.index, std::move(function));
+    } else if (auto decl_maybe = ctx.globals().define(address.index, std::move(function)); decl_maybe.is_error()) {
+        return SyntaxError { func_def->location(), ErrorCode::VariableAlreadyDeclared, func_def->name() };
+    }
     return std::make_shared<ExpressionResult>(func_def->location(), Value { });
 }
 
 NODE_PROCESSOR(ExpressionStatement)
 {
     auto stmt = std::dynamic_pointer_cast<ExpressionStatement>(tree);
-    auto expr = TRY_AND_CAST(ExpressionResult, stmt->expression(), ctx);
-    return std::make_shared<ExpressionResult>(stmt->location(), expr->value());
+    auto value = TRY(evaluate(*stmt->expression(), ctx));
+    return std::make_shared<ExpressionResult>(stmt->location(), std::move(value));
 }
 
 NODE_PROCESSOR(VariableDeclaration)
 {
     auto decl = std::dynamic_pointer_cast<VariableDeclaration>(tree);
-    if (ctx.contains(decl->identifier()->name()))
+    auto const& address = std::dynamic_pointer_cast<ResolvedVariable>(decl->identifier())->address();
+    if (!address.is_local() && ctx.globals().is_defined(address.index))
         return SyntaxError { tree->location(), ErrorCode::VariableAlreadyDeclared };
 
-    std::shared_ptr<ExpressionResult> expr;
     Value v;
-    if (decl->expression() != nullptr) {
-        expr = TRY_AND_CAST(ExpressionResult, decl->expression(), ctx);
-        v = expr->value();
-    } else {
-        expr = std::make_shared<ExpressionResult>(decl->location(), v);
-    }
-    TRY_RETURN(ctx.declare(decl->identifier()->name(), v));
+    if (decl->expression() != nullptr)
+        v = TRY(evaluate(*decl->expression(), ctx));
+    auto expr = std::make_shared<ExpressionResult>(decl->location(), v);
+    if (address.is_local())
+        ctx.declare_local(address.index, std::move(v));
+    else
+        TRY_RETURN(ctx.globals().define(address.index, std::move(v)));
     return expr;
 }
 
+// A range only has a meaning as the range of a for loop. It's the only
+// binary expression that doesn't evaluate to a single value.
 NODE_PROCESSOR(BinaryExpression)
 {
     auto expr = std::dynamic_pointer_cast<BinaryExpression>(tree);
-    auto lhs = TRY_AND_TRY_CAST(ExpressionResult, expr->lhs(), ctx);
-    auto rhs_node = TRY_AND_CAST(SyntaxNode, expr->rhs(), ctx);
-    auto rhs = std::dynamic_pointer_cast<ExpressionResult>(rhs_node);
-
-    switch (expr->op().code()) {
-    case TokenCode::Equals: {
-        if (expr->lhs()->node_type() != SyntaxNodeType::Identifier)
-            return SyntaxError { expr->location(), ErrorCode::CannotAssignToRValue, expr->lhs() };
-        auto ident = std::dynamic_pointer_cast<Identifier>(expr->lhs());
-        ctx.set(ident->name(), rhs->value());
-        return rhs;
-    }
-
-    case TokenCode::OpenParen: {
-        if (lhs->value().is_error())
-            return SyntaxError { expr->location(), *lhs->value().to_error(), expr->lhs() };
-        if (!lhs->value().is_function())
-            return SyntaxError { expr->location(), ErrorCode::FunctionUndefined, expr->lhs() };
-        Values args;
-        if (rhs_node->node_type() == SyntaxNodeType::ExpressionResultList) {
-            args = std::dynamic_pointer_cast<ExpressionResultList>(rhs_node)->values();
-        } else {
-            args = { rhs->value() };
-        }
-        auto f = *(lhs->value().to_function());
-        return std::make_shared<ExpressionResult>(expr->location(), f->execute(args, ctx));
-    }
-
-    case TokenCode::Plus: {
-        auto res = lhs->value().add(rhs->value());
-        if (res.is_error())
-            return SyntaxError { expr->location(), *res.to_error() };
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::Minus: {
-        auto res = lhs->value().subtract(rhs->value());
-        if (res.is_error())
-            return SyntaxError { expr->location(), *res.to_error() };
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::Asterisk: {
-        auto res = lhs->value().multiply(rhs->value());
-        if (res.is_error())
-            return SyntaxError { expr->location(), *res.to_error() };
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::Slash: {
-        auto res = lhs->value().divide(rhs->value());
-        if (res.is_error())
-            return SyntaxError { expr->location(), *res.to_error() };
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::Percent: {
-        auto res = lhs->value().modulo(rhs->value());
-        if (res.is_error())
-            return SyntaxError { expr->location(), *res.to_error() };
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::EqualsTo: {
-        auto res = Value(lhs->value() == rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::NotEqualTo: {
-        auto res = Value(lhs->value() != rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
+    if (expr->op().code() == Scribble::KeywordRange) {
+        auto lhs = TRY(evaluate(*expr->lhs(), ctx));
+        auto rhs = TRY(evaluate(*expr->rhs(), ctx));
+        if (lhs.type() != ValueType::Integer || rhs.type() != ValueType::Integer)
+            return SyntaxError { expr->location(), ErrorCode::TypeMismatch };
+        return std::make_shared<ExpressionResultList>(expr->location(), Values { lhs, rhs });
     }
+    return std::make_shared<ExpressionResult>(expr->location(), TRY(evaluate(*expr, ctx)));
+}
 
-    case TokenCode::GreaterThan: {
-        auto res = Value(lhs->value() > rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::GreaterEqualThan: {
-        auto res = Value(lhs->value() >= rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::LessThan: {
-        auto res = Value(lhs->value() < rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
-
-    case TokenCode::LessEqualThan: {
-        auto res = Value(lhs->value() <= rhs->value());
-        return std::make_shared<ExpressionResult>(expr->location(), res);
-    };
+NODE_PROCESSOR(Variable)
+{
+    return SyntaxError { tree->location(), ErrorCode::InternalError, format("Unresolved variable '{}'", tree->to_string()) };
+}
 
-    case Scribble::KeywordRange: {
-        if (lhs->value().type() != ValueType::Integer || rhs->value().type() != ValueType::Integer)
-            return SyntaxError { expr->location(), ErrorCode::TypeMismatch };
-        return std::make_shared<ExpressionResultList>(expr->location(), Values { lhs->value(), rhs->value() });
-    }
+NODE_PROCESSOR(ResolvedVariable)
+{
+    return std::make_shared<ExpressionResult>(tree->location(), TRY(evaluate(*std::dynamic_pointer_cast<Expression>(tree), ctx)));
+}
 
-    default:
-        return SyntaxError { expr->location(), ErrorCode::InternalError, format("Unimplemented operator {}", expr->op().value()) };
-    }
+NODE_PROCESSOR(ResolvedCall)
+{
+    return std::make_shared<ExpressionResult>(tree->location(), TRY(evaluate(*std::dynamic_pointer_cast<Expression>(tree), ctx)));
 }
 
-NODE_PROCESSOR(Variable)
+NODE_PROCESSOR(Constant)
 {
-    auto ident = std::dynamic_pointer_cast<Identifier>(tree);
-    auto value_maybe = ctx.get(ident->name());
-    if (!value_maybe.has_value())
-        value_maybe = ErrorCode::UndeclaredVariable;
-    return std::make_shared<ExpressionResult>(ident->location(), value_maybe.value());
+    auto constant = std::dynamic_pointer_cast<Constant>(tree);
+    return std::make_shared<ExpressionResult>(constant->location(), constant->value());
 }
 
 NODE_PROCESSOR(IntLiteral)
@@ -258,10 +386,10 @@ NODE_PROCESSOR(ExpressionList)
     auto list = std::dynamic_pointer_cast<ExpressionList>(tree);
     Values values;
     for (auto const& expr : list->expressions()) {
-        auto value = TRY_AND_CAST(ExpressionResult, expr, ctx);
-        if (value->value().is_error())
-            return SyntaxError { expr->location(), *value->value().to_error() };
-        values.push_back(value->value());
+        auto value = TRY(evaluate(*expr, ctx));
+        if (value.is_error())
+            return SyntaxError { expr->location(), *value.to_error() };
+        values.push_back(std::move(value));
     }
     return std::make_shared<ExpressionResultList>(list->location(), values);
 }
@@ -270,9 +398,9 @@ NODE_PROCESSOR(IfStatement)
 {
     auto if_stmt = std::dynamic_pointer_cast<IfStatement>(tree);
     for (auto const& branch : if_stmt->branches()) {
-        auto cond = TRY_AND_CAST(ExpressionResult, branch->condition(), ctx);
+        auto cond = TRY(evaluate(*branch->condition(), ctx));
 
-        if (auto match_maybe = cond->value().to_bool(); match_maybe) {
+        if (auto match_maybe = cond.to_bool(); match_maybe) {
             if (*match_maybe)
                 return TRY_AND_CAST(ExpressionResult, branch->statement(), ctx);
         } else {
@@ -284,24 +412,32 @@ NODE_PROCESSOR(IfStatement)
     return std::make_shared<ExpressionResult>(if_stmt->location(), Value {});
 }
 
+// The switch expression is evaluated once, like the bytecode does.
 NODE_PROCESSOR(SwitchStatement)
 {
     auto switch_stmt = std::dynamic_pointer_cast<SwitchStatement>(tree);
+    auto subject = TRY(evaluate(*switch_stmt->expression(), ctx));
     for (auto const& case_stmt : switch_stmt->cases()) {
-        auto match_expr = std::make_shared<BinaryExpression>(switch_stmt->expression(), Token { {}, TokenCode::EqualsTo, "==" }, case_stmt->condition());
-        auto match_value = TRY_AND_CAST(ExpressionResult, match_expr, ctx);
-        if (auto match_maybe = match_value->value().to_bool(); match_maybe) {
-            if (*match_maybe)
-                return TRY_AND_CAST(ExpressionResult, case_stmt->statement(), ctx);
-        } else {
-            return SyntaxError { case_stmt->location(), ErrorCode::TypeMismatch };
-        }
+        auto case_value = TRY(evaluate(*case_stmt->condition(), ctx));
+        if (subject == case_value)
+            return TRY_AND_CAST(ExpressionResult, case_stmt->statement(), ctx);
     }
     if (switch_stmt->default_case() != nullptr)
         return TRY_AND_CAST(ExpressionResult, switch_stmt->default_case()->statement(), ctx);
     return std::make_shared<ExpressionResult>(switch_stmt->location(), Value {});
 }
 
+NODE_PROCESSOR(TableSwitch)
+{
+    auto switch_stmt = std::dynamic_pointer_cast<TableSwitch>(tree);
+    auto subject = TRY(evaluate(*switch_stmt->expression(), ctx));
+    if (auto ix = switch_stmt->table().find(subject); ix.has_value())
+        return TRY_AND_CAST(ExpressionResult, switch_stmt->cases()[*ix]->statement(), ctx);
+    if (switch_stmt->default_case() != nullptr)
+        return TRY_AND_CAST(ExpressionResult, switch_stmt->default_case()->statement(), ctx);
+    return std::make_shared<ExpressionResult>(switch_stmt->location(), Value {});
+}
+
 NODE_PROCESSOR(ExpressionResult)
 {
     return tree;
@@ -313,18 +449,26 @@ NODE_PROCESSOR(WhileStatement)
 
     Value res;
     do {
-        auto cond = TRY_AND_CAST(ExpressionResult, while_stmt->condition(), ctx);
-        auto cond_maybe = cond->value().to_bool();
+        if (!ctx.budget().tick())
+            return ctx.budget().error(while_stmt->location());
+        auto cond = TRY(evaluate(*while_stmt->condition(), ctx));
+        auto cond_maybe = cond.to_bool();
         if (!cond_maybe)
             return SyntaxError { while_stmt->location(), ErrorCode::TypeMismatch };
         if (!cond_maybe.value())
             return std::make_shared<ExpressionResult>(while_stmt->location(), res);
         auto stmt_result = TRY_AND_CAST(ExpressionResult, while_stmt->statement(), ctx);
-        if ((*ctx).type == StatementResult::StatementResultType::Break)
+        if ((*ctx).type == StatementResult::StatementResultType::Break) {
+            *ctx = {};
             return std::make_shared<ExpressionResult>(while_stmt->location(), res);
+        }
         if ((*ctx).type == StatementResult::StatementResultType::Return) {
             return std::make_shared<ExpressionResult>(while_stmt->location(), (*ctx).payload);
         }
+        if ((*ctx).type == StatementResult::StatementResultType::Continue) {
+            *ctx = {};
+            continue;
+        }
         res = stmt_result->value();
     } while (true);
 }
@@ -337,18 +481,23 @@ NODE_PROCESSOR(ForStatement)
     auto range_expr = TRY_AND_CAST(ExpressionResultList, for_stmt->range(), ctx);
     auto current = *(range_expr->values()[0].to_int<long>());
     auto upper_bound = *(range_expr->values()[1].to_int<long>());
-    InterpreterContext for_ctx(ctx);
-    TRY_RETURN(for_ctx.declare(for_stmt->variable()->name(), Value(current)));
+    auto slot = std::dynamic_pointer_cast<ResolvedVariable>(for_stmt->variable())->address().index;
     while (current < upper_bound) {
-        for_ctx.set(for_stmt->variable()->name(), Value(current));
-        auto stmt_result = TRY_AND_CAST(ExpressionResult, for_stmt->statement(), for_ctx);
-        if ((*for_ctx).type == StatementResult::StatementResultType::Break)
+        if (!ctx.budget().tick())
+            return ctx.budget().error(for_stmt->location());
+        ctx.declare_local(slot, Value(current));
+        auto stmt_result = TRY_AND_CAST(ExpressionResult, for_stmt->statement(), ctx);
+        if ((*ctx).type == StatementResult::StatementResultType::Break) {
+            *ctx = {};
             break;
-        if ((*for_ctx).type == StatementResult::StatementResultType::Return) {
-            ctx = *for_ctx;
+        }
+        if ((*ctx).type == StatementResult::StatementResultType::Return)
             return std::make_shared<ExpressionResult>(for_stmt->location(), (*ctx).payload);
+        if ((*ctx).type == StatementResult::StatementResultType::Continue) {
+            *ctx = {};
+        } else {
+            res = stmt_result->value();
         }
-        res = stmt_result->value();
         ++current;
     }
     return std::make_shared<ExpressionResult>(for_stmt->location(), res);
@@ -358,14 +507,34 @@ NODE_PROCESSOR(Return)
 {
     auto ret_stmt = std::dynamic_pointer_cast<Return>(tree);
     if (ret_stmt->expression()) {
-        auto ret_val = TRY_AND_CAST(ExpressionResult, ret_stmt->expression(), ctx);
-        *ctx = { StatementResult::StatementResultType::Return, ret_val->value() };
+        auto ret_val = TRY(evaluate(*ret_stmt->expression(), ctx));
+        *ctx = { StatementResult::StatementResultType::Return, std::move(ret_val) };
     } else {
         *ctx = { StatementResult::StatementResultType::Return, Value {} };
     }
     return std::make_shared<ExpressionResult>(ret_stmt->location(), (*ctx).payload);
 }
 
+// The tree interpreter can't put a script aside and continue it later, so
+// yield only checks its delay and carries on.
+NODE_PROCESSOR(Yield)
+{
+    auto yield_stmt = std::dynamic_pointer_cast<Yield>(tree);
+    if (yield_stmt->expression()) {
+        auto delay = TRY(evaluate(*yield_stmt->expression(), ctx));
+        if (!delay.is_null() && delay.type() != ValueType::Integer)
+            return SyntaxError { yield_stmt->location(), ErrorCode::TypeMismatch };
+        if (auto millis = delay.is_null() ? 0 : *delay.to_int<int64_t>(); millis > 0 && !ctx.budget().sleep(std::chrono::milliseconds { millis }))
+            return ctx.budget().error(yield_stmt->location());
+    }
+    return std::make_shared<ExpressionResult>(yield_stmt->location(), Value {});
+}
+
+NODE_PROCESSOR(Pass)
+{
+    return std::make_shared<ExpressionResult>(tree->location(), Value {});
+}
+
 NODE_PROCESSOR(Break)
 {
     *ctx = { StatementResult::StatementResultType::Break, Value {} };
@@ -379,3 +548,164 @@ NODE_PROCESSOR(Continue)
 }
 
 }
+
+namespace Scratch::Interp {
+
+// Counted per thread, so counting doesn't cost more than an increment on
+// the thread running the script. Only the benchmark looks at it.
+static thread_local size_t s_evaluated_nodes { 0 };
+
+size_t evaluated_nodes()
+{
+    return s_evaluated_nodes;
+}
+
+#define BINARY_OPERATION(method)                                    \
+    {                                                               \
+        auto res = lhs.method(rhs);                                 \
+        if (res.is_error())                                         \
+            return SyntaxError { expr.location(), *res.to_error() }; \
+        return res;                                                 \
+    }
+
+// The tree is shared and immutable, so unlike the virtual machine the tree
+// interpreter can't remember the operand types seen at a site. It tries
+// the fast path every time instead, which only costs a tag compare when it
+// doesn't apply.
+#define QUICK_OPERATION(fast_method, method) \
+    {                                        \
+        if (lhs.fast_method(rhs))            \
+            return lhs;                      \
+        BINARY_OPERATION(method)             \
+    }
+
+#define COMPARISON(op)                                     \
+    {                                                      \
+        if (lhs.is_signed_int() && rhs.is_signed_int())    \
+            return Value(lhs.int64() op rhs.int64());      \
+        return Value(lhs op rhs);                          \
+    }
+
+// Evaluates an expression straight to a Value, without going through
+// process() and without building an ExpressionResult node for every
+// operand. The nodes are only looked at through references, so no
+// reference counts are touched either. Evaluating an expression with
+// numeric operands doesn't allocate; strings and the argument lists of
+// calls still do.
+ErrorOr<Value, SyntaxError> evaluate(Expression const& expr, InterpreterContext& ctx)
+{
+    ++s_evaluated_nodes;
+    switch (expr.node_type()) {
+    case SyntaxNodeType::Constant:
+        return static_cast<Constant const&>(expr).value();
+
+    case SyntaxNodeType::ResolvedVariable: {
+        auto const& address = static_cast<ResolvedVariable const&>(expr).address();
+        if (address.is_local())
+            return ctx.local(address.index);
+        if (auto* local = ctx.caller_local(address.index); local != nullptr)
+            return *local;
+        if (!ctx.globals().is_defined(address.index))
+            return Value { ErrorCode::UndeclaredVariable };
+        return ctx.globals().get(address.index);
+    }
+
+    case SyntaxNodeType::BinaryExpression:
+        break;
+
+    // Checked in the same order, and failing with the same errors, as the
+    // Call instruction of the virtual machine: the callee and all arguments
+    // are evaluated first, and an argument that is an error fails the call
+    // instead of being passed on.
+    case SyntaxNodeType::ResolvedCall: {
+        auto const& call = static_cast<ResolvedCall const&>(expr);
+        auto callee = TRY(evaluate(*call.lhs(), ctx));
+        Values args;
+        if (call.rhs()->node_type() == SyntaxNodeType::ExpressionList) {
+            auto const& expressions = static_cast<ExpressionList const&>(*call.rhs()).expressions();
+            args.reserve(expressions.size());
+            for (auto const& arg_expr : expressions)
+                args.push_back(TRY(evaluate(*arg_expr, ctx)));
+        } else {
+            args.push_back(TRY(evaluate(*call.rhs(), ctx)));
+        }
+        if (!ctx.budget().tick())
+            return ctx.budget().error(expr.location());
+        for (auto const& arg : args) {
+            if (arg.is_error())
+                return SyntaxError { expr.location(), *arg.to_error() };
+        }
+        if (callee.is_error())
+            return SyntaxError { expr.location(), *callee.to_error(), call.lhs()->to_string() };
+        if (!callee.is_function())
+            return SyntaxError { expr.location(), ErrorCode::FunctionUndefined, call.lhs()->to_string() };
+        ctx.call(call.call_site());
+        return (*callee.to_function())->execute(args, ctx);
+    }
+
+    default: {
+        // Anything else goes the long way:
+        ProcessResult result;
+        auto res = TRY(try_and_cast<ExpressionResult>(std::const_pointer_cast<SyntaxNode>(expr.shared_from_this()), ctx, result));
+        if (res == nullptr)
+            return SyntaxError { expr.location(), ErrorCode::InternalError, format("Expression '{}' has no value", expr.to_string()) };
+        return res->value();
+    }
+    }
+
+    auto const& binary = static_cast<BinaryExpression const&>(expr);
+    switch (binary.op().code()) {
+    case TokenCode::Equals: {
+        if (binary.lhs()->node_type() != SyntaxNodeType::ResolvedVariable)
+            return SyntaxError { expr.location(), ErrorCode::CannotAssignToRValue, binary.lhs() };
+        auto value = TRY(evaluate(*binary.rhs(), ctx));
+        auto const& address = static_cast<ResolvedVariable const&>(*binary.lhs()).address();
+        if (address.is_local())
+            ctx.local(address.index) = value;
+        else if (auto* local = ctx.caller_local(address.index); local != nullptr)
+            *local = value;
+        else
+            ctx.globals().set(address.index, value);
+        return value;
+    }
+
+    case ::Scratch::Scribble::Scribble::KeywordRange:
+        return SyntaxError { expr.location(), ErrorCode::TypeMismatch };
+
+    default:
+        break;
+    }
+
+    auto lhs = TRY(evaluate(*binary.lhs(), ctx));
+    auto rhs = TRY(evaluate(*binary.rhs(), ctx));
+    switch (binary.op().code()) {
+    case TokenCode::Plus:
+        if (lhs.append(rhs))
+            return lhs;
+        QUICK_OPERATION(add_int, add)
+    case TokenCode::Minus:
+        QUICK_OPERATION(subtract_int, subtract)
+    case TokenCode::Asterisk:
+        QUICK_OPERATION(multiply_int, multiply)
+    case TokenCode::Slash:
+        BINARY_OPERATION(divide)
+    case TokenCode::Percent:
+        QUICK_OPERATION(modulo_int, modulo)
+    case TokenCode::EqualsTo:
+        COMPARISON(==)
+    case TokenCode::NotEqualTo:
+        COMPARISON(!=)
+    case TokenCode::GreaterThan:
+        COMPARISON(>)
+    case TokenCode::GreaterEqualThan:
+        COMPARISON(>=)
+    case TokenCode::LessThan:
+        COMPARISON(<)
+    case TokenCode::LessEqualThan:
+        COMPARISON(<=)
+    default:
+        return SyntaxError { expr.location(), ErrorCode::InternalError, format("Unimplemented operator {}", binary.op().value()) };
+    }
+}
+
+}
@@ -6,9 +6,16 @@
 
 #pragma once
 
-#include <Scribble/Context.h>
+#include <cassert>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Scribble/Interp/ExecutionBudget.h>
 #include <Scribble/Interp/ExpressionResult.h>
 #include <Scribble/Processor.h>
+#include <Scribble/Syntax/Expression.h>
 #include <Scribble/Syntax/Statement.h>
 
 namespace Scratch::Interp {
@@ -29,8 +36,172 @@ struct StatementResult {
     StatementResult& operator=(StatementResult const&) = default;
 };
 
-using InterpreterContext = Context<Value,StatementResult>;
+// Variables declared at the top level of a module, and the builtins. The
+// resolver turns a name into an index once, when the script is compiled,
+// and after that the value is found by indexing. Names are never removed,
+// so indexes remain valid for as long as the table lives. That allows the
+// Console to keep the globals from one statement to the next.
+//
+// A name that is also declared as a local somewhere is marked as shadowed.
+// Only for those names the locals of the calling functions have to be
+// looked at before the global, see CallSite.
+class Globals {
+public:
+    [[nodiscard]] uint32_t index(std::string const&);
+    [[nodiscard]] std::optional<uint32_t> find(std::string const&) const;
+    [[nodiscard]] std::string const& name(uint32_t ix) const { return m_globals[ix].name; }
+    [[nodiscard]] bool is_defined(uint32_t ix) const { return m_globals[ix].defined; }
+    [[nodiscard]] bool is_shadowed(uint32_t ix) const { return m_globals[ix].shadowed; }
+    [[nodiscard]] Value const& get(uint32_t ix) const { return m_globals[ix].value; }
+    bool set(uint32_t, Value);
+    void shadow(uint32_t ix) { m_globals[ix].shadowed = true; }
+    ErrorOr<void, SyntaxError> define(uint32_t, Value);
+    ErrorOr<void, SyntaxError> define(std::string const&, Value);
+
+private:
+    struct Global {
+        std::string name;
+        Value value {};
+        bool defined { false };
+        bool shadowed { false };
+    };
+
+    std::vector<Global> m_globals {};
+    std::unordered_map<std::string, uint32_t> m_indexes {};
+};
+
+using Builtins = std::vector<std::pair<std::string, Value>>;
+
+// The locals in scope at a call: the index of their name in the globals,
+// and their slot in the frame making the call. Like it always has, a
+// function sees the variables of the code calling it. A name a function
+// doesn't declare itself is looked up in the locals in scope at the calls
+// leading to it, innermost call first, and only then in the globals.
+class CallSite {
+public:
+    void add(uint32_t name, uint32_t slot) { m_locals.emplace_back(name, slot); }
+    [[nodiscard]] std::optional<uint32_t> slot(uint32_t name) const;
+    [[nodiscard]] std::vector<std::pair<uint32_t, uint32_t>> const& locals() const { return m_locals; }
+    bool operator==(CallSite const&) const = default;
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> m_locals {};
+};
+
+// The state of one invocation of a script or function: its local variables,
+// stored in the slots assigned by the resolver, and the pending return,
+// break or continue. All frames made from the same root share the globals
+// and the execution budget.
+class InterpreterContext {
+public:
+    InterpreterContext();
+    InterpreterContext(InterpreterContext const&) = delete;
+    InterpreterContext(InterpreterContext&&) = default;
+
+    // Makes the frame for a function called from this one. call() must be
+    // called first, with the site of the call.
+    [[nodiscard]] InterpreterContext make_frame();
+    void call(CallSite const& site) { m_call_site = &site; }
+
+    // The variables of a block live in slots of the frame of the function
+    // it's in, so a block doesn't get a context of its own.
+    [[nodiscard]] InterpreterContext& make_subcontext() { return *this; }
+
+    [[nodiscard]] Globals& globals() { return *m_globals; }
+    [[nodiscard]] Globals const& globals() const { return *m_globals; }
+    [[nodiscard]] ExecutionBudget& budget() { return *m_budget; }
+
+    [[nodiscard]] Value& local(uint32_t slot)
+    {
+        assert(slot < m_locals.size());
+        return m_locals[slot];
+    }
+
+    void declare_local(uint32_t slot, Value value)
+    {
+        if (slot >= m_locals.size())
+            m_locals.resize(slot + 1);
+        m_locals[slot] = std::move(value);
+    }
+
+    // The local of a calling function a global name refers to, if any.
+    [[nodiscard]] Value* caller_local(uint32_t name)
+    {
+        if (m_caller == nullptr || !m_globals->is_shadowed(name))
+            return nullptr;
+        return find_caller_local(name);
+    }
+
+    [[nodiscard]] StatementResult& operator*() { return m_result; }
+    [[nodiscard]] StatementResult const& operator*() const { return m_result; }
+
+private:
+    InterpreterContext(std::shared_ptr<Globals>, std::shared_ptr<ExecutionBudget>, InterpreterContext*);
+    [[nodiscard]] Value* find_caller_local(uint32_t);
+
+    std::shared_ptr<Globals> m_globals;
+    std::shared_ptr<ExecutionBudget> m_budget;
+    InterpreterContext* m_caller { nullptr };
+    CallSite const* m_call_site { nullptr };
+    Values m_locals {};
+    StatementResult m_result {};
+};
+
+#define ENUMERATE_SCRIBBLE_ENGINES(S) \
+    S(Tree)                           \
+    S(Bytecode)                       \
+    S(Validate)
+
+// Tree walks the syntax tree, Bytecode compiles it and runs it on the
+// VirtualMachine. Validate runs both and logs an error when the results
+// differ. It's meant for checking the engines, not for running scripts:
+// the tree interpreter gets stubs for the builtins running editor
+// commands, so those only take effect once, but any time the script spends
+// waiting, in a yield, is spent twice.
+enum class ScribbleEngine {
+#undef ENUM_SCRIBBLE_ENGINE
+#define ENUM_SCRIBBLE_ENGINE(engine) engine,
+    ENUMERATE_SCRIBBLE_ENGINES(ENUM_SCRIBBLE_ENGINE)
+#undef ENUM_SCRIBBLE_ENGINE
+};
+
+constexpr char const* ScribbleEngine_name(ScribbleEngine engine)
+{
+    switch (engine) {
+#undef ENUM_SCRIBBLE_ENGINE
+#define ENUM_SCRIBBLE_ENGINE(engine) \
+    case ScribbleEngine::engine:     \
+        return #engine;
+        ENUMERATE_SCRIBBLE_ENGINES(ENUM_SCRIBBLE_ENGINE)
+#undef ENUM_SCRIBBLE_ENGINE
+    default:
+        fatal("Unknown ScribbleEngine value '{}'", (int)engine);
+    }
+}
+
+[[nodiscard]] std::optional<ScribbleEngine> ScribbleEngine_by_name(std::string const&);
+[[nodiscard]] ScribbleEngine scribble_engine();
+void set_scribble_engine(ScribbleEngine);
+
+// The builtins, and the same builtins with the ones running editor
+// commands replaced by stubs doing nothing. Those don't need the
+// application to be there. builtins() looks up the editor commands, so it
+// has to be called on the event loop, also for a script that is going to
+// run on the worker.
+[[nodiscard]] Builtins builtins();
+[[nodiscard]] Builtins stub_builtins();
+
+[[nodiscard]] ErrorOr<Value, SyntaxError> evaluate(Expression const&, InterpreterContext&);
+// The number of expressions evaluated by the tree interpreter on the
+// calling thread.
+[[nodiscard]] size_t evaluated_nodes();
 [[nodiscard]] ProcessResult interpret(std::shared_ptr<Project> const&);
-[[nodiscard]] ProcessResult interpret(std::shared_ptr<Project> const&, InterpreterContext&);
+[[nodiscard]] ProcessResult interpret(std::shared_ptr<Project> const&, ScribbleEngine, Builtins const&);
+[[nodiscard]] ProcessResult interpret(std::shared_ptr<Project> const&, InterpreterContext&, Builtins const&);
+
+// Whether two runs of a script returned the same value, or failed with the
+// same error.
+[[nodiscard]] bool same_result(ProcessResult const&, ProcessResult const&);
+[[nodiscard]] std::string result_to_string(ProcessResult const&);
 
 }
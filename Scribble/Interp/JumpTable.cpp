@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+
+#include <Scribble/Interp/JumpTable.h>
+
+namespace Scratch::Interp {
+
+JumpTable::JumpTable(Kind kind, Values labels)
+    : m_kind(kind)
+    , m_labels(std::move(labels))
+{
+}
+
+std::optional<JumpTable> JumpTable::create(Values const& labels)
+{
+    if (labels.empty())
+        return {};
+
+    if (std::all_of(labels.begin(), labels.end(), [](Value const& label) { return label.is_signed_int(); })) {
+        JumpTable ret { Kind::Int, labels };
+        auto [low, high] = std::minmax_element(labels.begin(), labels.end(), [](Value const& a, Value const& b) { return a.int64() < b.int64(); });
+        auto span = static_cast<uint64_t>(high->int64()) - static_cast<uint64_t>(low->int64());
+        if (span < 2 * labels.size()) {
+            ret.m_low = low->int64();
+            ret.m_dense.assign(span + 1, NoCase);
+            for (auto ix = 0u; ix < labels.size(); ++ix) {
+                auto& slot = ret.m_dense[static_cast<uint64_t>(labels[ix].int64()) - static_cast<uint64_t>(ret.m_low)];
+                if (slot == NoCase)
+                    slot = ix;
+            }
+        } else {
+            for (auto ix = 0u; ix < labels.size(); ++ix)
+                ret.m_ints.emplace(labels[ix].int64(), ix);
+        }
+        return ret;
+    }
+
+    if (std::all_of(labels.begin(), labels.end(), [](Value const& label) { return label.is_string(); })) {
+        JumpTable ret { Kind::Text, labels };
+        for (auto ix = 0u; ix < labels.size(); ++ix)
+            ret.m_strings.emplace(labels[ix].string(), ix);
+        return ret;
+    }
+
+    return {};
+}
+
+std::optional<size_t> JumpTable::find(Value const& subject) const
+{
+    switch (m_kind) {
+    case Kind::Int: {
+        if (!subject.is_int())
+            break;
+        // An unsigned subject too large for an int64_t can't be equal to
+        // any of the labels:
+        auto value = subject.to_int<int64_t>();
+        if (!value.has_value())
+            return {};
+        if (!m_dense.empty()) {
+            auto offset = static_cast<uint64_t>(*value) - static_cast<uint64_t>(m_low);
+            if (offset >= m_dense.size() || m_dense[offset] == NoCase)
+                return {};
+            return m_dense[offset];
+        }
+        if (auto it = m_ints.find(*value); it != m_ints.end())
+            return it->second;
+        return {};
+    }
+    case Kind::Text: {
+        if (!subject.is_string())
+            break;
+        if (auto it = m_strings.find(subject.string()); it != m_strings.end())
+            return it->second;
+        return {};
+    }
+    }
+
+    // A subject of another type than the labels can still be equal to one
+    // of them after conversion, for example the string "3" and the integer
+    // 3. Those are compared the slow way:
+    for (auto ix = 0u; ix < m_labels.size(); ++ix) {
+        if (subject == m_labels[ix])
+            return ix;
+    }
+    return {};
+}
+
+}
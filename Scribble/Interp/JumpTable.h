@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Scribble/Interp/Value.h>
+
+namespace Scratch::Interp {
+
+// Maps the labels of a switch statement to the index of the case they
+// belong to, so a switch finds its case without comparing the subject to
+// every label. Only labels that are all integers or all strings can be put
+// in a table. Integers close together are looked up in an array, anything
+// else in a hash table. When several cases have the same label the first
+// one wins, like it does when the labels are compared one by one.
+class JumpTable {
+public:
+    [[nodiscard]] static std::optional<JumpTable> create(Values const&);
+    [[nodiscard]] std::optional<size_t> find(Value const&) const;
+    [[nodiscard]] size_t size() const { return m_labels.size(); }
+
+private:
+    enum class Kind {
+        Int,
+        Text,
+    };
+
+    constexpr static size_t NoCase = std::numeric_limits<size_t>::max();
+
+    JumpTable(Kind, Values);
+
+    Kind m_kind;
+    Values m_labels;
+    int64_t m_low { 0 };
+    std::vector<size_t> m_dense {};
+    std::unordered_map<int64_t, size_t> m_ints {};
+    std::unordered_map<std::string, size_t> m_strings {};
+};
+
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <Scribble/Interp/Resolver.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+// -- ResolvedVariable ------------------------------------------------------
+
+ResolvedVariable::ResolvedVariable(Span location, std::string name, VariableAddress address)
+    : Variable(std::move(location), std::move(name))
+    , m_address(address)
+{
+}
+
+std::string ResolvedVariable::attributes() const
+{
+    return format(R"(name="{}" scope="{}" index="{}")", name(), (m_address.is_local()) ? "local" : "global", m_address.index);
+}
+
+// -- ResolvedCall ----------------------------------------------------------
+
+ResolvedCall::ResolvedCall(std::shared_ptr<BinaryExpression> const& call, std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs, CallSite call_site)
+    : BinaryExpression(std::move(lhs), call->op(), std::move(rhs))
+    , m_call_site(std::move(call_site))
+{
+}
+
+// -- Constant --------------------------------------------------------------
+
+Constant::Constant(Span location, Value value)
+    : Expression(std::move(location))
+    , m_value(std::move(value))
+{
+}
+
+std::string Constant::attributes() const
+{
+    return format(R"(type="{}" value="{}")", ValueType_name(m_value.type()), m_value.to_string());
+}
+
+std::string Constant::to_string() const
+{
+    if (m_value.type() == ValueType::Text)
+        return format("\"{}\"", m_value.to_string());
+    return m_value.to_string();
+}
+
+// -- TableSwitch -----------------------------------------------------------
+
+TableSwitch::TableSwitch(std::shared_ptr<SwitchStatement> const& switch_stmt, CaseStatements cases, std::shared_ptr<DefaultCase> default_case, JumpTable table)
+    : SwitchStatement(switch_stmt->location(), switch_stmt->expression(), std::move(cases), std::move(default_case))
+    , m_table(std::move(table))
+{
+}
+
+// -- ResolverContext -------------------------------------------------------
+
+ResolverContext::ResolverContext(Globals& globals)
+    : m_globals(globals)
+{
+    m_functions.emplace_back();
+}
+
+void ResolverContext::begin_function()
+{
+    m_functions.push_back({ {}, 1 });
+}
+
+void ResolverContext::end_function()
+{
+    m_functions.pop_back();
+}
+
+void ResolverContext::begin_scope()
+{
+    ++m_functions.back().scope_depth;
+}
+
+void ResolverContext::end_scope()
+{
+    auto& function = m_functions.back();
+    while (!function.locals.empty() && function.locals.back().depth == function.scope_depth)
+        function.locals.pop_back();
+    --function.scope_depth;
+}
+
+// A name can't be declared twice in the same scope. Declaring it in a
+// nested scope gives it a slot of its own, which hides the outer one until
+// the end of that scope.
+ErrorOr<VariableAddress, SyntaxError> ResolverContext::declare(Span const& location, std::string const& name)
+{
+    auto& function = m_functions.back();
+    for (auto it = function.locals.rbegin(); it != function.locals.rend() && it->depth == function.scope_depth; ++it) {
+        if (it->name == name)
+            return SyntaxError { location, ErrorCode::VariableAlreadyDeclared, name };
+    }
+    auto global = m_globals.index(name);
+    m_globals.shadow(global);
+    function.locals.push_back({ name, function.scope_depth, global });
+    return VariableAddress { VariableAddress::Scope::Local, static_cast<uint32_t>(function.locals.size() - 1) };
+}
+
+VariableAddress ResolverContext::resolve(std::string const& name)
+{
+    auto const& locals = m_functions.back().locals;
+    for (auto ix = static_cast<int>(locals.size()) - 1; ix >= 0; --ix) {
+        if (locals[ix].name == name)
+            return { VariableAddress::Scope::Local, static_cast<uint32_t>(ix) };
+    }
+    return { VariableAddress::Scope::Global, m_globals.index(name) };
+}
+
+CallSite ResolverContext::call_site() const
+{
+    CallSite ret;
+    auto const& locals = m_functions.back().locals;
+    for (auto ix = 0u; ix < locals.size(); ++ix)
+        ret.add(locals[ix].global, ix);
+    return ret;
+}
+
+ProcessResult resolve(pSyntaxNode const& tree, Globals& globals)
+{
+    ResolverContext ctx(globals);
+    return process(tree, ctx);
+}
+
+}
+
+namespace Scratch::Scribble {
+
+using namespace Scratch::Interp;
+
+INIT_NODE_PROCESSOR(ResolverContext)
+
+static ErrorOrTypedNode<Statement> resolve_scoped(pStatement const& statement, ResolverContext& ctx, ProcessResult& result)
+{
+    if (statement == nullptr)
+        return nullptr;
+    ctx.begin_scope();
+    auto ret = try_and_cast<Statement>(statement, ctx, result);
+    ctx.end_scope();
+    return ret;
+}
+
+static ErrorOr<Statements, SyntaxError> resolve_statements(Statements const& statements, ResolverContext& ctx, ProcessResult& result)
+{
+    Statements ret;
+    for (auto const& statement : statements)
+        ret.push_back(TRY(try_and_cast<Statement>(statement, ctx, result)));
+    return ret;
+}
+
+NODE_PROCESSOR(Module)
+{
+    auto module = std::dynamic_pointer_cast<Module>(tree);
+    auto statements = TRY(resolve_statements(module->statements(), ctx, result));
+    return std::make_shared<Module>(module, statements, module->tokens());
+}
+
+NODE_PROCESSOR(Block)
+{
+    auto block = std::dynamic_pointer_cast<Block>(tree);
+    ctx.begin_scope();
+    auto statements_maybe = resolve_statements(block->statements(), ctx, result);
+    ctx.end_scope();
+    if (statements_maybe.is_error())
+        return statements_maybe.error();
+    return std::make_shared<Block>(block->location(), statements_maybe.value());
+}
+
+// The name of a function declared inside another one is declared before
+// its body is resolved, so it's in scope for the calls the function makes
+// to itself.
+NODE_PROCESSOR(FunctionDef)
+{
+    auto func_def = std::dynamic_pointer_cast<FunctionDef>(tree);
+    auto decl = func_def->declaration();
+
+    VariableAddress address { VariableAddress::Scope::Global, 0 };
+    if (ctx.at_top_level())
+        address.index = ctx.globals().index(func_def->name());
+    else
+        address = TRY(ctx.declare(func_def->location(), func_def->name()));
+
+    ctx.begin_function();
+    Identifiers parameters;
+    for (auto const& param : decl->parameters()) {
+        auto address_maybe = ctx.declare(param->location(), param->name());
+        if (address_maybe.is_error()) {
+            ctx.end_function();
+            return address_maybe.error();
+        }
+        parameters.push_back(std::make_shared<ResolvedVariable>(param->location(), param->name(), address_maybe.value()));
+    }
+    auto statement_maybe = resolve_scoped(func_def->statement(), ctx, result);
+    ctx.end_function();
+    if (statement_maybe.is_error())
+        return statement_maybe.error();
+    auto identifier = std::make_shared<ResolvedVariable>(decl->identifier()->location(), func_def->name(), address);
+    auto resolved_decl = std::make_shared<FunctionDecl>(decl->location(), decl->module(), identifier, parameters);
+    return std::make_shared<FunctionDef>(func_def->location(), resolved_decl, statement_maybe.value());
+}
+
+NODE_PROCESSOR(VariableDeclaration)
+{
+    auto decl = std::dynamic_pointer_cast<VariableDeclaration>(tree);
+
+    // The initializer is resolved first, so it can't refer to the variable
+    // being declared:
+    std::shared_ptr<Expression> expr;
+    if (decl->expression() != nullptr)
+        expr = TRY_AND_CAST(Expression, decl->expression(), ctx);
+    VariableAddress address { VariableAddress::Scope::Global, 0 };
+    if (ctx.at_top_level())
+        address.index = ctx.globals().index(decl->name());
+    else
+        address = TRY(ctx.declare(decl->location(), decl->name()));
+    auto identifier = std::make_shared<ResolvedVariable>(decl->identifier()->location(), decl->name(), address);
+    return std::make_shared<VariableDeclaration>(decl->location(), identifier, expr, decl->is_const());
+}
+
+NODE_PROCESSOR(Variable)
+{
+    auto variable = std::dynamic_pointer_cast<Variable>(tree);
+    return std::make_shared<ResolvedVariable>(variable->location(), variable->name(), ctx.resolve(variable->name()));
+}
+
+NODE_PROCESSOR(ResolvedVariable)
+{
+    return tree;
+}
+
+NODE_PROCESSOR(BinaryExpression)
+{
+    auto expr = std::dynamic_pointer_cast<BinaryExpression>(tree);
+    auto lhs = TRY_AND_CAST(Expression, expr->lhs(), ctx);
+    auto rhs = TRY_AND_CAST(Expression, expr->rhs(), ctx);
+    if (expr->op().code() == TokenCode::OpenParen)
+        return std::make_shared<ResolvedCall>(expr, lhs, rhs, ctx.call_site());
+    return std::make_shared<BinaryExpression>(lhs, expr->op(), rhs);
+}
+
+NODE_PROCESSOR(ResolvedCall)
+{
+    return tree;
+}
+
+NODE_PROCESSOR(IntLiteral)
+{
+    auto literal = std::dynamic_pointer_cast<IntLiteral>(tree);
+    return std::make_shared<Constant>(literal->location(), Value(token_value<long>(literal->token()).value()));
+}
+
+NODE_PROCESSOR(StringLiteral)
+{
+    auto literal = std::dynamic_pointer_cast<StringLiteral>(tree);
+    return std::make_shared<Constant>(literal->location(), Value(literal->string()));
+}
+
+NODE_PROCESSOR(Constant)
+{
+    return tree;
+}
+
+NODE_PROCESSOR(Branch)
+{
+    auto branch = std::dynamic_pointer_cast<Branch>(tree);
+    std::shared_ptr<Expression> condition { nullptr };
+    if (branch->condition())
+        condition = TRY_AND_CAST(Expression, branch->condition(), ctx);
+    auto statement = TRY(resolve_scoped(branch->statement(), ctx, result));
+    return std::make_shared<Branch>(branch, condition, statement);
+}
+
+NODE_PROCESSOR(CaseStatement)
+{
+    auto case_stmt = std::dynamic_pointer_cast<CaseStatement>(tree);
+    auto condition = TRY_AND_CAST(Expression, case_stmt->condition(), ctx);
+    auto statement = TRY(resolve_scoped(case_stmt->statement(), ctx, result));
+    return std::make_shared<CaseStatement>(case_stmt, condition, statement);
+}
+
+NODE_PROCESSOR(DefaultCase)
+{
+    auto default_case = std::dynamic_pointer_cast<DefaultCase>(tree);
+    auto statement = TRY(resolve_scoped(default_case->statement(), ctx, result));
+    return std::make_shared<DefaultCase>(default_case, statement);
+}
+
+NODE_PROCESSOR(SwitchStatement)
+{
+    auto switch_stmt = std::dynamic_pointer_cast<SwitchStatement>(tree);
+    auto expr = TRY_AND_CAST(Expression, switch_stmt->expression(), ctx);
+    CaseStatements cases;
+    Values labels;
+    bool constant_labels = true;
+    for (auto const& case_stmt : switch_stmt->cases()) {
+        auto resolved_case = TRY_AND_CAST(CaseStatement, case_stmt, ctx);
+        if (auto label = std::dynamic_pointer_cast<Constant>(resolved_case->condition()); label != nullptr)
+            labels.push_back(label->value());
+        else
+            constant_labels = false;
+        cases.push_back(resolved_case);
+    }
+    auto default_case = TRY_AND_CAST(DefaultCase, switch_stmt->default_case(), ctx);
+    auto resolved = std::make_shared<SwitchStatement>(switch_stmt->location(), expr, cases, default_case);
+    if (constant_labels) {
+        if (auto table = JumpTable::create(labels); table.has_value())
+            return std::make_shared<TableSwitch>(resolved, cases, default_case, std::move(*table));
+    }
+    return resolved;
+}
+
+// The default processor drops the else branch.
+NODE_PROCESSOR(IfStatement)
+{
+    auto if_stmt = std::dynamic_pointer_cast<IfStatement>(tree);
+    Branches branches;
+    for (auto const& branch : if_stmt->branches())
+        branches.push_back(TRY_AND_CAST(Branch, branch, ctx));
+    if (if_stmt->else_stmt() != nullptr) {
+        auto else_stmt = TRY(resolve_scoped(if_stmt->else_stmt(), ctx, result));
+        branches.push_back(std::make_shared<Branch>(else_stmt->location(), else_stmt));
+    }
+    return std::make_shared<IfStatement>(if_stmt->location(), branches);
+}
+
+NODE_PROCESSOR(WhileStatement)
+{
+    auto while_stmt = std::dynamic_pointer_cast<WhileStatement>(tree);
+    auto condition = TRY_AND_CAST(Expression, while_stmt->condition(), ctx);
+    ctx.begin_loop();
+    auto statement_maybe = resolve_scoped(while_stmt->statement(), ctx, result);
+    ctx.end_loop();
+    if (statement_maybe.is_error())
+        return statement_maybe.error();
+    auto statement = statement_maybe.value();
+    return std::make_shared<WhileStatement>(while_stmt->location(), condition, statement);
+}
+
+NODE_PROCESSOR(ForStatement)
+{
+    auto for_stmt = std::dynamic_pointer_cast<ForStatement>(tree);
+    auto range = TRY_AND_CAST(Expression, for_stmt->range(), ctx);
+    ctx.begin_scope();
+    auto address_maybe = ctx.declare(for_stmt->variable()->location(), for_stmt->variable()->name());
+    if (address_maybe.is_error()) {
+        ctx.end_scope();
+        return address_maybe.error();
+    }
+    auto variable = std::make_shared<ResolvedVariable>(for_stmt->variable()->location(), for_stmt->variable()->name(), address_maybe.value());
+    ctx.begin_loop();
+    auto statement_maybe = resolve_scoped(for_stmt->statement(), ctx, result);
+    ctx.end_loop();
+    ctx.end_scope();
+    if (statement_maybe.is_error())
+        return statement_maybe.error();
+    return std::make_shared<ForStatement>(for_stmt->location(), variable, range, statement_maybe.value());
+}
+
+// The engines have nowhere to take break and continue outside of a loop,
+// so that is an error. A loop in the function calling this one doesn't
+// count.
+NODE_PROCESSOR(Break)
+{
+    if (!ctx.in_loop())
+        return SyntaxError { tree->location(), ErrorCode::SyntaxError, format("'{}' outside of a loop", tree->to_string()) };
+    return tree;
+}
+
+ALIAS_NODE_PROCESSOR(Continue, Break);
+
+}
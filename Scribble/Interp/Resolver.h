@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Scribble/Interp/Interpreter.h>
+#include <Scribble/Interp/JumpTable.h>
+#include <Scribble/Processor.h>
+#include <Scribble/Syntax/Expression.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+// Where a variable lives at run time: a slot in the frame of the function
+// being executed, or an index into the globals. A name that isn't a local
+// of the function can still refer to a local of the code calling it, which
+// is looked for first; see CallSite.
+struct VariableAddress {
+    enum class Scope : uint8_t {
+        Local,
+        Global,
+    };
+
+    Scope scope { Scope::Global };
+    uint32_t index { 0 };
+
+    [[nodiscard]] bool is_local() const { return scope == Scope::Local; }
+};
+
+// Replaces Variable nodes, and the identifiers in declarations and
+// parameter lists, in a resolved tree.
+NODE_CLASS(ResolvedVariable, Variable)
+public:
+    ResolvedVariable(Span, std::string, VariableAddress);
+    [[nodiscard]] VariableAddress const& address() const { return m_address; }
+    [[nodiscard]] std::string attributes() const override;
+
+private:
+    VariableAddress m_address;
+};
+
+// Replaces function calls in a resolved tree. Carries the locals in scope
+// where the call is made, for the function called to find the variables of
+// its caller.
+NODE_CLASS(ResolvedCall, BinaryExpression)
+public:
+    ResolvedCall(std::shared_ptr<BinaryExpression> const&, std::shared_ptr<Expression>, std::shared_ptr<Expression>, CallSite);
+    [[nodiscard]] CallSite const& call_site() const { return m_call_site; }
+
+private:
+    CallSite m_call_site;
+};
+
+// Replaces literals in a resolved tree, so their value is converted once
+// instead of every time the literal is evaluated.
+NODE_CLASS(Constant, Expression)
+public:
+    Constant(Span, Value);
+    [[nodiscard]] Value const& value() const { return m_value; }
+    [[nodiscard]] std::string attributes() const override;
+    [[nodiscard]] std::string to_string() const override;
+
+private:
+    Value m_value;
+};
+
+// Replaces a switch statement of which all case labels are constants of
+// the same type. The case taken is looked up in a jump table instead of
+// comparing the switch expression with every label in turn.
+NODE_CLASS(TableSwitch, SwitchStatement)
+public:
+    TableSwitch(std::shared_ptr<SwitchStatement> const&, CaseStatements, std::shared_ptr<DefaultCase>, JumpTable);
+    [[nodiscard]] JumpTable const& table() const { return m_table; }
+
+private:
+    JumpTable m_table;
+};
+
+// Keeps track of the variables in scope while the resolver walks the tree.
+// Every function gets a fresh set of slots, the parameters first. Variables
+// declared in a block, a branch, or a loop body go out of scope at the end
+// of it, and their slots are reused. A variable can hide one with the same
+// name declared in an enclosing scope. Variables declared at the top level
+// of a module are globals. Both engines run the resolved tree, so this is
+// where they get their scoping rules from.
+class ResolverContext {
+public:
+    explicit ResolverContext(Globals&);
+
+    // Scopes are opened and closed explicitly by the node processors, so
+    // the default block processor doesn't get a new context.
+    [[nodiscard]] ResolverContext& make_subcontext() { return *this; }
+    [[nodiscard]] Globals& globals() { return m_globals; }
+    [[nodiscard]] bool at_top_level() const { return m_functions.size() == 1 && m_functions.back().scope_depth == 0; }
+    void begin_function();
+    void end_function();
+    void begin_scope();
+    void end_scope();
+    void begin_loop() { ++m_functions.back().loops; }
+    void end_loop() { --m_functions.back().loops; }
+    [[nodiscard]] bool in_loop() const { return m_functions.back().loops > 0; }
+    ErrorOr<VariableAddress, SyntaxError> declare(Span const&, std::string const&);
+    [[nodiscard]] VariableAddress resolve(std::string const&);
+    [[nodiscard]] CallSite call_site() const;
+
+private:
+    struct Local {
+        std::string name;
+        int depth;
+        uint32_t global;
+    };
+
+    struct FunctionScope {
+        std::vector<Local> locals {};
+        int scope_depth { 0 };
+        int loops { 0 };
+    };
+
+    Globals& m_globals;
+    std::vector<FunctionScope> m_functions {};
+};
+
+// Returns a copy of the tree with every variable reference and declaration
+// replaced by a ResolvedVariable, every call by a ResolvedCall, every
+// literal by a Constant, and every switch with constant labels by a
+// TableSwitch. New globals are added to the table passed in.
+[[nodiscard]] ProcessResult resolve(pSyntaxNode const&, Globals&);
+
+}
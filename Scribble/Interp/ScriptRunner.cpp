@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <future>
+
+#include <Scribble/Interp/ScriptRunner.h>
+#include <Widget/App.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+
+static thread_local bool s_worker_thread { false };
+
+std::optional<ScriptMode> ScriptMode_by_name(std::string const& name)
+{
+#undef ENUM_SCRIPT_MODE
+#define ENUM_SCRIPT_MODE(mode)               \
+    if (stricmp(name.c_str(), #mode) == 0)   \
+        return ScriptMode::mode;
+    ENUMERATE_SCRIPT_MODES(ENUM_SCRIPT_MODE)
+#undef ENUM_SCRIPT_MODE
+    return {};
+}
+
+// A script still running when the editor quits is cancelled. If it's
+// waiting for the event loop it gets an error instead, because the event
+// loop is gone.
+ScriptRunner::~ScriptRunner()
+{
+    if (!m_thread.joinable())
+        return;
+    m_stopping = true;
+    ExecutionBudget::cancel();
+    m_thread.join();
+    SDL_SetEventFilter(nullptr, nullptr);
+}
+
+std::chrono::milliseconds ScriptRunner::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started);
+}
+
+bool ScriptRunner::on_worker_thread()
+{
+    return s_worker_thread;
+}
+
+// Called by SDL for every event, before it's queued. Esc is taken away from
+// the widgets while a script runs, so cancelling it doesn't also close a
+// dialog or the console.
+int ScriptRunner::filter_events(void*, SDL_Event* evt)
+{
+    if (evt->type == SDL_KEYDOWN && evt->key.keysym.sym == SDLK_ESCAPE) {
+        ExecutionBudget::cancel();
+        return 0;
+    }
+    return 1;
+}
+
+bool ScriptRunner::start(Job job, Done done, Step step)
+{
+    if (m_running)
+        return false;
+    m_started = std::chrono::steady_clock::now();
+    if (m_mode == ScriptMode::Blocking || (m_mode == ScriptMode::Sliced && step == nullptr)) {
+        done(job());
+        return true;
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+    m_running = true;
+    SDL_SetEventFilter(filter_events, nullptr);
+    if (m_mode == ScriptMode::Sliced) {
+        run_slice(step, done);
+        return true;
+    }
+    m_thread = std::thread([this, job = std::move(job), done = std::move(done)]() {
+        s_worker_thread = true;
+        auto result = job();
+        App::instance().post([this, result, done]() {
+            m_thread.join();
+            finish(result, done);
+        });
+    });
+    return true;
+}
+
+// Runs one slice of the script every frame. The next slice is posted
+// without waking the event loop, so the editor gets the rest of the frame.
+void ScriptRunner::run_slice(Step const& step, Done const& done)
+{
+    auto result = step(std::chrono::milliseconds { SCRATCH_SCRIPT_SLICE_MS });
+    if (!result.has_value()) {
+        App::instance().post([this, step, done]() { run_slice(step, done); }, false);
+        return;
+    }
+    finish(*result, done);
+}
+
+void ScriptRunner::finish(ProcessResult const& result, Done const& done)
+{
+    SDL_SetEventFilter(nullptr, nullptr);
+    m_running = false;
+    done(result);
+}
+
+Value ScriptRunner::on_main_thread(std::function<Value()> const& func)
+{
+    if (!on_worker_thread())
+        return func();
+    auto promise = std::make_shared<std::promise<Value>>();
+    auto future = promise->get_future();
+    App::instance().post([promise, func]() {
+        promise->set_value(func());
+    });
+    while (future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+        if (m_stopping)
+            return Value(ErrorCode::ExecutionError);
+    }
+    return future.get();
+}
+
+}
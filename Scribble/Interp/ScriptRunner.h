@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <thread>
+
+#include <SDL.h>
+
+#include <Scribble/Interp/Interpreter.h>
+
+#ifndef SCRATCH_SCRIPT_MODE
+#define SCRATCH_SCRIPT_MODE Worker
+#endif /* SCRATCH_SCRIPT_MODE */
+
+#ifndef SCRATCH_SCRIPT_SLICE_MS
+#define SCRATCH_SCRIPT_SLICE_MS 5
+#endif /* SCRATCH_SCRIPT_SLICE_MS */
+
+namespace Scratch::Interp {
+
+#define ENUMERATE_SCRIPT_MODES(S) \
+    S(Blocking)                   \
+    S(Worker)                     \
+    S(Sliced)
+
+// Blocking runs scripts on the event loop, which waits until they are
+// done. Worker runs them on a thread of their own. Sliced runs them on the
+// event loop, SCRATCH_SCRIPT_SLICE_MS milliseconds every frame; only the
+// bytecode engine can do that, scripts for the other engines block.
+enum class ScriptMode {
+#undef ENUM_SCRIPT_MODE
+#define ENUM_SCRIPT_MODE(mode) mode,
+    ENUMERATE_SCRIPT_MODES(ENUM_SCRIPT_MODE)
+#undef ENUM_SCRIPT_MODE
+};
+
+constexpr char const* ScriptMode_name(ScriptMode mode)
+{
+    switch (mode) {
+#undef ENUM_SCRIPT_MODE
+#define ENUM_SCRIPT_MODE(mode) \
+    case ScriptMode::mode:     \
+        return #mode;
+        ENUMERATE_SCRIPT_MODES(ENUM_SCRIPT_MODE)
+#undef ENUM_SCRIPT_MODE
+    default:
+        fatal("Unknown ScriptMode value '{}'", (int)mode);
+    }
+}
+
+[[nodiscard]] std::optional<ScriptMode> ScriptMode_by_name(std::string const&);
+
+// Runs scripts without keeping the editor from rendering, in the mode
+// selected. Anything a script on the worker does to the editor, like
+// running a command, has to go through on_main_thread(). The result of the
+// script is handed to the Done function on the event loop. Only one script
+// runs at a time, and Esc cancels it.
+class ScriptRunner {
+public:
+    using Job = std::function<ProcessResult()>;
+    using Step = std::function<std::optional<ProcessResult>(std::chrono::milliseconds)>;
+    using Done = std::function<void(ProcessResult const&)>;
+
+    ScriptRunner() = default;
+    ScriptRunner(ScriptRunner const&) = delete;
+    ~ScriptRunner();
+
+    [[nodiscard]] ScriptMode mode() const { return m_mode; }
+    void mode(ScriptMode mode) { m_mode = mode; }
+    [[nodiscard]] bool is_running() const { return m_running; }
+    [[nodiscard]] std::chrono::milliseconds elapsed() const;
+
+    // The job runs the script to the end. The step, if there is one, runs
+    // it for at most the time given, and returns nothing until the script
+    // is done; it's used instead of the job in Sliced mode. Returns false,
+    // and doesn't run anything, if a script is running already.
+    bool start(Job, Done, Step = nullptr);
+
+    // Runs the function on the event loop and waits for it to finish when
+    // called from the worker; just runs it otherwise.
+    [[nodiscard]] Value on_main_thread(std::function<Value()> const&);
+
+    [[nodiscard]] static bool on_worker_thread();
+
+private:
+    static int filter_events(void*, SDL_Event*);
+    void run_slice(Step const&, Done const&);
+    void finish(ProcessResult const&, Done const&);
+
+    std::thread m_thread {};
+    std::atomic<bool> m_running { false };
+    std::atomic<bool> m_stopping { false };
+    std::chrono::steady_clock::time_point m_started {};
+    ScriptMode m_mode { ScriptMode::SCRATCH_SCRIPT_MODE };
+};
+
+}
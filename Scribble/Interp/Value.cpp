@@ -66,9 +66,9 @@ template<typename Callback>
 static decltype(auto) downsize_integer(Value const& value, Callback&& callback)
 {
     assert(value.is_int());
-    if (std::holds_alternative<int64_t>(value.value()))
-        return downsize_integer(std::get<int64_t>(value.value()), std::forward<Callback>(callback));
-    return downsize_integer(std::get<uint64_t>(value.value()), std::forward<Callback>(callback));
+    if (!value.is_unsigned())
+        return downsize_integer(value.to_int<int64_t>().value(), std::forward<Callback>(callback));
+    return downsize_integer(value.to_int<uint64_t>().value(), std::forward<Callback>(callback));
 }
 
 template<typename Callback>
@@ -77,7 +77,7 @@ static Value perform_integer_operation(Value const& lhs, Value const& rhs, Callb
     assert(lhs.is_int());
     assert(rhs.is_int());
 
-    if (std::holds_alternative<int64_t>(lhs.value())) {
+    if (!lhs.is_unsigned()) {
         if (auto rhs_value = rhs.to_int<int64_t>(); rhs_value.has_value())
             return callback(lhs.to_int<int64_t>().value(), rhs_value.value());
     } else {
@@ -95,13 +95,13 @@ Value::Value(ValueType type)
 
 Value::Value(std::string value)
     : m_type(ValueType::Text)
-    , m_value(std::move(value))
+    , m_repr(Repr::Text)
+    , m_text(new Shared<std::string> { 1, std::move(value) })
 {
 }
 
 Value::Value(std::string_view value)
-    : m_type(ValueType::Text)
-    , m_value(std::string(value))
+    : Value(std::string(value))
 {
 }
 
@@ -110,42 +110,65 @@ Value::Value(double value)
     if (trunc(value) == value) {
         if (is_within_range<int64_t>(value)) {
             m_type = ValueType::Integer;
-            m_value = static_cast<int64_t>(value);
+            m_repr = Repr::Int;
+            m_int = static_cast<int64_t>(value);
             return;
         }
         if (is_within_range<uint64_t>(value)) {
             m_type = ValueType::Integer;
-            m_value = static_cast<uint64_t>(value);
+            m_repr = Repr::Uint;
+            m_uint = static_cast<uint64_t>(value);
             return;
         }
     }
     m_type = ValueType::Float;
-    m_value = value;
+    m_repr = Repr::Float;
+    m_float = value;
 }
 
 Value::Value(ErrorCode value)
     : m_type(ValueType::Error)
-    , m_value(value)
+    , m_repr(Repr::Error)
+    , m_error(value)
 {
 }
 
 Value::Value(pFunction value)
     : m_type(ValueType::Function)
-    , m_value(value)
+    , m_repr(Repr::Function)
+    , m_function(new Shared<pFunction> { 1, std::move(value) })
 {
 }
 
-Value::Value(Value&& other) noexcept
-    : m_type(other.m_type)
-    , m_value(std::move(other.m_value))
+void Value::release()
 {
+    switch (m_repr) {
+    case Repr::Text:
+        if (m_text->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete m_text;
+        break;
+    case Repr::Function:
+        if (m_function->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete m_function;
+        break;
+    default:
+        break;
+    }
+    m_repr = Repr::Null;
 }
 
-Value::~Value() = default;
-
-ValueType Value::type() const
+// Appends in place if this value is the only one referring to its string,
+// which is the case for the intermediate results of 'a + b + c'.
+bool Value::append(Value const& other)
 {
-    return m_type;
+    if (m_repr != Repr::Text || other.m_repr != Repr::Text)
+        return false;
+    if (m_text->refs.load(std::memory_order_acquire) == 1) {
+        m_text->value += other.m_text->value;
+        return true;
+    }
+    *this = Value(m_text->value + other.m_text->value);
+    return true;
 }
 
 std::string_view Value::type_name() const
@@ -168,140 +191,120 @@ bool Value::is_type_compatible_with(ValueType other_type) const
     return type() == other_type;
 }
 
-bool Value::is_null() const
-{
-    return !m_value.has_value();
-}
-
-bool Value::is_int() const
-{
-    return m_value.has_value() && (std::holds_alternative<int64_t>(m_value.value()) || std::holds_alternative<uint64_t>(m_value.value()));
-}
-
-bool Value::is_string() const
-{
-    return m_value.has_value() && std::holds_alternative<std::string>(m_value.value());
-}
-
-bool Value::is_error() const
-{
-    return m_value.has_value() && std::holds_alternative<ErrorCode>(m_value.value());
-}
-
-bool Value::is_function() const
-{
-    return m_value.has_value() && std::holds_alternative<pFunction>(m_value.value());
-}
-
 std::string Value::to_string() const
 {
-    if (is_null())
+    switch (m_repr) {
+    case Repr::Null:
         return "(null)";
-
-    return visit(
-        [](std::string const& value) -> std::string { return value; },
-        [](Integer auto value) -> std::string { return Obelix::to_string<decltype(value)>()(value); },
-        [](double value) -> std::string { return Obelix::to_string<double>()(value); },
-        [](bool value) -> std::string { return value ? "true" : "false"; },
-        [](ErrorCode value) -> std::string { return ErrorCode_name(value); },
-        [](pFunction const& value) -> std::string { return value->to_string(); });
+    case Repr::Text:
+        return m_text->value;
+    case Repr::Int:
+        return Obelix::to_string<int64_t>()(m_int);
+    case Repr::Uint:
+        return Obelix::to_string<uint64_t>()(m_uint);
+    case Repr::Float:
+        return Obelix::to_string<double>()(m_float);
+    case Repr::Bool:
+        return m_bool ? "true" : "false";
+    case Repr::Error:
+        return ErrorCode_name(m_error);
+    case Repr::Function:
+        return m_function->value->to_string();
+    default:
+        fatal("Unreachable");
+    }
 }
 
 std::optional<double> Value::to_double() const
 {
-    if (is_null())
+    switch (m_repr) {
+    case Repr::Text:
+        return Obelix::try_to_double<std::string>()(m_text->value);
+    case Repr::Int:
+        return static_cast<double>(m_int);
+    case Repr::Uint:
+        return static_cast<double>(m_uint);
+    case Repr::Float:
+        return m_float;
+    case Repr::Bool:
+        return static_cast<double>(m_bool);
+    case Repr::Error:
+        return static_cast<double>(m_error);
+    default:
         return {};
-
-    return visit(
-        [](std::string const& value) -> std::optional<double> { return Obelix::try_to_double<std::string>()(value); },
-        [](Integer auto value) -> std::optional<double> { return static_cast<double>(value); },
-        [](double value) -> std::optional<double> { return value; },
-        [](bool value) -> std::optional<double> { return static_cast<double>(value); },
-        [](ErrorCode value) -> std::optional<double> { return static_cast<double>(value); },
-        [](pFunction const& value) -> std::optional<double> { return {}; });
+    }
 }
 
 std::optional<bool> Value::to_bool() const
 {
-    if (is_null())
+    switch (m_repr) {
+    case Repr::Text: {
+        auto const& value = m_text->value;
+        if (stricmp(value.c_str(), "true") == 0 || stricmp(value.c_str(), "t") == 0)
+            return true;
+        if (stricmp(value.c_str(), "false") == 0 || stricmp(value.c_str(), "f") == 0)
+            return false;
         return {};
-
-    return visit(
-        [](std::string const& value) -> std::optional<bool> {
-            if (stricmp(value.c_str(), "true") == 0 || stricmp(value.c_str(), "t") == 0)
-                return true;
-            if (stricmp(value.c_str(), "false") == 0 || stricmp(value.c_str(), "f") == 0)
-                return false;
-            return {};
-        },
-        [](Integer auto value) -> std::optional<bool> { return static_cast<bool>(value); },
-        [](double value) -> std::optional<bool> { return fabs(value) > std::numeric_limits<double>::epsilon(); },
-        [](bool value) -> std::optional<bool> { return value; },
-        [](ErrorCode value) -> std::optional<bool> { return value == ErrorCode::NoError; },
-        [](pFunction const& value) -> std::optional<bool> { return {}; });
+    }
+    case Repr::Int:
+        return m_int != 0;
+    case Repr::Uint:
+        return m_uint != 0;
+    case Repr::Float:
+        return fabs(m_float) > std::numeric_limits<double>::epsilon();
+    case Repr::Bool:
+        return m_bool;
+    case Repr::Error:
+        return m_error == ErrorCode::NoError;
+    default:
+        return {};
+    }
 }
 
 std::optional<ErrorCode> Value::to_error() const
 {
-    if (is_null())
+    if (m_repr != Repr::Error)
         return {};
-
-    return visit(
-        [](std::string const& value) -> std::optional<ErrorCode> { return {}; },
-        [](Integer auto value) -> std::optional<ErrorCode> { return {}; },
-        [](double value) -> std::optional<ErrorCode> { return {}; },
-        [](bool value) -> std::optional<ErrorCode> { return {}; },
-        [](ErrorCode value) -> std::optional<ErrorCode> { return value; },
-        [](pFunction const& value) -> std::optional<ErrorCode> { return {}; });
+    return m_error;
 }
 
 std::optional<pFunction> Value::to_function() const
 {
-    if (is_null())
+    if (m_repr != Repr::Function)
         return {};
-
-    return visit(
-        [](std::string const& value) -> std::optional<pFunction> { return {}; },
-        [](Integer auto value) -> std::optional<pFunction> { return {}; },
-        [](double value) -> std::optional<pFunction> { return {}; },
-        [](bool value) -> std::optional<pFunction> { return {}; },
-        [](ErrorCode value) -> std::optional<pFunction> { return {}; },
-        [](pFunction const& value) -> std::optional<pFunction> { return value; });
+    return m_function->value;
 }
 
 Value& Value::operator=(Value value)
 {
-    m_type = value.m_type;
-    m_value = std::move(value.m_value);
+    std::swap(m_type, value.m_type);
+    std::swap(m_repr, value.m_repr);
+    std::swap(m_bits, value.m_bits);
     return *this;
 }
 
 Value& Value::operator=(std::string value)
 {
-    m_type = ValueType::Text;
-    m_value = std::move(value);
-    return *this;
+    return *this = Value(std::move(value));
 }
 
 Value& Value::operator=(double value)
 {
+    release();
     m_type = ValueType::Float;
-    m_value = value;
+    m_repr = Repr::Float;
+    m_float = value;
     return *this;
 }
 
 Value& Value::operator=(ErrorCode value)
 {
-    m_type = ValueType::Error;
-    m_value = value;
-    return *this;
+    return *this = Value(value);
 }
 
 Value& Value::operator=(pFunction const& value)
 {
-    m_type = ValueType::Function;
-    m_value = value;
-    return *this;
+    return *this = Value(value);
 }
 
 int Value::compare(Value const& other) const
@@ -311,51 +314,63 @@ int Value::compare(Value const& other) const
     if (other.is_null())
         return 1;
 
-    return visit(
-        [&](std::string const& value) -> int { return value.compare(other.to_string()); },
-        [&](Integer auto value) -> int {
-            auto casted = other.to_int<IntegerType<decltype(value)>>();
+    switch (m_repr) {
+    case Repr::Text:
+        if (other.m_repr == Repr::Text)
+            return m_text->value.compare(other.m_text->value);
+        return m_text->value.compare(other.to_string());
+    case Repr::Int:
+    case Repr::Uint: {
+        auto compare_int = [&other](Integer auto value) -> int {
+            auto casted = other.to_int<decltype(value)>();
             if (!casted.has_value())
                 return 1;
 
             if (value == *casted)
                 return 0;
             return value < *casted ? -1 : 1;
-        },
-        [&](double value) -> int {
-            auto casted = other.to_double();
-            if (!casted.has_value())
-                return 1;
-
-            auto diff = value - *casted;
-            if (fabs(diff) < std::numeric_limits<double>::epsilon())
-                return 0;
-            return diff < 0 ? -1 : 1;
-        },
-        [&](bool value) -> int {
-            auto casted = other.to_bool();
-            if (!casted.has_value())
-                return 1;
-            return value ^ *casted;
-        },
-        [&](ErrorCode value) -> int {
-            auto casted = other.to_error();
-            if (!casted.has_value())
-                return 1;
+        };
+        if (m_repr == Repr::Int)
+            return compare_int(m_int);
+        return compare_int(m_uint);
+    }
+    case Repr::Float: {
+        auto casted = other.to_double();
+        if (!casted.has_value())
+            return 1;
 
-            if (value == *casted)
-                return 0;
-            return value < *casted ? -1 : 1;
-        },
-        [&](pFunction const& value) -> int {
-            auto casted = other.to_function();
-            if (!casted.has_value())
-                return 1;
+        auto diff = m_float - *casted;
+        if (fabs(diff) < std::numeric_limits<double>::epsilon())
+            return 0;
+        return diff < 0 ? -1 : 1;
+    }
+    case Repr::Bool: {
+        auto casted = other.to_bool();
+        if (!casted.has_value())
+            return 1;
+        return m_bool ^ *casted;
+    }
+    case Repr::Error: {
+        auto casted = other.to_error();
+        if (!casted.has_value())
+            return 1;
 
-            if (value == *casted)
-                return 0;
+        if (m_error == *casted)
+            return 0;
+        return m_error < *casted ? -1 : 1;
+    }
+    case Repr::Function: {
+        auto casted = other.to_function();
+        if (!casted.has_value())
             return 1;
-        });
+
+        if (m_function->value == *casted)
+            return 0;
+        return 1;
+    }
+    default:
+        fatal("Unreachable");
+    }
 }
 
 bool Value::operator==(Value const& value) const
@@ -417,7 +432,7 @@ Value Value::add(Value const& other) const
     }
 
     if (is_string() && other.is_string())
-        return Value { to_string() + other.to_string() };
+        return Value { string() + other.string() };
 
     auto lhs = to_double();
     auto rhs = other.to_double();
@@ -466,7 +481,7 @@ Value Value::multiply(Value const& other) const
         auto how_many = *other.to_int<int>();
 
         for (auto ix = 0u; ix < how_many; ++ix) {
-            ret += to_string();
+            ret += string();
         }
         return Value { ret };
     }
@@ -6,15 +6,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <concepts>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <variant>
+#include <utility>
 #include <vector>
 
+#include <core/Checked.h>
 #include <core/Error.h>
 #include <core/Logging.h>
 #include <core/StringUtil.h>
@@ -65,6 +70,12 @@ constexpr std::string_view ValueType_name(ValueType t)
 class Function;
 using pFunction = std::shared_ptr<Function>;
 
+// A Value is 16 bytes: the type, a tag telling which member of the union
+// is in use, and the union. Numbers, booleans and error codes are stored
+// inline. Strings and functions are stored in a reference counted block on
+// the heap, so copying any Value never copies a string, and at most bumps a
+// counter. A string is never changed while it is shared; operations on
+// strings make new ones, except append() on a string nothing else refers to.
 class Value {
     template<Integer T>
     using IntegerType = std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>;
@@ -76,48 +87,65 @@ public:
     explicit Value(double);
     explicit Value(ErrorCode);
     explicit Value(pFunction);
-    Value(Value const&) noexcept = default;
-    Value(Value&&) noexcept;
-    ~Value();
+
+    Value(Value const& other) noexcept
+        : m_type(other.m_type)
+        , m_repr(other.m_repr)
+        , m_bits(other.m_bits)
+    {
+        retain();
+    }
+
+    Value(Value&& other) noexcept
+        : m_type(other.m_type)
+        , m_repr(other.m_repr)
+        , m_bits(other.m_bits)
+    {
+        other.m_type = ValueType::Null;
+        other.m_repr = Repr::Null;
+    }
+
+    ~Value()
+    {
+        release();
+    }
 
     explicit Value(int64_t value)
         : m_type(ValueType::Integer)
-        , m_value(value)
+        , m_repr(Repr::Int)
+        , m_int(value)
     {
     }
 
     explicit Value(uint64_t value)
         : m_type(ValueType::Integer)
-        , m_value(value)
+        , m_repr(Repr::Uint)
+        , m_uint(value)
     {
     }
 
     explicit Value(Integer auto value)
-        : m_type(ValueType::Integer)
-        , m_value(static_cast<IntegerType<decltype(value)>>(value))
+        : Value(static_cast<IntegerType<decltype(value)>>(value))
     {
     }
 
     explicit Value(Boolean auto value)
         : m_type(ValueType::Boolean)
-        , m_value(value)
+        , m_repr(Repr::Bool)
+        , m_bool(value)
     {
     }
 
-    [[nodiscard]] ValueType type() const;
+    [[nodiscard]] ValueType type() const { return m_type; }
     [[nodiscard]] std::string_view type_name() const;
     [[nodiscard]] bool is_type_compatible_with(ValueType) const;
-    [[nodiscard]] bool is_null() const;
-    [[nodiscard]] bool is_int() const;
-    [[nodiscard]] bool is_string() const;
-    [[nodiscard]] bool is_error() const;
-    [[nodiscard]] bool is_function() const;
-
-    [[nodiscard]] auto const& value() const
-    {
-        assert(m_value.has_value());
-        return *m_value;
-    }
+    [[nodiscard]] bool is_null() const { return m_repr == Repr::Null; }
+    [[nodiscard]] bool is_int() const { return m_repr == Repr::Int || m_repr == Repr::Uint; }
+    [[nodiscard]] bool is_unsigned() const { return m_repr == Repr::Uint; }
+    [[nodiscard]] bool is_signed_int() const { return m_repr == Repr::Int; }
+    [[nodiscard]] bool is_string() const { return m_repr == Repr::Text; }
+    [[nodiscard]] bool is_error() const { return m_repr == Repr::Error; }
+    [[nodiscard]] bool is_function() const { return m_repr == Repr::Function; }
 
     [[nodiscard]] std::string to_string() const;
     [[nodiscard]] std::optional<double> to_double() const;
@@ -125,54 +153,78 @@ public:
     [[nodiscard]] std::optional<ErrorCode> to_error() const;
     [[nodiscard]] std::optional<pFunction> to_function() const;
 
-    template<class... Fs>
-    struct Visitor : Fs... {
-        explicit Visitor(Fs&&... functions)
-            : Fs(std::forward<Fs>(functions))...
-        {
-        }
+    // The string of a Text value, without copying it. Only valid as long as
+    // the value is.
+    [[nodiscard]] std::string const& string() const
+    {
+        assert(is_string());
+        return m_text->value;
+    }
 
-        using Fs::operator()...;
-    };
+    [[nodiscard]] int64_t int64() const
+    {
+        assert(is_signed_int());
+        return m_int;
+    }
 
-    template<typename... Fs>
-    decltype(auto) visit(Fs&&... functions)
+    // Fast paths for operations on two signed integers, and for string
+    // concatenation. They change the value in place and return true, or
+    // return false and leave it alone if either operand has another
+    // representation or the result would overflow. The caller then falls
+    // back to the generic operation, which deals with everything else.
+    bool add_int(Value const& other)
     {
-        return std::visit(Visitor { std::forward<Fs>(functions)... }, m_value.value());
+        return int_operation(other, [](auto& result, int64_t rhs) { result.add(rhs); });
     }
 
-    template<typename... Fs>
-    decltype(auto) visit(Fs&&... functions) const
+    bool subtract_int(Value const& other)
     {
-        return std::visit(Visitor { std::forward<Fs>(functions)... }, m_value.value());
+        return int_operation(other, [](auto& result, int64_t rhs) { result.sub(rhs); });
     }
 
+    bool multiply_int(Value const& other)
+    {
+        return int_operation(other, [](auto& result, int64_t rhs) { result.mul(rhs); });
+    }
+
+    bool modulo_int(Value const& other)
+    {
+        return int_operation(other, [](auto& result, int64_t rhs) { result.mod(rhs); });
+    }
+
+    bool append(Value const& other);
+
     template<Integer T>
     [[nodiscard]] std::optional<T> to_int() const
     {
-        if (is_null())
+        auto in_range = [](auto value) -> std::optional<T> {
+            if (!std::in_range<T>(value))
+                return {};
+            return static_cast<T>(value);
+        };
+
+        switch (m_repr) {
+        case Repr::Text:
+            if constexpr (std::is_signed_v<T>)
+                return Obelix::to_int<std::string, T>(m_text->value);
+            else
+                return to_uint<std::string, T>(m_text->value);
+        case Repr::Int:
+            return in_range(m_int);
+        case Repr::Uint:
+            return in_range(m_uint);
+        case Repr::Float: {
+            if (m_float < std::numeric_limits<T>::min() || m_float > std::numeric_limits<T>::max())
+                return {};
+            return static_cast<T>(round(m_float));
+        }
+        case Repr::Bool:
+            return static_cast<T>(m_bool);
+        case Repr::Error:
+            return static_cast<T>(m_error);
+        default:
             return {};
-
-        return visit(
-            [](std::string const& value) -> std::optional<T> {
-                if constexpr (std::is_signed_v<T>)
-                    return Obelix::to_int<std::string, T>(value);
-                else
-                    return to_uint<std::string, T>(value);
-            },
-            [](Integer auto value) -> std::optional<T> {
-                if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max())
-                    return {};
-                return static_cast<T>(value);
-            },
-            [](double value) -> std::optional<T> {
-                if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max())
-                    return {};
-                return static_cast<T>(round(value));
-            },
-            [](bool value) -> std::optional<T> { return static_cast<T>(value); },
-            [](ErrorCode value) -> std::optional<T> { return static_cast<T>(value); },
-            [](pFunction const& value) -> std::optional<T> { return {}; });
+        }
     }
 
     Value& operator=(Value);
@@ -183,16 +235,12 @@ public:
 
     Value& operator=(Integer auto value)
     {
-        m_type = ValueType::Integer;
-        m_value = static_cast<IntegerType<decltype(value)>>(value);
-        return *this;
+        return *this = Value(value);
     }
 
     Value& operator=(Boolean auto value)
     {
-        m_type = ValueType::Boolean;
-        m_value = value;
-        return *this;
+        return *this = Value(value);
     }
 
     [[nodiscard]] int compare(Value const&) const;
@@ -227,12 +275,62 @@ public:
     [[nodiscard]] Value bitwise_not() const;
 
 private:
-    using ValueImplType = std::variant<std::string, int64_t, uint64_t, double, bool, ErrorCode, pFunction>;
+    enum class Repr : uint8_t {
+        Null,
+        Text,
+        Int,
+        Uint,
+        Float,
+        Bool,
+        Error,
+        Function,
+    };
+
+    template<typename T>
+    struct Shared {
+        std::atomic<uint32_t> refs { 1 };
+        T value;
+    };
+
+    void retain() const
+    {
+        if (m_repr == Repr::Text)
+            m_text->refs.fetch_add(1, std::memory_order_relaxed);
+        else if (m_repr == Repr::Function)
+            m_function->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release();
+
+    template<typename Operation>
+    bool int_operation(Value const& other, Operation&& operation)
+    {
+        if (m_repr != Repr::Int || other.m_repr != Repr::Int)
+            return false;
+        Checked result { m_int };
+        operation(result, other.m_int);
+        if (result.has_overflow())
+            return false;
+        m_int = result.value_unchecked();
+        return true;
+    }
 
     ValueType m_type { ValueType::Null };
-    std::optional<ValueImplType> m_value;
+    Repr m_repr { Repr::Null };
+    union {
+        uint64_t m_bits { 0 };
+        int64_t m_int;
+        uint64_t m_uint;
+        double m_float;
+        bool m_bool;
+        ErrorCode m_error;
+        Shared<std::string>* m_text;
+        Shared<pFunction>* m_function;
+    };
 };
 
+static_assert(sizeof(Value) == 16);
+
 using Values = std::vector<Value>;
 
 }
@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <Scribble/Interp/ExpressionResult.h>
+#include <Scribble/Interp/Folder.h>
+#include <Scribble/Interp/Resolver.h>
+#include <Scribble/Interp/VirtualMachine.h>
+
+namespace Scratch::Interp {
+
+using namespace Obelix;
+using namespace Scratch::Scribble;
+
+static bool s_quickening { true };
+
+bool vm_quickening()
+{
+    return s_quickening;
+}
+
+void set_vm_quickening(bool quickening)
+{
+    s_quickening = quickening;
+}
+
+VirtualMachine::VirtualMachine(Builtins const& builtins)
+    : m_quickening(s_quickening)
+{
+    m_stack.reserve(1024);
+    for (auto const& [name, value] : builtins) {
+        if (auto err = define(name, value); err.is_error())
+            log_error("Could not define builtin '{}': {}", name, err.error());
+    }
+}
+
+ProcessResult VirtualMachine::execute(std::shared_ptr<Project> const& project)
+{
+    begin(project, false);
+    return *proceed();
+}
+
+// A script waiting for the delay of a yield to pass isn't continued, unless
+// it has been cancelled in the mean time. A cancelled script is dropped
+// without running it any further.
+std::optional<ProcessResult> VirtualMachine::run_slice(std::shared_ptr<Project> const& project, std::chrono::milliseconds slice)
+{
+    if (!m_execution.has_value())
+        begin(project, true);
+    else if (std::chrono::steady_clock::now() < m_resume_at && !ExecutionBudget::cancelled())
+        return {};
+    m_context.budget().start_slice(slice);
+    if (m_context.budget().exhausted()) {
+        ProcessResult result = m_context.budget().error(m_execution->project->location());
+        if (m_frames.size() > m_execution->depth) {
+            m_stack.resize(m_frames[m_execution->depth].base - 1);
+            m_frames.resize(m_execution->depth);
+        }
+        m_execution.reset();
+        return result;
+    }
+    return proceed();
+}
+
+void VirtualMachine::begin(std::shared_ptr<Project> const& project, bool sliced)
+{
+    m_execution = Execution { project, m_frames.size() };
+    m_sliced = sliced;
+    m_resume_at = {};
+    m_context.budget().start();
+}
+
+// Compiles and runs the modules of the project one after the other, until
+// the last one is done or the script is put aside.
+std::optional<ProcessResult> VirtualMachine::proceed()
+{
+    auto& execution = *m_execution;
+    auto const& modules = execution.project->modules();
+    ProcessResult result;
+    while (execution.module < modules.size()) {
+        if (!execution.in_module) {
+            auto folded = fold(modules[execution.module]);
+            if (folded.is_error()) {
+                m_execution.reset();
+                return folded;
+            }
+            auto resolved = resolve(folded.value(), globals());
+            if (resolved.is_error()) {
+                m_execution.reset();
+                return resolved;
+            }
+            Compiler compiler(*this);
+            auto script_maybe = compiler.compile(std::dynamic_pointer_cast<Module>(resolved.value()));
+            if (script_maybe.is_error()) {
+                m_execution.reset();
+                result = script_maybe.error();
+                return result;
+            }
+            auto script = script_maybe.value();
+            m_stack.emplace_back(std::static_pointer_cast<Function>(script));
+            m_frames.push_back({ script.get(), 0, m_stack.size() });
+            execution.in_module = true;
+        }
+        auto value_maybe = run(execution.depth);
+        if (m_suspended) {
+            m_suspended = false;
+            return {};
+        }
+        if (m_context.budget().exhausted()) {
+            result = m_context.budget().error(execution.project->location());
+            m_execution.reset();
+            return result;
+        }
+        if (value_maybe.is_error()) {
+            m_execution.reset();
+            result = value_maybe.error();
+            return result;
+        }
+        execution.value = value_maybe.value();
+        execution.in_module = false;
+        ++execution.module;
+    }
+    result = std::make_shared<ExpressionResult>(execution.project->location(), execution.value);
+    m_execution.reset();
+    return result;
+}
+
+// Calls a compiled function from native code, for example when a builtin
+// calls back into a script. Errors are reported the same way as the tree
+// interpreter does for a failing function.
+Value VirtualMachine::call(BytecodeFunction const& function, Values const& arguments)
+{
+    if (arguments.size() < function.arity())
+        return Value {};
+    if (m_frames.size() >= SCRATCH_VM_MAX_FRAMES)
+        return Value(ErrorCode::ExecutionError);
+    auto depth = m_frames.size();
+    auto stack_height = m_stack.size();
+    m_stack.emplace_back();
+    for (auto ix = 0u; ix < function.arity(); ++ix)
+        m_stack.push_back(arguments[ix]);
+    m_frames.push_back({ &function, 0, stack_height + 1 });
+    ++m_native_calls;
+    auto ret = run(depth);
+    --m_native_calls;
+    if (ret.is_error()) {
+        m_frames.resize(depth);
+        m_stack.resize(stack_height);
+        return Value(ErrorCode::ExecutionError);
+    }
+    return ret.value();
+}
+
+ErrorOr<void, SyntaxError> VirtualMachine::define(std::string const& name, Value value)
+{
+    return m_context.globals().define(name, std::move(value));
+}
+
+// Every frame below the one running is making a call, so the instruction
+// before its ip is the Call telling which of its locals are in scope.
+Value* VirtualMachine::find_caller_local(uint32_t name)
+{
+    for (auto ix = m_frames.size() - 1; ix-- > 0;) {
+        auto const& frame = m_frames[ix];
+        auto const& call = frame.function->code()[frame.ip - 1];
+        if (auto slot = frame.function->call_sites()[call.b].slot(name); slot.has_value())
+            return &m_stack[frame.base + *slot];
+    }
+    return nullptr;
+}
+
+#define FAIL(error)                                                                 \
+    do {                                                                            \
+        SyntaxError __error = (error);                                              \
+        if (m_frames.size() - depth <= 1) {                                         \
+            m_stack.resize(frame->base - 1);                                        \
+            m_frames.resize(depth);                                                 \
+            return __error;                                                         \
+        }                                                                           \
+        m_stack.resize(frame->base - 1);                                            \
+        m_stack.emplace_back(ErrorCode::ExecutionError);                            \
+        m_frames.pop_back();                                                        \
+        frame = &m_frames.back();                                                   \
+        code = frame->function->code().data();                                      \
+        goto next;                                                                  \
+    } while (0)
+
+// Puts the script aside. The stack and the frames are left as they are, so
+// calling run() again continues it.
+#define SUSPEND()           \
+    do {                    \
+        m_suspended = true; \
+        return Value {};    \
+    } while (0)
+
+// Charges the budget at a loop back edge or a call. If the slice is over,
+// the instruction is executed again when the script is continued.
+#define CHARGE_BUDGET()                                                             \
+    do {                                                                            \
+        if (!budget.tick()) {                                                       \
+            if (budget.status() != BudgetStatus::SliceEnded)                        \
+                FAIL(budget.error(location()));                                     \
+            if (can_suspend()) {                                                    \
+                --frame->ip;                                                        \
+                SUSPEND();                                                          \
+            }                                                                       \
+            budget.continue_slice();                                                \
+        }                                                                           \
+    } while (0)
+
+#define BINARY_OPERATION(method)                                                    \
+    {                                                                               \
+        auto rhs = std::move(m_stack.back());                                       \
+        m_stack.pop_back();                                                         \
+        auto& lhs = m_stack.back();                                                 \
+        auto res = lhs.method(rhs);                                                 \
+        if (res.is_error())                                                         \
+            FAIL((SyntaxError { location(), *res.to_error() }));                    \
+        lhs = std::move(res);                                                       \
+        break;                                                                      \
+    }
+
+#define COMPARISON(op)                                                              \
+    {                                                                               \
+        auto rhs = std::move(m_stack.back());                                       \
+        m_stack.pop_back();                                                         \
+        auto& lhs = m_stack.back();                                                 \
+        lhs = Value(lhs op rhs);                                                    \
+        break;                                                                      \
+    }
+
+// A quickened instruction handles the operand types it was specialized for
+// and turns back into the generic instruction, which is then executed
+// instead, when it gets anything else, or when the result overflows.
+#define QUICK_OPERATION(method, generic)                                            \
+    {                                                                               \
+        if (m_stack[m_stack.size() - 2].method(m_stack.back())) {                   \
+            m_stack.pop_back();                                                     \
+            break;                                                                  \
+        }                                                                           \
+        frame->function->quicken(--frame->ip, OpCode::generic);                     \
+        break;                                                                      \
+    }
+
+#define QUICK_COMPARISON(op, generic)                                               \
+    {                                                                               \
+        auto const& rhs = m_stack.back();                                           \
+        auto& lhs = m_stack[m_stack.size() - 2];                                    \
+        if (!lhs.is_signed_int() || !rhs.is_signed_int()) {                         \
+            frame->function->quicken(--frame->ip, OpCode::generic);                 \
+            break;                                                                  \
+        }                                                                           \
+        auto res = lhs.int64() op rhs.int64();                                      \
+        m_stack.pop_back();                                                         \
+        m_stack.back() = Value(res);                                                \
+        break;                                                                      \
+    }
+
+// Runs until the frame at the given depth returns. A runtime error in a
+// function called from that frame makes the call evaluate to an
+// ExecutionError value, like a failing function does in the tree
+// interpreter. An error in the frame itself is returned. When the script is
+// put aside, run() returns early and sets m_suspended.
+ErrorOr<Value, SyntaxError> VirtualMachine::run(size_t depth)
+{
+    auto& globals = m_context.globals();
+    auto& budget = m_context.budget();
+    auto* frame = &m_frames.back();
+    auto const* code = frame->function->code().data();
+    auto location = [&frame]() -> Span const& {
+        return frame->function->location(frame->ip - 1);
+    };
+    auto quicken_if = [this, &frame](bool condition, OpCode op) {
+        if (m_quickening && condition)
+            frame->function->quicken(frame->ip - 1, op);
+    };
+    auto operands_are_ints = [this]() {
+        return m_stack.back().is_signed_int() && m_stack[m_stack.size() - 2].is_signed_int();
+    };
+    auto operands_are_strings = [this]() {
+        return m_stack.back().is_string() && m_stack[m_stack.size() - 2].is_string();
+    };
+
+    while (true) {
+        auto const& instruction = code[frame->ip++];
+        switch (instruction.op) {
+        case OpCode::PushConstant:
+            m_stack.push_back(frame->function->constants()[instruction.b]);
+            break;
+        case OpCode::PushNull:
+            m_stack.emplace_back();
+            break;
+        case OpCode::Pop:
+            m_stack.pop_back();
+            break;
+        case OpCode::PopN:
+            m_stack.resize(m_stack.size() - instruction.a);
+            break;
+        case OpCode::Slide: {
+            auto top = std::move(m_stack.back());
+            m_stack.resize(m_stack.size() - instruction.a);
+            m_stack.back() = std::move(top);
+            break;
+        }
+        case OpCode::LoadLocal:
+            m_stack.push_back(m_stack[frame->base + instruction.a]);
+            break;
+        case OpCode::StoreLocal:
+            m_stack[frame->base + instruction.a] = m_stack.back();
+            break;
+        case OpCode::LoadGlobal:
+            if (auto* local = caller_local(instruction.b); local != nullptr) {
+                // The local is on the stack, which may move when it grows:
+                Value value = *local;
+                m_stack.push_back(std::move(value));
+            } else if (globals.is_defined(instruction.b)) {
+                m_stack.push_back(globals.get(instruction.b));
+            } else {
+                m_stack.emplace_back(ErrorCode::UndeclaredVariable);
+            }
+            break;
+        case OpCode::StoreGlobal:
+            if (auto* local = caller_local(instruction.b); local != nullptr)
+                *local = m_stack.back();
+            else
+                globals.set(instruction.b, m_stack.back());
+            break;
+        case OpCode::DefineGlobal:
+            if (globals.define(instruction.b, m_stack.back()).is_error())
+                FAIL((SyntaxError { location(), ErrorCode::VariableAlreadyDeclared, globals.name(instruction.b) }));
+            break;
+        case OpCode::Add:
+            quicken_if(operands_are_ints(), OpCode::AddInt);
+            quicken_if(operands_are_strings(), OpCode::AddText);
+            BINARY_OPERATION(add)
+        case OpCode::Subtract:
+            quicken_if(operands_are_ints(), OpCode::SubtractInt);
+            BINARY_OPERATION(subtract)
+        case OpCode::Multiply:
+            quicken_if(operands_are_ints(), OpCode::MultiplyInt);
+            BINARY_OPERATION(multiply)
+        case OpCode::Divide:
+            BINARY_OPERATION(divide)
+        case OpCode::Modulo:
+            quicken_if(operands_are_ints(), OpCode::ModuloInt);
+            BINARY_OPERATION(modulo)
+        case OpCode::EqualsTo:
+            quicken_if(operands_are_ints(), OpCode::EqualsToInt);
+            COMPARISON(==)
+        case OpCode::NotEqualTo:
+            quicken_if(operands_are_ints(), OpCode::NotEqualToInt);
+            COMPARISON(!=)
+        case OpCode::GreaterThan:
+            quicken_if(operands_are_ints(), OpCode::GreaterThanInt);
+            COMPARISON(>)
+        case OpCode::GreaterEqualThan:
+            quicken_if(operands_are_ints(), OpCode::GreaterEqualThanInt);
+            COMPARISON(>=)
+        case OpCode::LessThan:
+            quicken_if(operands_are_ints(), OpCode::LessThanInt);
+            COMPARISON(<)
+        case OpCode::LessEqualThan:
+            quicken_if(operands_are_ints(), OpCode::LessEqualThanInt);
+            COMPARISON(<=)
+        case OpCode::Range: {
+            auto const& upper = m_stack.back();
+            auto const& lower = m_stack[m_stack.size() - 2];
+            if (lower.type() != ValueType::Integer || upper.type() != ValueType::Integer)
+                FAIL((SyntaxError { location(), ErrorCode::TypeMismatch }));
+            break;
+        }
+        case OpCode::Jump:
+            // Jumping back closes a loop:
+            if (instruction.b < frame->ip)
+                CHARGE_BUDGET();
+            frame->ip = instruction.b;
+            break;
+        case OpCode::JumpIfFalse: {
+            auto condition = m_stack.back().to_bool();
+            m_stack.pop_back();
+            if (!condition.has_value())
+                FAIL((SyntaxError { location(), ErrorCode::TypeMismatch }));
+            if (!*condition)
+                frame->ip = instruction.b;
+            break;
+        }
+        case OpCode::ForIter: {
+            auto slot = frame->base + instruction.a;
+            auto current = *m_stack[slot].to_int<int64_t>();
+            if (current >= *m_stack[slot + 1].to_int<int64_t>()) {
+                frame->ip = instruction.b;
+                break;
+            }
+            m_stack[slot + 2] = Value(current);
+            m_stack[slot] = Value(current + 1);
+            break;
+        }
+        case OpCode::Switch: {
+            auto const& jumps = frame->function->switch_tables()[instruction.b];
+            auto ix = jumps.table.find(m_stack.back());
+            frame->ip = ix.has_value() ? jumps.targets[*ix] : jumps.default_target;
+            break;
+        }
+        case OpCode::Call: {
+            CHARGE_BUDGET();
+            auto argc = instruction.a;
+            auto callee_slot = m_stack.size() - argc - 1;
+            for (auto ix = callee_slot + 1; ix < m_stack.size(); ++ix) {
+                if (m_stack[ix].is_error())
+                    FAIL((SyntaxError { location(), *m_stack[ix].to_error() }));
+            }
+            auto const& callee = m_stack[callee_slot];
+            if (callee.is_error())
+                FAIL((SyntaxError { location(), *callee.to_error(), frame->function->callee(frame->ip - 1) }));
+            if (!callee.is_function())
+                FAIL((SyntaxError { location(), ErrorCode::FunctionUndefined, frame->function->callee(frame->ip - 1) }));
+            auto function = *callee.to_function();
+            if (auto const* compiled = dynamic_cast<BytecodeFunction const*>(function.get()); compiled != nullptr) {
+                if (argc < compiled->arity()) {
+                    m_stack.resize(callee_slot);
+                    m_stack.emplace_back();
+                    break;
+                }
+                if (m_frames.size() >= SCRATCH_VM_MAX_FRAMES)
+                    FAIL((SyntaxError { location(), ErrorCode::ExecutionError, "Call stack exhausted" }));
+                m_stack.resize(callee_slot + 1 + compiled->arity());
+                m_frames.push_back({ compiled, 0, callee_slot + 1 });
+                frame = &m_frames.back();
+                code = compiled->code().data();
+                break;
+            }
+            Values args(std::make_move_iterator(m_stack.begin() + static_cast<long>(callee_slot) + 1), std::make_move_iterator(m_stack.end()));
+            m_stack.resize(callee_slot);
+            m_stack.push_back(function->execute(args, m_context));
+            // A builtin calling back into the script pushes frames, which
+            // may move them:
+            frame = &m_frames.back();
+            code = frame->function->code().data();
+            break;
+        }
+        case OpCode::Yield: {
+            auto const& delay = m_stack.back();
+            if (!delay.is_null() && delay.type() != ValueType::Integer)
+                FAIL((SyntaxError { location(), ErrorCode::TypeMismatch }));
+            auto millis = delay.is_null() ? 0 : *delay.to_int<int64_t>();
+            m_stack.back() = Value {};
+            if (can_suspend()) {
+                m_resume_at = std::chrono::steady_clock::now() + std::chrono::milliseconds { millis };
+                SUSPEND();
+            }
+            if (millis > 0 && !budget.sleep(std::chrono::milliseconds { millis }))
+                FAIL(budget.error(location()));
+            break;
+        }
+        case OpCode::Return: {
+            auto result = std::move(m_stack.back());
+            m_stack.resize(frame->base - 1);
+            m_frames.pop_back();
+            if (m_frames.size() == depth)
+                return result;
+            m_stack.push_back(std::move(result));
+            frame = &m_frames.back();
+            code = frame->function->code().data();
+            break;
+        }
+        case OpCode::AddInt:
+            QUICK_OPERATION(add_int, Add)
+        case OpCode::SubtractInt:
+            QUICK_OPERATION(subtract_int, Subtract)
+        case OpCode::MultiplyInt:
+            QUICK_OPERATION(multiply_int, Multiply)
+        case OpCode::ModuloInt:
+            QUICK_OPERATION(modulo_int, Modulo)
+        case OpCode::AddText:
+            QUICK_OPERATION(append, Add)
+        case OpCode::EqualsToInt:
+            QUICK_COMPARISON(==, EqualsTo)
+        case OpCode::NotEqualToInt:
+            QUICK_COMPARISON(!=, NotEqualTo)
+        case OpCode::GreaterThanInt:
+            QUICK_COMPARISON(>, GreaterThan)
+        case OpCode::GreaterEqualThanInt:
+            QUICK_COMPARISON(>=, GreaterEqualThan)
+        case OpCode::LessThanInt:
+            QUICK_COMPARISON(<, LessThan)
+        case OpCode::LessEqualThanInt:
+            QUICK_COMPARISON(<=, LessEqualThan)
+        }
+    next:;
+    }
+}
+
+}
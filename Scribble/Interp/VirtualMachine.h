@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <Scribble/Interp/Bytecode.h>
+#include <Scribble/Interp/Interpreter.h>
+
+#ifndef SCRATCH_VM_MAX_FRAMES
+#define SCRATCH_VM_MAX_FRAMES 1024
+#endif /* SCRATCH_VM_MAX_FRAMES */
+
+namespace Scratch::Interp {
+
+// Whether machines created from now on rewrite arithmetic and comparison
+// instructions into forms specialized for the operand types they see.
+// Switching it off is only useful for measuring what it buys.
+[[nodiscard]] bool vm_quickening();
+void set_vm_quickening(bool);
+
+// Runs Scribble compiled to bytecode. The globals live as long as the
+// machine does, so a machine can execute one project after another and
+// keep the variables and functions defined by the earlier ones, like the
+// Console does.
+//
+// A project can also be run a slice at a time. The machine then puts the
+// script aside when the slice is over, or when it yields, and continues
+// where it left off on the next call. The state of the script is all in
+// the stack and the frames, so that doesn't need anything from the host
+// but calling again. A script can only be put aside when no native code,
+// like a builtin calling back into the script, is running; until that
+// returns the script carries on.
+class VirtualMachine {
+public:
+    explicit VirtualMachine(Builtins const& = builtins());
+
+    [[nodiscard]] ProcessResult execute(std::shared_ptr<Project> const&);
+
+    // Runs the project for about the given time. The first call starts it,
+    // following calls continue it. Returns nothing until the script is
+    // done.
+    [[nodiscard]] std::optional<ProcessResult> run_slice(std::shared_ptr<Project> const&, std::chrono::milliseconds);
+    [[nodiscard]] Value call(BytecodeFunction const&, Values const&);
+    ErrorOr<void, SyntaxError> define(std::string const&, Value);
+    [[nodiscard]] Globals& globals() { return m_context.globals(); }
+
+private:
+    struct Frame {
+        BytecodeFunction const* function;
+        size_t ip;
+        size_t base;
+    };
+
+    // The project being executed, and how far along it is.
+    struct Execution {
+        std::shared_ptr<Project> project;
+        size_t depth;
+        size_t module { 0 };
+        bool in_module { false };
+        Value value {};
+    };
+
+    void begin(std::shared_ptr<Project> const&, bool sliced);
+    [[nodiscard]] std::optional<ProcessResult> proceed();
+    ErrorOr<Value, SyntaxError> run(size_t);
+    [[nodiscard]] bool can_suspend() const { return m_sliced && m_native_calls == 0; }
+    [[nodiscard]] Value* caller_local(uint32_t name)
+    {
+        if (m_frames.size() < 2 || !globals().is_shadowed(name))
+            return nullptr;
+        return find_caller_local(name);
+    }
+    [[nodiscard]] Value* find_caller_local(uint32_t);
+
+    Values m_stack {};
+    std::vector<Frame> m_frames {};
+    InterpreterContext m_context {};
+    bool m_quickening { true };
+    std::optional<Execution> m_execution {};
+    bool m_sliced { false };
+    bool m_suspended { false };
+    int m_native_calls { 0 };
+    std::chrono::steady_clock::time_point m_resume_at {};
+};
+
+}
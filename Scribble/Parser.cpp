@@ -65,46 +65,26 @@ std::shared_ptr<Module> Parser::parse(bool keep_tokens)
     return std::make_shared<Module>(statements, m_current_module, m_lexer.buffer());
 }
 
+// Functions can only be defined at the top level. Anything else is parsed
+// like it is in a block; the resolver rejects a break or continue that
+// isn't in a loop.
 std::shared_ptr<Statement> Parser::parse_top_level_statement()
 {
-    debug(scribble, "Parser::parse_top_level_statement");
+    lazy_debug(scribble, "Parser::parse_top_level_statement");
     auto token = skip(TokenCode::Whitespace);
-    std::shared_ptr<Statement> ret;
     switch (token.code()) {
-    case TokenCode::SemiColon:
-        return std::make_shared<Pass>(lex().location());
-    case TokenCode::OpenBrace: {
-        lex();
-        Statements statements;
-        return parse_block(statements);
-    }
-    case Scribble::KeywordImport:
-        return parse_import_statement(lex());
-    case Scribble::KeywordVar:
-    case Scribble::KeywordConst:
-        return parse_variable_declaration(lex(), token.code() == Scribble::KeywordConst);
     case Scribble::KeywordCmd:
     case Scribble::KeywordFunc:
     case Scribble::KeywordIntrinsic:
         return parse_function_definition(lex());
-    case TokenCode::Identifier: {
-        break;
-    }
-    case TokenCode::CloseBrace:
-    case TokenCode::EndOfFile:
-        return nullptr;
     default:
-        break;
+        return parse_statement();
     }
-    auto expr = parse_expression();
-    if (!expr)
-        return nullptr;
-    return std::make_shared<ExpressionStatement>(expr);
 }
 
 std::shared_ptr<Statement> Parser::parse_statement()
 {
-    debug(scribble, "Parser::parse_statement");
+    lazy_debug(scribble, "Parser::parse_statement");
     auto token = skip(TokenCode::Whitespace);
     std::shared_ptr<Statement> ret;
     switch (token.code()) {
@@ -135,6 +115,10 @@ std::shared_ptr<Statement> Parser::parse_statement()
             return std::make_shared<Return>(token.location(), nullptr);;
         return std::make_shared<Return>(token.location(), expr);
     }
+    case Scribble::KeywordYield: {
+        m_lexer.lex();
+        return std::make_shared<Yield>(token.location(), parse_expression());
+    }
     case Scribble::KeywordBreak:
         return std::make_shared<Break>(lex().location());
     case Scribble::KeywordContinue:
@@ -12,6 +12,7 @@
 #include <unordered_map>
 
 #include <core/Error.h>
+#include <Common/Logging.h>
 #include <Scribble/Context.h>
 #include <Scribble/Syntax/ControlFlow.h>
 #include <Scribble/Syntax/Expression.h>
@@ -237,6 +238,13 @@ ErrorOrNode process_tree(std::shared_ptr<SyntaxNode> const& tree, Context& ctx,
         break;
     }
 
+    case SyntaxNodeType::Yield: {
+        auto yield_stmt = std::dynamic_pointer_cast<Yield>(tree);
+        auto expr = TRY_AND_CAST(Expression, yield_stmt->expression(), ctx);
+        ret = std::make_shared<Yield>(yield_stmt->location(), expr);
+        break;
+    }
+
     case SyntaxNodeType::Branch: {
         auto branch = std::dynamic_pointer_cast<Branch>(tree);
         std::shared_ptr<Expression> condition { nullptr };
@@ -376,9 +384,12 @@ ProcessResult& process(std::shared_ptr<SyntaxNode> const& tree, Ctx& ctx, Proces
         return ss.str();
     };
 
-    std::string log_message  = format("{} => ", node_to_string(tree));
+    // node_to_string() renders the whole subtree, so only do it if it's
+    // going to be logged:
+    auto const logging = debug_enabled(scribble);
     ErrorOrNode processed = tree;
-    debug(scribble, "Process {}", node_to_string(tree));
+    if (logging)
+        debug(scribble, "Process {}", node_to_string(tree));
     switch (tree->node_type()) {
 #undef ENUM_SYNTAXNODETYPE
 #define ENUM_SYNTAXNODETYPE(type)                                               \
@@ -391,14 +402,15 @@ ProcessResult& process(std::shared_ptr<SyntaxNode> const& tree, Ctx& ctx, Proces
         fatal("Unknown SyntaxNodeType '{}'", tree->node_type());
     }
     if (processed.is_error()) {
-        log_message += format("Error {}", processed.error());
+        if (logging)
+            debug(scribble, "{} => Error {}", node_to_string(tree), processed.error());
         result.error(processed.error());
         result = tree;
     } else {
         result = processed.value();
-        log_message += node_to_string(result.value());
+        if (logging)
+            debug(scribble, "{} => {}", node_to_string(tree), node_to_string(result.value()));
     }
-    debug(scribble, "{}", log_message);
     return result;
 }
 
@@ -420,7 +432,7 @@ ProcessResult process(std::shared_ptr<SyntaxNode> const& tree, Ctx& ctx)
 template<typename Ctx, SyntaxNodeType node_type>
 ErrorOrNode process_node(std::shared_ptr<SyntaxNode> const& tree, Ctx& ctx, ProcessResult& result)
 {
-    debug(scribble, "Falling back to default processor for type {}", tree->node_type());
+    lazy_debug(scribble, "Falling back to default processor for type {}", tree->node_type());
     return process_tree(tree, ctx, result, [](std::shared_ptr<SyntaxNode> const& tree, Ctx& ctx, ProcessResult& result) {
         return process(tree, ctx, result);
     });
@@ -431,7 +443,7 @@ ErrorOrTypedNode<Cls> try_and_try_cast(pSyntaxNode const& expr, Ctx& ctx, Proces
 {
     process(expr, ctx, result);
     if (result.is_error()) {
-        debug(scribble, "Processing node results in error '{}' instead of node of type '{}'", result.error(), typeid(Cls).name());
+        lazy_debug(scribble, "Processing node results in error '{}' instead of node of type '{}'", result.error(), typeid(Cls).name());
         return result.error();
     }
     if (result.value() == nullptr)
@@ -444,7 +456,7 @@ ErrorOrTypedNode<Cls> try_and_cast(pSyntaxNode const& expr, Ctx& ctx, ProcessRes
 {
     process(expr, ctx, result);
     if (result.is_error()) {
-        debug(scribble, "Processing node results in error '{}' instead of node of type '{}'", result.error(), typeid(Cls).name());
+        lazy_debug(scribble, "Processing node results in error '{}' instead of node of type '{}'", result.error(), typeid(Cls).name());
         return result.error();
     }
     if (result.value() == nullptr)
@@ -8,6 +8,7 @@
 #include <App/Scratch.h>
 #include <Scribble/Interp/ExpressionResult.h>
 #include <Scribble/Interp/Interpreter.h>
+#include <Scribble/Interp/VirtualMachine.h>
 #include <Scribble/Scribble.h>
 #include <Scribble/Parser.h>
 #include <Scribble/Syntax/Statement.h>
@@ -30,17 +31,73 @@ ScribbleCommands::ScribbleCommands()
                     doc->insert("\n// " + project_maybe.error().to_string());
                     return;
                 }
-                auto result = interpret(std::dynamic_pointer_cast<Project>(project_maybe.value()));
-                if (result.is_error()) {
-                    doc->bottom(false);
-                    doc->insert("\n// " + result.error().to_string());
-                    return;
+                auto project = std::dynamic_pointer_cast<Project>(project_maybe.value());
+                ScriptRunner::Step step { nullptr };
+                if (scribble_engine() == ScribbleEngine::Bytecode) {
+                    step = [vm = std::make_shared<VirtualMachine>(), project](std::chrono::milliseconds slice) -> std::optional<ProcessResult> {
+                        return vm->run_slice(project, slice);
+                    };
                 }
-                auto r = std::dynamic_pointer_cast<Interp::ExpressionResult>(result.value());
-                doc->bottom(false);
-                doc->insert("\n// " + r->value().to_string());
+                auto started = Scratch::script_runner().start(
+                    [project, engine = scribble_engine(), builtins = Interp::builtins()]() -> ProcessResult {
+                        return interpret(project, engine, builtins);
+                    },
+                    [doc](ProcessResult const& result) -> void {
+                        doc->bottom(false);
+                        if (result.is_error()) {
+                            doc->insert("\n// " + result.error().to_string());
+                            return;
+                        }
+                        auto r = std::dynamic_pointer_cast<Interp::ExpressionResult>(result.value());
+                        doc->insert("\n// " + r->value().to_string());
+                    },
+                    step);
+                if (!started)
+                    log_error("Can't evaluate buffer: a script is running already");
             } },
         { SDLK_e, KMOD_CTRL });
+
+    register_command({ "set-scribble-engine", "Select the engine running scripts: tree, bytecode, or validate",
+        {
+            { "Engine", CommandParameterType::String }
+        },
+        [](Widget&, strings const& args) -> void {
+            auto engine = ScribbleEngine_by_name(args[0]);
+            if (!engine.has_value()) {
+                log_error("Unknown Scribble engine '{}'", args[0]);
+                return;
+            }
+            set_scribble_engine(*engine);
+        }
+    });
+
+    register_command({ "set-scribble-mode", "Select how scripts run: blocking, worker, or sliced",
+        {
+            { "Mode", CommandParameterType::String }
+        },
+        [](Widget&, strings const& args) -> void {
+            auto mode = ScriptMode_by_name(args[0]);
+            if (!mode.has_value()) {
+                log_error("Unknown Scribble mode '{}'", args[0]);
+                return;
+            }
+            Scratch::script_runner().mode(*mode);
+        }
+    });
+
+    register_command({ "set-scribble-time-limit", "Set the number of milliseconds a script on the event loop can run before it is interrupted. 0 means no limit",
+        {
+            { "Milliseconds", CommandParameterType::Integer }
+        },
+        [](Widget&, strings const& args) -> void {
+            auto millis = try_to_long<std::string>()(args[0]);
+            if (!millis.has_value() || *millis < 0) {
+                log_error("Invalid Scribble time limit '{}'", args[0]);
+                return;
+            }
+            ExecutionBudget::set_limits(SCRATCH_SCRIPT_MAX_TICKS, std::chrono::milliseconds { *millis });
+        }
+    });
 }
 
 ScribbleCommands Scribble::s_scribble_commands;
@@ -81,6 +138,7 @@ Scribble::Scribble(bool ignore_ws)
         KeywordSwitch, "switch",
         KeywordVar, "var",
         KeywordWhile, "while",
+        KeywordYield, "yield",
 
         KeywordTrue, "true",
         KeywordFalse, "false");
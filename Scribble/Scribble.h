@@ -46,6 +46,7 @@ public:
     constexpr static TokenCode KeywordSwitch = TokenCode::Keyword19;
     constexpr static TokenCode KeywordVar = TokenCode::Keyword20;
     constexpr static TokenCode KeywordWhile = TokenCode::Keyword21;
+    constexpr static TokenCode KeywordYield = TokenCode::Keyword22;
 
     constexpr static TokenCode KeywordTrue = TokenCode::Keyword31;
     constexpr static TokenCode KeywordFalse = TokenCode::Keyword32;
@@ -370,4 +370,36 @@ bool Return::is_complete() const
     return (m_expression == nullptr) || m_expression->is_complete();
 }
 
+// -- Yield -----------------------------------------------------------------
+
+Yield::Yield(Span location, std::shared_ptr<Expression> expression)
+    : Statement(location)
+    , m_expression(std::move(expression))
+{
+}
+
+Nodes Yield::children() const
+{
+    if (m_expression)
+        return { m_expression };
+    return {};
+}
+
+std::string Yield::to_string() const
+{
+    if (m_expression)
+        return format("yield {}", m_expression->to_string());
+    return "yield";
+}
+
+std::shared_ptr<Expression> const& Yield::expression() const
+{
+    return m_expression;
+}
+
+bool Yield::is_complete() const
+{
+    return (m_expression == nullptr) || m_expression->is_complete();
+}
+
 }
@@ -154,4 +154,19 @@ private:
     bool m_return_error;
 };
 
+// Waits for the number of milliseconds the expression evaluates to, if
+// there is one. A script running in slices hands control back to the
+// editor and continues on a later frame; anywhere else the script sleeps.
+NODE_CLASS(Yield, Statement)
+public:
+    Yield(Span, std::shared_ptr<Expression>);
+    [[nodiscard]] Nodes children() const override;
+    [[nodiscard]] std::string to_string() const override;
+    [[nodiscard]] std::shared_ptr<Expression> const& expression() const;
+    [[nodiscard]] bool is_complete() const override;
+
+private:
+    std::shared_ptr<Expression> m_expression;
+};
+
 }
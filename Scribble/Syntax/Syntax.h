@@ -11,10 +11,10 @@
 #include <string>
 #include <vector>
 
-#include <core/Logging.h>
 #include <lexer/Token.h>
 
 #include <Scribble/Syntax/SyntaxNodeType.h>
+#include <Common/Logging.h>
 
 namespace Scratch::Scribble {
 
@@ -123,7 +123,7 @@ template<class T, class... Args>
 std::shared_ptr<T> make_node(Args&&... args)
 {
     auto ret = std::make_shared<T>(std::forward<Args>(args)...);
-    debug(scribble, "{}: {}", SyntaxNodeType_name(ret->node_type()), ret->to_string());
+    lazy_debug(scribble, "{}: {}", SyntaxNodeType_name(ret->node_type()), ret->to_string());
     return ret;
 }
 
@@ -61,6 +61,7 @@ namespace Scratch::Scribble {
     S(Return)                           \
     S(Break)                            \
     S(Continue)                         \
+    S(Yield)                            \
     S(Branch)                           \
     S(IfStatement)                      \
     S(WhileStatement)                   \
@@ -70,6 +71,10 @@ namespace Scratch::Scribble {
     S(SwitchStatement)                  \
     S(ExpressionResult)                 \
     S(ExpressionResultList)             \
+    S(ResolvedVariable)                 \
+    S(ResolvedCall)                     \
+    S(Constant)                         \
+    S(TableSwitch)                      \
     S(StatementExecutionResult)
 
 enum class SyntaxNodeType {
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <Scribble/Interp/Interpreter.h>
+#include <Scribble/Interp/VirtualMachine.h>
+#include <Scribble/Parser.h>
+
+using namespace Obelix;
+using namespace Scratch;
+using namespace Scratch::Interp;
+
+// Runs every script in a directory with the tree interpreter and on the
+// virtual machine, both in one go and a slice at a time, and checks that
+// all return what the first line of the script says they should:
+//
+//   // expect: 42
+//
+// 'error' means the script must fail, with the same error on both engines.
+// The builtins running editor commands are stubs, so the scripts don't
+// need the application. It also checks that a script cancelled while it
+// waits for the delay of a yield stops. Usage:
+//
+//   scratch_scribble_tests <directory>
+static std::string expected_result(std::filesystem::path const& path)
+{
+    static std::string const prefix = "// expect:";
+    std::ifstream stream(path);
+    std::string line;
+    if (!std::getline(stream, line) || !line.starts_with(prefix))
+        return {};
+    auto expected = line.substr(prefix.length());
+    expected.erase(0, expected.find_first_not_of(" \t"));
+    expected.erase(expected.find_last_not_of(" \t\r") + 1);
+    return expected;
+}
+
+// Runs the project on a virtual machine a slice at a time, like the editor
+// runs a script on the event loop, until it's done.
+static ProcessResult run_sliced(std::shared_ptr<Project> const& project)
+{
+    VirtualMachine vm(stub_builtins());
+    while (true) {
+        if (auto result = vm.run_slice(project, std::chrono::milliseconds { 1 }); result.has_value())
+            return *result;
+    }
+}
+
+static bool run_script(std::filesystem::path const& path)
+{
+    auto expected = expected_result(path);
+    if (expected.empty()) {
+        fprintf(stderr, "%s: no '// expect:' line\n", path.c_str());
+        return false;
+    }
+    auto project_maybe = ::Scratch::Scribble::compile_project(path.string());
+    if (project_maybe.is_error()) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), project_maybe.error().to_string().c_str());
+        return false;
+    }
+    auto project = std::dynamic_pointer_cast<Project>(project_maybe.value());
+    auto tree = interpret(project, ScribbleEngine::Tree, stub_builtins());
+    auto bytecode = interpret(project, ScribbleEngine::Bytecode, stub_builtins());
+    auto sliced = run_sliced(project);
+    auto ok = same_result(tree, bytecode) && same_result(bytecode, sliced);
+    if (ok)
+        ok = (expected == "error") ? tree.is_error() : (!tree.is_error() && result_to_string(tree) == expected);
+    if (!ok) {
+        fprintf(stderr, "%s: expected '%s', tree returned '%s', bytecode returned '%s', sliced returned '%s'\n",
+            path.c_str(), expected.c_str(), result_to_string(tree).c_str(), result_to_string(bytecode).c_str(),
+            result_to_string(sliced).c_str());
+    }
+    return ok;
+}
+
+static char const* yield_loop_script = R"(
+var n = 0
+while (n >= 0) {
+    n = n + 1
+    yield 1000
+}
+n
+)";
+
+// Cancels a script put aside by a yield. The next slice must end it,
+// instead of carrying on with the loop without the delay.
+static bool cancel_yield_loop()
+{
+    auto project_maybe = ::Scratch::Scribble::compile_project("yield_loop", std::make_shared<StringBuffer>(std::string(yield_loop_script)));
+    if (project_maybe.is_error()) {
+        fprintf(stderr, "yield_loop: %s\n", project_maybe.error().to_string().c_str());
+        return false;
+    }
+    auto project = std::dynamic_pointer_cast<Project>(project_maybe.value());
+    VirtualMachine vm(stub_builtins());
+    if (vm.run_slice(project, std::chrono::milliseconds { 10 }).has_value()) {
+        fprintf(stderr, "yield_loop: finished without being put aside\n");
+        return false;
+    }
+    ExecutionBudget::cancel();
+    auto result = vm.run_slice(project, std::chrono::milliseconds { 10 });
+    if (!result.has_value() || !result->is_error()) {
+        fprintf(stderr, "yield_loop: still running after being cancelled\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char const** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    std::vector<std::filesystem::path> scripts;
+    for (auto const& entry : std::filesystem::directory_iterator(argv[1])) {
+        if (entry.path().extension() == ".scratch")
+            scripts.push_back(entry.path());
+    }
+    if (scripts.empty()) {
+        fprintf(stderr, "No scripts in %s\n", argv[1]);
+        return 1;
+    }
+    std::sort(scripts.begin(), scripts.end());
+
+    auto failures = 0;
+    for (auto const& script : scripts) {
+        auto ok = run_script(script);
+        printf("%s %s\n", (ok) ? "ok  " : "FAIL", script.filename().c_str());
+        if (!ok)
+            ++failures;
+    }
+    auto cancelled = cancel_yield_loop();
+    printf("%s (cancel yield loop)\n", (cancelled) ? "ok  " : "FAIL");
+    if (!cancelled)
+        ++failures;
+    printf("%zu scripts, %d failed\n", scripts.size(), failures);
+    return (failures > 0) ? 1 : 0;
+}
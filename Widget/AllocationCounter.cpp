@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+// Replaces the global operator new and delete with versions that count
+// allocations in heap_allocation_count. This is not part of scratch_core:
+// it's linked into the benchmarks, and into the editor only when it's built
+// with the SCRATCH_COUNT_ALLOCATIONS option.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <Widget/FrameArena.h>
+
+namespace {
+
+void* counted_allocate(size_t size, size_t alignment = 0)
+{
+    Scratch::heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    while (true) {
+        void* ptr;
+        if (alignment > alignof(std::max_align_t))
+            ptr = std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+        else
+            ptr = std::malloc(size);
+        if (ptr != nullptr)
+            return ptr;
+        auto handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* counted_allocate_nothrow(size_t size, size_t alignment = 0) noexcept
+{
+    try {
+        return counted_allocate(size, alignment);
+    } catch (std::bad_alloc const&) {
+        return nullptr;
+    }
+}
+
+}
+
+void* operator new(size_t size)
+{
+    return counted_allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return counted_allocate(size);
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+    return counted_allocate_nothrow(size);
+}
+
+void* operator new[](size_t size, std::nothrow_t const&) noexcept
+{
+    return counted_allocate_nothrow(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return counted_allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return counted_allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    return counted_allocate_nothrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    return counted_allocate_nothrow(size, static_cast<size_t>(alignment));
+}
+
+// Memory from malloc() and aligned_alloc() is released with free(), so
+// every flavour of delete comes down to the same thing:
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    std::free(ptr);
+}
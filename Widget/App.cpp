@@ -33,6 +33,17 @@ App::App(std::string name, SDLContext* ctx)
 {
     oassert(s_app == nullptr, "App is a singleton");
     s_app = this;
+    m_wake_event = SDL_RegisterEvents(1);
+}
+
+// Widgets hold textures, which have to go before the renderer they were
+// created with. The SDL context is a member of App, so it would otherwise
+// be torn down before the widgets in the Layout base class.
+App::~App()
+{
+    m_focus = nullptr;
+    m_modals.clear();
+    container().clear();
 }
 
 void App::add_modal(Widget* widget)
@@ -97,11 +108,17 @@ void App::set_font(std::string const& name)
 void App::render()
 {
     m_frameCount++;
-
-    SDL_SetRenderDrawColor(renderer(), 0x2e, 0x32, 0x38, 0xff);
-    SDL_RenderClear(renderer());
-    for (auto const& c : components()) {
-        c->render();
+    m_frame_arena.reset();
+
+    {
+        ProfileScope scope(m_profiler, ProfilePhase::Render);
+        SDL_SetRenderDrawColor(renderer(), 0x2e, 0x32, 0x38, 0xff);
+        SDL_RenderClear(renderer());
+        for (auto const& c : components()) {
+            m_profiler.render(c);
+        }
+        if (m_profiler_visible)
+            m_profiler_overlay.render();
     }
     if (m_modals.empty()) {
         if (!m_pending_commands.empty()) {
@@ -114,7 +131,14 @@ void App::render()
             m->render();
         }
     }
-    SDL_RenderPresent(renderer());
+    {
+        ProfileScope scope(m_profiler, ProfilePhase::Present);
+        SDL_RenderPresent(renderer());
+    }
+    if (m_input_timestamp != 0) {
+        m_input_latency = SDL_GetTicks() - m_input_timestamp;
+        m_input_timestamp = 0;
+    }
 }
 
 void App::resize(Box const& outline)
@@ -123,6 +147,12 @@ void App::resize(Box const& outline)
     Layout::resize(outline);
 }
 
+void App::fit_to_renderer()
+{
+    SDL_GetRendererOutputSize(renderer(), &m_width, &m_height);
+    resize({ 0, 0, m_width, m_height });
+}
+
 int App::fps() const
 {
     if (m_last_render_time.count() < 0.001)
@@ -130,12 +160,61 @@ int App::fps() const
     return (int) (1.0 / m_last_render_time.count());
 }
 
+void App::show_profiler(bool visible)
+{
+    m_profiler_visible = visible;
+    m_profiler.enable(visible);
+}
+
+double App::input_latency() const
+{
+    return m_input_latency;
+}
+
+App::Clock::duration App::frame_interval() const
+{
+    auto rate = SCRATCH_FRAME_RATE;
+    if (m_frame_pacing == FramePacing::Deadline) {
+        if (auto refresh_rate = context()->refresh_rate(); refresh_rate > 0)
+            rate = refresh_rate;
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate));
+}
+
 
 void App::schedule(ScheduledCommand cmd)
 {
     m_pending_commands.push_back(cmd);
 }
 
+// The event wakes up the event loop if it's waiting for input, so the
+// function doesn't have to wait for the next frame.
+void App::post(std::function<void()> func, bool wake)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_posted_mutex);
+        m_posted.push_back(std::move(func));
+    }
+    if (!wake)
+        return;
+    SDL_Event evt {};
+    evt.type = m_wake_event;
+    SDL_PushEvent(&evt);
+}
+
+// Functions posted while these run wait for the next frame, so a function
+// that posts itself again can't keep the loop from rendering.
+void App::run_posted()
+{
+    std::deque<std::function<void()>> posted;
+    {
+        std::lock_guard<std::mutex> lock(m_posted_mutex);
+        posted.swap(m_posted);
+    }
+    for (auto const& func : posted)
+        func();
+}
+
 int App::width() const
 {
     return context()->width();
@@ -192,76 +271,172 @@ SDL_Color App::color(PaletteIndex color)
     return *((SDL_Color*)&c);
 }
 
-void App::event_loop()
+// Keys that produce text are followed by an SDL_TEXTINPUT event. Pending
+// text doesn't have to be delivered before them, so a key repeat burst
+// still ends up as one insert.
+static bool produces_text(SDL_Keysym const& sym)
+{
+    return (sym.mod & (KMOD_CTRL | KMOD_ALT | KMOD_GUI)) == 0 && sym.sym >= SDLK_SPACE && sym.sym < SDLK_DELETE;
+}
+
+// Text input and mouse motion are not delivered when they arrive. All text
+// typed in one poll cycle is delivered as one string, and only the last
+// mouse position is. That happens at the end of the cycle, or before an
+// event that has to see them first.
+void App::flush_input()
+{
+    if (m_text_input_pending) {
+        m_text_input_pending = false;
+        if (auto m = modal(); m != nullptr) {
+            m->handle_text_input();
+        } else if (auto w = focus(); w != nullptr) {
+            w->handle_text_input();
+        }
+    }
+    if (m_pending_motion.has_value()) {
+        auto motion = *m_pending_motion;
+        m_pending_motion.reset();
+        handle_motion(motion);
+    }
+}
+
+bool App::handle_event(SDL_Event const& evt)
+{
+    ProfileScope scope(m_profiler, ProfilePhase::Events);
+    if (evt.type == m_wake_event)
+        return true;
+    switch (evt.type) {
+    case SDL_QUIT: {
+        m_quit = true;
+    } break;
+    case SDL_WINDOWEVENT: {
+        switch (evt.window.event) {
+        case SDL_WINDOWEVENT_SHOWN:
+        case SDL_WINDOWEVENT_RESIZED: {
+            fit_to_renderer();
+        } break;
+        }
+        return true;
+    }
+    case SDL_RENDER_TARGETS_RESET:
+    case SDL_RENDER_DEVICE_RESET: {
+        render_targets_reset();
+        return true;
+    }
+    case SDL_KEYDOWN: {
+        if (!produces_text(evt.key.keysym))
+            flush_input();
+        m_last_key = evt.key.keysym;
+        Widget *target = this;
+        if (auto m = modal(); m != nullptr) {
+            target = m;
+        }
+        target->dispatch(evt.key.keysym);
+    } break;
+    case SDL_TEXTINPUT: {
+        CodePoint wchars[17];
+        strFromUtf8(wchars, countof(wchars), evt.text.text, nullptr);
+        for (auto i = 0u; i < countof(wchars) && wchars[i] != 0; i++)
+            m_input_characters.push_back(wchars[i]);
+        m_text_input_pending = true;
+    } break;
+    case SDL_MOUSEMOTION: {
+        m_mouse = { evt.motion.x, evt.motion.y };
+        if (m_pending_motion.has_value()) {
+            auto xrel = m_pending_motion->xrel + evt.motion.xrel;
+            auto yrel = m_pending_motion->yrel + evt.motion.yrel;
+            m_pending_motion = evt.motion;
+            m_pending_motion->xrel = xrel;
+            m_pending_motion->yrel = yrel;
+        } else {
+            m_pending_motion = evt.motion;
+        }
+    } break;
+    case SDL_MOUSEBUTTONDOWN: {
+        flush_input();
+        handle_mousedown(evt.button);
+    } break;
+    case SDL_MOUSEBUTTONUP: {
+        flush_input();
+        handle_click(evt.button);
+    } break;
+    case SDL_MOUSEWHEEL: {
+        flush_input();
+        handle_wheel(evt.wheel);
+    } break;
+    default:
+        return false;
+    }
+
+    // Remember when the oldest input that is not on screen yet arrived, so
+    // render() can report the input-to-present latency:
+    if (m_input_timestamp == 0)
+        m_input_timestamp = std::max(evt.common.timestamp, 1u);
+    return true;
+}
+
+void App::process_events(Clock::time_point deadline)
 {
     SDL_Event evt;
 
-    auto start_render = std::chrono::steady_clock::now();
     while (!m_quit) {
+        auto now = Clock::now();
+        if (now >= deadline || m_frame_pacing == FramePacing::Fixed) {
+            if (now < deadline)
+                std::this_thread::sleep_for(deadline - now);
+            while (SDL_PollEvent(&evt))
+                handle_event(evt);
+            ProfileScope scope(m_profiler, ProfilePhase::Events);
+            flush_input();
+            return;
+        }
 
-        // Processes events.
-        while (SDL_PollEvent(&evt)) {
-            switch (evt.type) {
-            case SDL_QUIT: {
-                m_quit = true;
-            } break;
-            case SDL_WINDOWEVENT: {
-                switch (evt.window.event) {
-                case SDL_WINDOWEVENT_SHOWN:
-                case SDL_WINDOWEVENT_RESIZED: {
-                    SDL_GetRendererOutputSize(renderer(), &m_width, &m_height);
-                    resize({ 0, 0, m_width, m_height });
-                } break;
-                }
-            } break;
-            case SDL_KEYDOWN: {
-                m_last_key = evt.key.keysym;
-                Widget *target = this;
-                if (auto m = modal(); m != nullptr) {
-                    target = m;
-                }
-                target->dispatch(evt.key.keysym);
-            } break;
-            case SDL_TEXTINPUT: {
-                CodePoint wchars[17];
-                strFromUtf8(wchars, countof(wchars), evt.text.text, nullptr);
-                for (auto i = 0u; i < countof(wchars) && wchars[i] != 0; i++)
-                    m_input_characters.push_back(wchars[i]);
-                if (auto m = modal(); m != nullptr) {
-                    m->handle_text_input();
-                } else if (auto w = focus(); w != nullptr) {
-                    w->handle_text_input();
-                }
-            } break;
-            case SDL_MOUSEMOTION: {
-                m_mouse = { evt.motion.x, evt.motion.y };
-                handle_motion(evt.motion);
-            } break;
-            case SDL_MOUSEBUTTONDOWN: {
-                handle_mousedown(evt.button);
-            } break;
-            case SDL_MOUSEBUTTONUP: {
-                handle_click(evt.button);
-            } break;
-            case SDL_MOUSEWHEEL: {
-                handle_wheel(evt.wheel);
-            } break;
-            default:
-                break;
-            }
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        if (!SDL_WaitEventTimeout(&evt, std::max(static_cast<int>(timeout), 1)))
+            continue;
+        auto had_input = handle_event(evt);
+        while (SDL_PollEvent(&evt))
+            had_input |= handle_event(evt);
+        {
+            ProfileScope scope(m_profiler, ProfilePhase::Events);
+            flush_input();
         }
 
-        render();
+        // The previous frame is done, so there is no reason to let the user
+        // wait for the next slot:
+        if (had_input && m_frame_pacing == FramePacing::Adaptive)
+            return;
+    }
+}
 
-        auto end_render = std::chrono::steady_clock::now();
-        static std::chrono::duration<double> one_frame(1.0/60.0);
-        auto render_time = end_render - start_render;
-        if (one_frame > render_time) {
-            std::this_thread::sleep_for(one_frame - render_time);
+void App::event_loop()
+{
+    // There is no window that will be shown and trigger the initial resize:
+    if (context()->headless())
+        fit_to_renderer();
+    auto start_frame = Clock::now();
+    while (!m_quit) {
+        auto deadline = start_frame + frame_interval();
+        if (m_frame_pacing == FramePacing::Deadline) {
+            // Start rendering just in time to make the next refresh:
+            deadline -= std::chrono::duration_cast<Clock::duration>(m_render_estimate + std::chrono::milliseconds(SCRATCH_DEADLINE_SLACK_MS));
         }
-        end_render = std::chrono::steady_clock::now();
-        m_last_render_time = end_render - start_render;
-        start_render = end_render;
+        m_profiler.begin_frame();
+        process_events(deadline);
+        if (m_quit)
+            break;
+        run_posted();
+
+        auto start_render = Clock::now();
+        render();
+        auto end_render = Clock::now();
+
+        // Exponential moving average, so one slow frame doesn't throw off
+        // the deadline scheduler:
+        m_render_estimate = 0.9 * m_render_estimate + 0.1 * std::chrono::duration<double>(end_render - start_render);
+        m_last_render_time = end_render - start_frame;
+        m_profiler.end_frame(m_last_render_time);
+        start_frame = end_render;
     }
 }
 
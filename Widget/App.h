@@ -6,8 +6,12 @@
 
 #pragma once
 
+#include <chrono>
 #include <deque>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 
@@ -19,7 +23,9 @@
 #include "Commands/Command.h"
 //#include <Scrollbar.h>
 #include "App/Key.h"
+#include "FrameArena.h"
 #include "Geometry.h"
+#include "Profiler.h"
 #include "Widget.h"
 
 #ifndef WIDGET_BORDER_X
@@ -50,6 +56,14 @@
 #define SCRATCH_CASE_FUNC ::tolower
 #endif /* SCRATCH_CASE_FUNC */
 
+#ifndef SCRATCH_FRAME_RATE
+#define SCRATCH_FRAME_RATE 60
+#endif /* SCRATCH_FRAME_RATE */
+
+#ifndef SCRATCH_DEADLINE_SLACK_MS
+#define SCRATCH_DEADLINE_SLACK_MS 2
+#endif /* SCRATCH_DEADLINE_SLACK_MS */
+
 #ifndef countof
 #define countof(A) (sizeof(A) / sizeof(*(A)))
 #endif /* countof */
@@ -64,12 +78,24 @@ static_assert(sizeof(Keycode) == sizeof(SDL_Keycode), "Wrong type size.");
 
 class SDLContext;
 
+// Fixed:    poll events, render, then sleep out the remainder of the frame.
+// Adaptive: wait for events until the next frame is due, but render and
+//           present immediately when input arrives.
+// Deadline: batch input and start rendering as late as possible before the
+//           next vertical refresh, based on the display's refresh rate and a
+//           running estimate of the render time.
+enum class FramePacing {
+    Fixed,
+    Adaptive,
+    Deadline,
+};
+
 class App : public Layout {
 public:
     App(std::string, SDLContext*);
     static App& instance();
 
-    ~App() override = default;
+    ~App() override;
     void quit() { m_quit = true; }
 
     [[nodiscard]] bool is_running() const { return !m_quit; }
@@ -94,9 +120,23 @@ public:
     void render() override;
     bool dispatch(SDL_Keysym) override;
     void resize(Box const&) override;
+    void fit_to_renderer();
     std::string input_buffer();
     void schedule(ScheduledCommand cmd);
+
+    // Queues a function to run on the event loop, between two frames. Can
+    // be called from any thread; this is how other threads get to touch
+    // widgets. Unless it's told to wake the loop, the function waits for
+    // the next frame.
+    void post(std::function<void()>, bool wake = true);
     [[nodiscard]] int fps() const;
+    [[nodiscard]] double input_latency() const;
+    [[nodiscard]] FramePacing frame_pacing() const { return m_frame_pacing; }
+    void frame_pacing(FramePacing pacing) { m_frame_pacing = pacing; }
+    [[nodiscard]] FrameProfiler& profiler() { return m_profiler; }
+    [[nodiscard]] FrameArena& frame_arena() { return m_frame_arena; }
+    [[nodiscard]] bool profiler_visible() const { return m_profiler_visible; }
+    void show_profiler(bool);
 
     void add_modal(Widget*);
     Widget* modal();
@@ -105,7 +145,21 @@ public:
     [[nodiscard]] Widget* focus();
     void focus(Widget*);
 
+protected:
+    // Called when the renderer lost the contents of its target textures, or
+    // the textures themselves. Widgets drawing into textures of their own
+    // must draw them again.
+    virtual void render_targets_reset() { }
+
 private:
+    using Clock = std::chrono::steady_clock;
+
+    [[nodiscard]] Clock::duration frame_interval() const;
+    void process_events(Clock::time_point deadline);
+    bool handle_event(SDL_Event const&);
+    void flush_input();
+    void run_posted();
+
     static App* s_app;
 
     std::string m_name;
@@ -128,9 +182,22 @@ private:
     std::vector<std::unique_ptr<Widget>> m_modals;
     std::unique_ptr<SDLContext> m_context;
     std::deque<ScheduledCommand> m_pending_commands;
+    std::mutex m_posted_mutex;
+    std::deque<std::function<void()>> m_posted;
+    Uint32 m_wake_event { 0 };
     SDLKey m_last_key { SDLK_UNKNOWN, KMOD_NONE };
     Position m_mouse { 0, 0 };
+    bool m_text_input_pending { false };
+    std::optional<SDL_MouseMotionEvent> m_pending_motion {};
     std::chrono::duration<double> m_last_render_time { 0.0 };
+    FramePacing m_frame_pacing { FramePacing::Adaptive };
+    std::chrono::duration<double> m_render_estimate { 0.0 };
+    Uint32 m_input_timestamp { 0 };
+    Uint32 m_input_latency { 0 };
+    FrameProfiler m_profiler {};
+    ProfilerOverlay m_profiler_overlay { m_profiler };
+    bool m_profiler_visible { false };
+    FrameArena m_frame_arena {};
 };
 
 }
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <core/Format.h>
+
+#include "FontManager.h"
+
+using namespace Obelix;
+
+namespace Scratch {
+
+extern_logging_category(scratch);
+
+// -- GlyphAtlas ------------------------------------------------------------
+
+namespace {
+
+// Layout of an atlas cache file: the header, `glyphs` AtlasFileGlyph
+// records, padding to a 16 byte boundary, and `pages` page bitmaps in
+// ARGB8888.
+struct AtlasFileHeader {
+    char magic[8];
+    uint64_t font_hash;
+    uint32_t version;
+    uint32_t cell_size;
+    uint32_t cells;
+    uint32_t pages;
+    uint32_t glyphs;
+    uint32_t next_cell;
+};
+
+struct AtlasFileGlyph {
+    uint32_t codepoint;
+    int32_t page;
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+    int32_t advance;
+};
+
+constexpr char atlas_file_magic[8] = { 'S', 'C', 'R', 'A', 'T', 'L', 'A', 'S' };
+constexpr uint32_t atlas_file_version = 1;
+
+size_t atlas_file_pages_offset(size_t glyphs)
+{
+    return (sizeof(AtlasFileHeader) + glyphs * sizeof(AtlasFileGlyph) + 15) & ~static_cast<size_t>(15);
+}
+
+}
+
+GlyphAtlas::GlyphAtlas(SDL_Renderer* renderer, TTF_Font* font, int cell_size)
+    : m_renderer(renderer)
+    , m_font(font)
+    , m_cell_size(cell_size)
+{
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+    for (auto& page : m_pages)
+        SDL_DestroyTexture(page.texture);
+    unmap();
+}
+
+void GlyphAtlas::unmap()
+{
+    if (m_mapping != nullptr)
+        munmap(m_mapping, m_mapping_size);
+    m_mapping = nullptr;
+    m_mapping_size = 0;
+}
+
+size_t GlyphAtlas::bytes() const
+{
+    auto page_bytes = static_cast<size_t>(page_size()) * static_cast<size_t>(page_size()) * 4;
+    size_t ret = m_pages.size() * page_bytes;
+    for (auto const& page : m_pages)
+        ret += page.pixels.size() * sizeof(uint32_t);
+    return ret;
+}
+
+SDL_Texture* GlyphAtlas::create_page_texture()
+{
+    auto* texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, page_size(), page_size());
+    if (texture == nullptr) {
+        log_error("Could not create glyph atlas page: {}", SDL_GetError());
+        return nullptr;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
+
+bool GlyphAtlas::add_page()
+{
+    auto* texture = create_page_texture();
+    if (texture == nullptr)
+        return false;
+    m_pages.push_back({ texture, nullptr, std::vector<uint32_t>(page_size() * page_size(), 0u) });
+    m_next_cell = 0;
+    return true;
+}
+
+AtlasGlyph const* GlyphAtlas::glyph(Char c)
+{
+    if (auto it = m_glyphs.find(c); it != m_glyphs.end())
+        return &it->second;
+
+    AtlasGlyph glyph;
+    if (TTF_GlyphMetrics32(m_font, c, nullptr, nullptr, nullptr, nullptr, &glyph.advance) != 0)
+        return nullptr;
+    if (auto* rendered = TTF_RenderGlyph32_Blended(m_font, c, SDL_Color { 0xff, 0xff, 0xff, 0xff }); rendered != nullptr) {
+        auto* surface = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(rendered);
+        if (surface == nullptr)
+            return nullptr;
+        if (m_next_cell >= SCRATCH_GLYPH_ATLAS_CELLS * SCRATCH_GLYPH_ATLAS_CELLS && !add_page()) {
+            SDL_FreeSurface(surface);
+            return nullptr;
+        }
+        auto& page = m_pages.back();
+        if (page.mapped != nullptr) {
+            page.pixels.assign(page.mapped, page.mapped + page_size() * page_size());
+            page.mapped = nullptr;
+        }
+        glyph.texture = page.texture;
+        glyph.page = static_cast<int>(m_pages.size()) - 1;
+        glyph.rect = SDL_Rect {
+            (m_next_cell % SCRATCH_GLYPH_ATLAS_CELLS) * m_cell_size,
+            (m_next_cell / SCRATCH_GLYPH_ATLAS_CELLS) * m_cell_size,
+            std::min(surface->w, m_cell_size),
+            std::min(surface->h, m_cell_size)
+        };
+        ++m_next_cell;
+        auto* origin = page.pixels.data() + glyph.rect.y * page_size() + glyph.rect.x;
+        for (auto row = 0; row < glyph.rect.h; ++row) {
+            memcpy(origin + row * page_size(), static_cast<uint8_t const*>(surface->pixels) + row * surface->pitch, glyph.rect.w * sizeof(uint32_t));
+        }
+        SDL_FreeSurface(surface);
+        SDL_UpdateTexture(glyph.texture, &glyph.rect, origin, page_size() * static_cast<int>(sizeof(uint32_t)));
+    }
+    m_dirty = true;
+    auto [it, inserted] = m_glyphs.emplace(c, glyph);
+    return &it->second;
+}
+
+// The cache file is written by us, but can still be truncated or come from
+// a build with a different layout. Everything in it is checked before any of
+// it is used, and a file that doesn't add up is ignored as a whole.
+bool GlyphAtlas::load(fs::path const& path, uint64_t font_hash)
+{
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AtlasFileHeader)) {
+        close(fd);
+        return false;
+    }
+    auto* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    m_mapping = mapping;
+    m_mapping_size = st.st_size;
+
+    auto const* base = static_cast<uint8_t const*>(m_mapping);
+    auto const* header = reinterpret_cast<AtlasFileHeader const*>(base);
+    auto page_bytes = static_cast<size_t>(page_size()) * static_cast<size_t>(page_size()) * sizeof(uint32_t);
+    constexpr uint32_t cells_per_page = SCRATCH_GLYPH_ATLAS_CELLS * SCRATCH_GLYPH_ATLAS_CELLS;
+    auto valid = memcmp(header->magic, atlas_file_magic, sizeof(atlas_file_magic)) == 0
+        && header->version == atlas_file_version
+        && header->font_hash == font_hash
+        && header->cell_size == static_cast<uint32_t>(m_cell_size)
+        && header->cells == SCRATCH_GLYPH_ATLAS_CELLS
+        && header->pages >= 1
+        && header->next_cell <= cells_per_page
+        && m_mapping_size >= atlas_file_pages_offset(header->glyphs) + header->pages * page_bytes;
+
+    // Glyphs must sit in a cell of a page that is in the file, and the
+    // cells on the last page must be below the first free one:
+    auto const* glyphs = reinterpret_cast<AtlasFileGlyph const*>(base + sizeof(AtlasFileHeader));
+    for (auto ix = 0u; valid && ix < header->glyphs; ++ix) {
+        auto const& g = glyphs[ix];
+        if (g.page < 0) {
+            valid = g.page == -1;
+            continue;
+        }
+        auto cell = static_cast<uint32_t>((g.y / m_cell_size) * SCRATCH_GLYPH_ATLAS_CELLS + g.x / m_cell_size);
+        valid = static_cast<uint32_t>(g.page) < header->pages
+            && g.x >= 0 && g.x % m_cell_size == 0 && g.x < page_size()
+            && g.y >= 0 && g.y % m_cell_size == 0 && g.y < page_size()
+            && g.w >= 0 && g.w <= m_cell_size
+            && g.h >= 0 && g.h <= m_cell_size
+            && (static_cast<uint32_t>(g.page) < header->pages - 1 || cell < header->next_cell);
+    }
+    if (!valid) {
+        debug(scratch, "Glyph cache file '{}' is stale or damaged", path.string());
+        unmap();
+        return false;
+    }
+
+    // The pages are drawn from the mapping until a glyph is added to them,
+    // so they don't get pixel buffers of their own:
+    auto const* pixels = base + atlas_file_pages_offset(header->glyphs);
+    for (auto ix = 0u; ix < header->pages; ++ix) {
+        auto* texture = create_page_texture();
+        if (texture == nullptr) {
+            for (auto& page : m_pages)
+                SDL_DestroyTexture(page.texture);
+            m_pages.clear();
+            unmap();
+            return false;
+        }
+        auto const* mapped = reinterpret_cast<uint32_t const*>(pixels + ix * page_bytes);
+        m_pages.push_back({ texture, mapped, {} });
+        SDL_UpdateTexture(texture, nullptr, mapped, page_size() * static_cast<int>(sizeof(uint32_t)));
+    }
+    for (auto ix = 0u; ix < header->glyphs; ++ix) {
+        auto const& g = glyphs[ix];
+        m_glyphs[g.codepoint] = AtlasGlyph {
+            (g.page >= 0) ? m_pages[g.page].texture : nullptr,
+            SDL_Rect { g.x, g.y, g.w, g.h },
+            g.advance,
+            g.page
+        };
+    }
+    m_next_cell = static_cast<int>(header->next_cell);
+    m_dirty = false;
+    debug(scratch, "Loaded {} glyphs from cache file '{}'", m_glyphs.size(), path.string());
+    return true;
+}
+
+void GlyphAtlas::save(fs::path const& path, uint64_t font_hash) const
+{
+    std::error_code err;
+    fs::create_directories(path.parent_path(), err);
+    auto tmp = path;
+    tmp += ".tmp";
+    std::ofstream s(tmp, std::ios::binary | std::ios::trunc);
+    if (!s.is_open()) {
+        log_error("Could not write glyph cache file '{}'", tmp.string());
+        return;
+    }
+    AtlasFileHeader header {};
+    memcpy(header.magic, atlas_file_magic, sizeof(atlas_file_magic));
+    header.font_hash = font_hash;
+    header.version = atlas_file_version;
+    header.cell_size = m_cell_size;
+    header.cells = SCRATCH_GLYPH_ATLAS_CELLS;
+    header.pages = m_pages.size();
+    header.glyphs = m_glyphs.size();
+    header.next_cell = m_next_cell;
+    s.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    for (auto const& [codepoint, glyph] : m_glyphs) {
+        AtlasFileGlyph g { codepoint, glyph.page, glyph.rect.x, glyph.rect.y, glyph.rect.w, glyph.rect.h, glyph.advance };
+        s.write(reinterpret_cast<char const*>(&g), sizeof(g));
+    }
+    auto padding = atlas_file_pages_offset(m_glyphs.size()) - sizeof(AtlasFileHeader) - m_glyphs.size() * sizeof(AtlasFileGlyph);
+    char const zeroes[16] = { 0 };
+    s.write(zeroes, static_cast<std::streamsize>(padding));
+    for (auto const& page : m_pages) {
+        s.write(reinterpret_cast<char const*>(page.data()), static_cast<std::streamsize>(page_size() * page_size() * sizeof(uint32_t)));
+    }
+    s.close();
+    if (s.fail()) {
+        log_error("Error writing glyph cache file '{}'", tmp.string());
+        fs::remove(tmp, err);
+        return;
+    }
+    fs::rename(tmp, path, err);
+}
+
+// -- FontFace --------------------------------------------------------------
+
+#if SCRATCH_GLYPH_CACHE
+static uint64_t hash_file(fs::path const& path)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    std::ifstream s(path, std::ios::binary);
+    char buffer[4096];
+    while (s.read(buffer, sizeof(buffer)) || s.gcount() > 0) {
+        for (auto ix = 0; ix < s.gcount(); ++ix) {
+            hash ^= static_cast<uint8_t>(buffer[ix]);
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+#endif
+
+static fs::path glyph_cache_dir()
+{
+    if (auto const* dir = getenv("SCRATCH_CACHE_DIR"); dir != nullptr && *dir)
+        return fs::path(dir) / "glyphs";
+    if (auto const* dir = getenv("XDG_CACHE_HOME"); dir != nullptr && *dir)
+        return fs::path(dir) / "scratch" / "glyphs";
+    if (auto const* home = getenv("HOME"); home != nullptr && *home)
+        return fs::path(home) / ".cache" / "scratch" / "glyphs";
+    return {};
+}
+
+FontFace::FontFace(SDL_Renderer* renderer, std::string name, int point_size, uint64_t font_hash)
+    : m_renderer(renderer)
+    , m_name(std::move(name))
+    , m_point_size(point_size)
+    , m_font_hash(font_hash)
+{
+    if (m_font = TTF_OpenFont(format("fonts/{}.ttf", m_name).c_str(), m_point_size); m_font == nullptr)
+        fatal("Could not load font '{}': {}", m_name, TTF_GetError());
+    if (TTF_SizeUTF8(m_font, "W", &m_character_width, &m_character_height) != 0)
+        fatal("Error getting size of text: {}", TTF_GetError());
+    if (m_character_height = TTF_FontHeight(m_font); m_character_height < 0)
+        fatal("Error getting font height: {}", TTF_GetError());
+    m_fixed_width = TTF_FontFaceIsFixedWidth(m_font) != 0;
+    m_atlas = std::make_unique<GlyphAtlas>(m_renderer, m_font, m_character_height);
+    debug(scratch, "Opened font '{}' size {} w/ character size {}x{}", m_name, m_point_size, m_character_width, m_character_height);
+
+    if (auto dir = glyph_cache_dir(); m_font_hash != 0 && !dir.empty()) {
+        char hash_str[17];
+        snprintf(hash_str, sizeof(hash_str), "%016llx", static_cast<unsigned long long>(m_font_hash));
+        m_cache_path = dir / format("{}-{}-{}.atlas", m_name, hash_str, m_point_size);
+        m_atlas->load(m_cache_path, m_font_hash);
+    }
+    for (auto digit = 0; digit < 10; ++digit)
+        m_digits[digit] = m_atlas->glyph('0' + digit);
+}
+
+FontFace::~FontFace()
+{
+    debug(scratch, "Closing font '{}' size {}", m_name, m_point_size);
+    if (!m_cache_path.empty() && m_atlas->dirty())
+        m_atlas->save(m_cache_path, m_font_hash);
+    m_atlas.reset();
+    if (m_font)
+        TTF_CloseFont(m_font);
+}
+
+SDL_Rect FontFace::render(int x, int y, std::string_view text, SDL_Color color)
+{
+    SDL_Rect rect { x, y, 0, 0 };
+    if (text.empty())
+        return rect;
+    rect.h = m_character_height;
+    auto const* ptr = text.data();
+    auto const* end = ptr + text.length();
+    while (ptr < end) {
+        Char c;
+        auto len = charFromUtf8(&c, ptr, end);
+        if (len <= 0)
+            break;
+        ptr += len;
+        auto const* g = m_atlas->glyph(c);
+        if (g == nullptr)
+            continue;
+        if (g->texture != nullptr) {
+            SDL_SetTextureColorMod(g->texture, color.r, color.g, color.b);
+            SDL_SetTextureAlphaMod(g->texture, color.a);
+            SDL_Rect dest { x + rect.w, y, g->rect.w, g->rect.h };
+            SDL_RenderCopy(m_renderer, g->texture, &g->rect, &dest);
+        }
+        rect.w += g->advance;
+    }
+    return rect;
+}
+
+int FontFace::advance(std::string_view text)
+{
+    auto ret = 0;
+    auto const* ptr = text.data();
+    auto const* end = ptr + text.length();
+    while (ptr < end) {
+        Char c;
+        auto len = charFromUtf8(&c, ptr, end);
+        if (len <= 0)
+            break;
+        ptr += len;
+        if (auto const* g = m_atlas->glyph(c); g != nullptr)
+            ret += g->advance;
+    }
+    return ret;
+}
+
+// Widths of text in a fixed width font are the number of code points times
+// the character width. Other text is measured once from the glyph advances,
+// and remembered.
+int FontFace::text_width(std::string_view text)
+{
+    if (m_fixed_width) {
+        auto count = std::count_if(text.begin(), text.end(), [](char ch) {
+            return (static_cast<uint8_t>(ch) & 0xC0) != 0x80;
+        });
+        return static_cast<int>(count) * m_character_width;
+    }
+    if (auto it = m_text_widths.find(text); it != m_text_widths.end())
+        return it->second;
+    if (m_text_widths.size() >= SCRATCH_TEXT_WIDTH_CACHE)
+        m_text_widths.clear();
+    auto ret = advance(text);
+    m_text_widths.emplace(std::string(text), ret);
+    return ret;
+}
+
+// Draws a non-negative number right-aligned in a field `width` characters
+// wide, straight from the digit glyphs. Numbers that don't fit in the field
+// extend to the left.
+SDL_Rect FontFace::render_number(int x, int y, int number, int width, SDL_Color color)
+{
+    auto right = x + width * m_character_width;
+    auto left = right;
+    auto n = static_cast<unsigned>(std::max(number, 0));
+    do {
+        auto const* g = m_digits[n % 10];
+        n /= 10;
+        if (g == nullptr)
+            continue;
+        left -= g->advance;
+        if (g->texture != nullptr) {
+            SDL_SetTextureColorMod(g->texture, color.r, color.g, color.b);
+            SDL_SetTextureAlphaMod(g->texture, color.a);
+            SDL_Rect dest { left, y, g->rect.w, g->rect.h };
+            SDL_RenderCopy(m_renderer, g->texture, &g->rect, &dest);
+        }
+    } while (n > 0);
+    left = std::min(left, x);
+    return SDL_Rect { left, y, right - left, m_character_height };
+}
+
+// -- FontManager -----------------------------------------------------------
+
+FontManager::FontManager(SDL_Renderer* renderer, size_t budget)
+    : m_renderer(renderer)
+    , m_budget(budget)
+{
+}
+
+std::shared_ptr<FontFace> FontManager::face(std::string const& name, int point_size)
+{
+    auto key = std::make_pair(name, point_size);
+    std::shared_ptr<FontFace> ret;
+    if (auto it = m_faces.find(key); it != m_faces.end()) {
+        ret = it->second;
+    } else {
+        ret = std::make_shared<FontFace>(m_renderer, name, point_size, font_hash(name));
+        m_faces[key] = ret;
+    }
+    ret->touch(++m_tick);
+    evict();
+    return ret;
+}
+
+size_t FontManager::bytes() const
+{
+    size_t ret = 0;
+    for (auto const& [key, face] : m_faces)
+        ret += face->bytes();
+    return ret;
+}
+
+// Every size of a font shares the font file, so it's only hashed once.
+uint64_t FontManager::font_hash(std::string const& name)
+{
+#if SCRATCH_GLYPH_CACHE
+    if (auto it = m_font_hashes.find(name); it != m_font_hashes.end())
+        return it->second;
+    auto ret = hash_file(format("fonts/{}.ttf", name));
+    m_font_hashes[name] = ret;
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+// Faces that are referenced outside the manager are in use and stay.
+void FontManager::evict()
+{
+    auto total = bytes();
+    while (total > m_budget) {
+        auto victim = m_faces.end();
+        for (auto it = m_faces.begin(); it != m_faces.end(); ++it) {
+            if (it->second.use_count() > 1)
+                continue;
+            if (victim == m_faces.end() || it->second->last_used() < victim->second->last_used())
+                victim = it;
+        }
+        if (victim == m_faces.end())
+            return;
+        total -= victim->second->bytes();
+        m_faces.erase(victim);
+    }
+}
+
+}
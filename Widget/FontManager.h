@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "obelixlibs/core/Logging.h"
+
+#include "App/Text.h"
+
+#ifndef SCRATCH_FONT_CACHE_BUDGET
+#define SCRATCH_FONT_CACHE_BUDGET (64 * 1024 * 1024)
+#endif /* SCRATCH_FONT_CACHE_BUDGET */
+
+#ifndef SCRATCH_GLYPH_ATLAS_CELLS
+#define SCRATCH_GLYPH_ATLAS_CELLS 16
+#endif /* SCRATCH_GLYPH_ATLAS_CELLS */
+
+#ifndef SCRATCH_TEXT_WIDTH_CACHE
+#define SCRATCH_TEXT_WIDTH_CACHE 4096
+#endif /* SCRATCH_TEXT_WIDTH_CACHE */
+
+#ifndef SCRATCH_GLYPH_CACHE
+#define SCRATCH_GLYPH_CACHE 1
+#endif /* SCRATCH_GLYPH_CACHE */
+
+namespace Scratch {
+
+namespace fs = std::filesystem;
+
+struct AtlasGlyph {
+    SDL_Texture* texture { nullptr };
+    SDL_Rect rect { 0, 0, 0, 0 };
+    int advance { 0 };
+    int page { -1 };
+};
+
+// Glyphs are rasterized in white when they are first drawn, and copied into
+// square cells of texture pages. Text is drawn by copying the glyphs from
+// the pages, using the texture color modulation to get the right color.
+//
+// The atlas can be saved to and loaded from a cache file. A loaded atlas
+// keeps the file mapped, and only copies a page into memory when a glyph
+// is added to it.
+class GlyphAtlas {
+public:
+    GlyphAtlas(SDL_Renderer*, TTF_Font*, int cell_size);
+    ~GlyphAtlas();
+
+    AtlasGlyph const* glyph(Char);
+    [[nodiscard]] size_t bytes() const;
+    [[nodiscard]] bool dirty() const { return m_dirty; }
+    bool load(fs::path const&, uint64_t font_hash);
+    void save(fs::path const&, uint64_t font_hash) const;
+
+private:
+    struct Page {
+        SDL_Texture* texture { nullptr };
+        uint32_t const* mapped { nullptr };
+        std::vector<uint32_t> pixels {};
+
+        [[nodiscard]] uint32_t const* data() const { return (mapped != nullptr) ? mapped : pixels.data(); }
+    };
+
+    [[nodiscard]] int page_size() const { return SCRATCH_GLYPH_ATLAS_CELLS * m_cell_size; }
+    SDL_Texture* create_page_texture();
+    bool add_page();
+    void unmap();
+
+    SDL_Renderer* m_renderer;
+    TTF_Font* m_font;
+    int m_cell_size;
+    std::vector<Page> m_pages {};
+    int m_next_cell { SCRATCH_GLYPH_ATLAS_CELLS * SCRATCH_GLYPH_ATLAS_CELLS };
+    std::unordered_map<Char, AtlasGlyph> m_glyphs {};
+    void* m_mapping { nullptr };
+    size_t m_mapping_size { 0 };
+    bool m_dirty { false };
+};
+
+class FontFace {
+public:
+    // The atlas is only cached on disk when the hash of the font file is
+    // given.
+    FontFace(SDL_Renderer*, std::string name, int point_size, uint64_t font_hash = 0);
+    ~FontFace();
+
+    [[nodiscard]] std::string const& name() const { return m_name; }
+    [[nodiscard]] int point_size() const { return m_point_size; }
+    [[nodiscard]] TTF_Font* font() const { return m_font; }
+    [[nodiscard]] int character_width() const { return m_character_width; }
+    [[nodiscard]] int character_height() const { return m_character_height; }
+    [[nodiscard]] bool fixed_width() const { return m_fixed_width; }
+    [[nodiscard]] size_t bytes() const { return m_atlas->bytes(); }
+    [[nodiscard]] unsigned long last_used() const { return m_last_used; }
+    void touch(unsigned long tick) { m_last_used = tick; }
+
+    SDL_Rect render(int x, int y, std::string_view text, SDL_Color color);
+    int advance(std::string_view text);
+    int text_width(std::string_view text);
+    SDL_Rect render_number(int x, int y, int number, int width, SDL_Color color);
+
+private:
+    SDL_Renderer* m_renderer;
+    std::string m_name;
+    int m_point_size;
+    TTF_Font* m_font { nullptr };
+    int m_character_width { 0 };
+    int m_character_height { 0 };
+    bool m_fixed_width { false };
+    std::unique_ptr<GlyphAtlas> m_atlas;
+    struct TextHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view text) const { return std::hash<std::string_view> {}(text); }
+    };
+
+    std::unordered_map<std::string, int, TextHash, std::equal_to<>> m_text_widths {};
+    std::array<AtlasGlyph const*, 10> m_digits {};
+    fs::path m_cache_path {};
+    uint64_t m_font_hash { 0 };
+    unsigned long m_last_used { 0 };
+};
+
+// Owns every opened TTF_Font and its glyph atlas, keyed by font name and
+// point size, so switching back to a font or size used before doesn't
+// reopen or re-rasterize anything. Faces that are not in use are evicted,
+// least recently used first, when the atlases grow over the budget.
+class FontManager {
+public:
+    explicit FontManager(SDL_Renderer*, size_t budget = SCRATCH_FONT_CACHE_BUDGET);
+
+    std::shared_ptr<FontFace> face(std::string const& name, int point_size);
+    [[nodiscard]] size_t bytes() const;
+
+private:
+    void evict();
+    uint64_t font_hash(std::string const& name);
+
+    SDL_Renderer* m_renderer;
+    size_t m_budget;
+    unsigned long m_tick { 0 };
+    std::map<std::pair<std::string, int>, std::shared_ptr<FontFace>> m_faces {};
+    std::map<std::string, uint64_t> m_font_hashes {};
+};
+
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <Widget/FrameArena.h>
+
+namespace Scratch {
+
+// -- FrameArena ------------------------------------------------------------
+
+void FrameArena::next_block(size_t size)
+{
+    // Blocks from earlier frames are reused if they are large enough:
+    while (m_block + 1 < m_blocks.size()) {
+        ++m_block;
+        m_offset = 0;
+        if (m_blocks[m_block].size >= size)
+            return;
+    }
+    auto block_size = std::max(size, static_cast<size_t>(SCRATCH_FRAME_ARENA_BLOCK));
+    m_blocks.push_back({ std::make_unique<char[]>(block_size), block_size });
+    m_block = m_blocks.size() - 1;
+    m_offset = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    if (m_blocks.empty())
+        next_block(size + alignment);
+    auto offset = (m_offset + alignment - 1) & ~(alignment - 1);
+    if (offset + size > m_blocks[m_block].size) {
+        next_block(size + alignment);
+        offset = 0;
+    }
+    m_offset = offset + size;
+    return m_blocks[m_block].data.get() + offset;
+}
+
+std::string_view FrameArena::store(std::string_view text)
+{
+    if (text.empty())
+        return {};
+    auto* ptr = static_cast<char*>(allocate(text.length(), 1));
+    memcpy(ptr, text.data(), text.length());
+    return { ptr, text.length() };
+}
+
+std::string_view FrameArena::printf(char const* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    va_list retry;
+    va_copy(retry, args);
+
+    // Format into what's left of the current block, and if that doesn't fit
+    // do it again into space that is large enough:
+    if (m_blocks.empty())
+        next_block(0);
+    auto available = m_blocks[m_block].size - m_offset;
+    auto* ptr = m_blocks[m_block].data.get() + m_offset;
+    auto len = vsnprintf(ptr, available, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        va_end(retry);
+        return {};
+    }
+    if (static_cast<size_t>(len) >= available) {
+        ptr = static_cast<char*>(allocate(len + 1, 1));
+        vsnprintf(ptr, len + 1, fmt, retry);
+    } else {
+        m_offset += len;
+    }
+    va_end(retry);
+    return { ptr, static_cast<size_t>(len) };
+}
+
+void FrameArena::reset()
+{
+    m_block = 0;
+    m_offset = 0;
+}
+
+size_t FrameArena::used() const
+{
+    size_t ret = m_offset;
+    for (auto ix = 0u; ix < m_block && ix < m_blocks.size(); ++ix)
+        ret += m_blocks[ix].size;
+    return ret;
+}
+
+size_t FrameArena::capacity() const
+{
+    size_t ret = 0;
+    for (auto const& block : m_blocks)
+        ret += block.size;
+    return ret;
+}
+
+// -- Allocation counter ----------------------------------------------------
+
+// Only counts in programs linked with Widget/AllocationCounter.cpp, which
+// replaces the global operator new.
+std::atomic<size_t> heap_allocation_count { 0 };
+
+size_t heap_allocations()
+{
+    return heap_allocation_count.load(std::memory_order_relaxed);
+}
+
+}
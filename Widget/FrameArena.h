@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#ifndef SCRATCH_FRAME_ARENA_BLOCK
+#define SCRATCH_FRAME_ARENA_BLOCK (64 * 1024)
+#endif /* SCRATCH_FRAME_ARENA_BLOCK */
+
+namespace Scratch {
+
+// Bump allocator for temporaries that only need to live until the frame is
+// rendered, like formatted status texts. Memory is handed out from large
+// blocks which are kept when the arena is reset at the start of the next
+// frame, so once the blocks are there a frame doesn't touch the heap.
+class FrameArena {
+public:
+    FrameArena() = default;
+    FrameArena(FrameArena const&) = delete;
+    FrameArena& operator=(FrameArena const&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    std::string_view store(std::string_view);
+    std::string_view printf(char const* fmt, ...) __attribute__((format(printf, 2, 3)));
+    void reset();
+
+    [[nodiscard]] size_t used() const;
+    [[nodiscard]] size_t capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    void next_block(size_t);
+
+    std::vector<Block> m_blocks {};
+    size_t m_block { 0 };
+    size_t m_offset { 0 };
+};
+
+// Number of times operator new was called since the program started. The
+// benchmarks link in a replacement operator new that counts; in other
+// programs this stays zero unless they are built with the
+// SCRATCH_COUNT_ALLOCATIONS option.
+extern std::atomic<size_t> heap_allocation_count;
+[[nodiscard]] size_t heap_allocations();
+
+}
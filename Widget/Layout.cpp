@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include "App.h"
 #include <Commands/Command.h>
 #include <Widget/Widget.h>
 
@@ -18,7 +19,7 @@ Layout::Layout(ContainerOrientation orientation, SizePolicy policy, int size)
 void Layout::render()
 {
     for (auto* c : m_container.components()) {
-        c->render();
+        App::instance().profiler().render(c);
     }
 }
 
@@ -62,7 +63,7 @@ void Layout::resize(Box const& outline)
     m_container.resize(outline);
 }
 
-std::vector<Widget*> Layout::components()
+std::vector<Widget*> const& Layout::components() const
 {
     return m_container.components();
 }
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+
+#include <core/Format.h>
+
+#include "App.h"
+#include <Widget/Profiler.h>
+
+namespace Scratch {
+
+// -- FrameProfiler ---------------------------------------------------------
+
+FrameProfiler::FrameProfiler()
+    : m_samples(SCRATCH_PROFILER_FRAMES)
+{
+}
+
+void FrameProfiler::enable(bool enabled)
+{
+    m_enabled = enabled;
+    if (!m_enabled) {
+        m_next = m_count = 0;
+        m_current = {};
+    }
+}
+
+void FrameProfiler::begin_frame()
+{
+    if (!m_enabled)
+        return;
+    m_current.interval = 0.0;
+    m_current.phases.fill(0.0);
+    m_current.widgets.assign(m_widget_names.size(), 0.0);
+    m_allocations_at_start = heap_allocations();
+}
+
+void FrameProfiler::end_frame(Milliseconds interval)
+{
+    if (!m_enabled)
+        return;
+    m_current.interval = interval.count();
+    m_current.allocations = heap_allocations() - m_allocations_at_start;
+    std::swap(m_samples[m_next], m_current);
+    m_next = (m_next + 1) % m_samples.size();
+    m_count = std::min(m_count + 1, m_samples.size());
+}
+
+void FrameProfiler::add(ProfilePhase phase, Milliseconds duration)
+{
+    if (!m_enabled)
+        return;
+    m_current.phases[(size_t)phase] += duration.count();
+}
+
+void FrameProfiler::render(Widget* widget)
+{
+    if (!m_enabled) {
+        widget->render();
+        return;
+    }
+    auto start = Clock::now();
+    widget->render();
+    auto elapsed = Milliseconds(Clock::now() - start);
+
+    std::type_index type = typeid(*widget);
+    size_t slot;
+    if (auto it = m_widget_slots.find(type); it != m_widget_slots.end()) {
+        slot = it->second;
+    } else {
+        int status;
+        auto demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        std::string name = (status == 0) ? demangled : type.name();
+        free(demangled);
+        if (name.starts_with("Scratch::"))
+            name = name.substr(9);
+        slot = m_widget_names.size();
+        m_widget_names.push_back(name);
+        m_widget_slots[type] = slot;
+    }
+    if (m_current.widgets.size() <= slot)
+        m_current.widgets.resize(slot + 1, 0.0);
+    m_current.widgets[slot] += elapsed.count();
+}
+
+double FrameProfiler::Sample::total() const
+{
+    return phases[(size_t)ProfilePhase::Events] + phases[(size_t)ProfilePhase::Render] + phases[(size_t)ProfilePhase::Present];
+}
+
+// Sample 0 is the oldest sample in the window.
+FrameProfiler::Sample const& FrameProfiler::sample(size_t ix) const
+{
+    return m_samples[(m_next + m_samples.size() - m_count + ix) % m_samples.size()];
+}
+
+std::vector<double> FrameProfiler::frame_times() const
+{
+    std::vector<double> ret;
+    ret.reserve(m_count);
+    for (auto ix = 0u; ix < m_count; ++ix)
+        ret.push_back(sample(ix).total());
+    return ret;
+}
+
+double FrameProfiler::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0.0;
+    auto times = frame_times();
+    auto n = static_cast<size_t>(p / 100.0 * static_cast<double>(times.size() - 1) + 0.5);
+    std::nth_element(times.begin(), times.begin() + n, times.end());
+    return times[n];
+}
+
+double FrameProfiler::mean(ProfilePhase phase) const
+{
+    if (m_count == 0)
+        return 0.0;
+    double sum = 0.0;
+    for (auto ix = 0u; ix < m_count; ++ix)
+        sum += sample(ix).phases[(size_t)phase];
+    return sum / static_cast<double>(m_count);
+}
+
+double FrameProfiler::allocations() const
+{
+    if (m_count == 0)
+        return 0.0;
+    size_t sum = 0;
+    for (auto ix = 0u; ix < m_count; ++ix)
+        sum += sample(ix).allocations;
+    return static_cast<double>(sum) / static_cast<double>(m_count);
+}
+
+std::vector<std::pair<std::string, double>> FrameProfiler::widget_means() const
+{
+    std::vector<std::pair<std::string, double>> ret;
+    for (auto slot = 0u; slot < m_widget_names.size(); ++slot) {
+        double sum = 0.0;
+        for (auto ix = 0u; ix < m_count; ++ix) {
+            auto const& widgets = sample(ix).widgets;
+            if (slot < widgets.size())
+                sum += widgets[slot];
+        }
+        ret.emplace_back(m_widget_names[slot], (m_count > 0) ? sum / static_cast<double>(m_count) : 0.0);
+    }
+    return ret;
+}
+
+std::string FrameProfiler::dump(fs::path const& path) const
+{
+    std::fstream s(path.string(), std::fstream::out);
+    if (!s.is_open())
+        return format("Error opening '{}'", path.string());
+    s << "frame,interval,total,allocations";
+    for (auto phase = 0u; phase < (size_t)ProfilePhase::Max; ++phase)
+        s << "," << ProfilePhase_name(static_cast<ProfilePhase>(phase));
+    for (auto const& name : m_widget_names)
+        s << "," << name;
+    s << "\n";
+    for (auto ix = 0u; ix < m_count; ++ix) {
+        auto const& smpl = sample(ix);
+        s << ix << "," << smpl.interval << "," << smpl.total() << "," << smpl.allocations;
+        for (auto phase : smpl.phases)
+            s << "," << phase;
+        for (auto slot = 0u; slot < m_widget_names.size(); ++slot)
+            s << "," << ((slot < smpl.widgets.size()) ? smpl.widgets[slot] : 0.0);
+        s << "\n";
+    }
+    if (s.fail() || s.bad())
+        return format("Error writing '{}'", path.string());
+    return "";
+}
+
+// -- ProfileScope ----------------------------------------------------------
+
+ProfileScope::ProfileScope(FrameProfiler& profiler, ProfilePhase phase)
+    : m_profiler(profiler)
+    , m_phase(phase)
+    , m_start(FrameProfiler::Clock::now())
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (m_profiler.enabled())
+        m_profiler.add(m_phase, FrameProfiler::Clock::now() - m_start);
+}
+
+// -- ProfilerOverlay -------------------------------------------------------
+
+static std::string milliseconds(double ms)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%7.2f ms", ms);
+    return buf;
+}
+
+ProfilerOverlay::ProfilerOverlay(FrameProfiler const& profiler)
+    : WindowedWidget(SizePolicy::Absolute, 0)
+    , m_profiler(profiler)
+{
+}
+
+int ProfilerOverlay::width() const
+{
+    return 36 * App::instance().context()->character_width() + 16;
+}
+
+int ProfilerOverlay::height() const
+{
+    auto lines = 5 + (int)ProfilePhase::Max + (int)m_profiler.widget_means().size();
+    return lines * (App::instance().context()->character_height() + 2) + 16 + 64;
+}
+
+int ProfilerOverlay::top() const
+{
+    return 8;
+}
+
+int ProfilerOverlay::left() const
+{
+    return App::instance().width() - width() - 8;
+}
+
+void ProfilerOverlay::render()
+{
+    static constexpr double budget = 1000.0 / SCRATCH_FRAME_RATE;
+    auto line_height = App::instance().context()->character_height() + 2;
+    SDL_Color white { 0xff, 0xff, 0xff, 0xff };
+    SDL_Color grey { 0xa0, 0xa0, 0xa0, 0xff };
+
+    box(SDL_Rect { 0, 0, 0, 0 }, SDL_Color { 0x2c, 0x2c, 0x2c, 0xe0 });
+    rectangle(SDL_Rect { 2, 2, width() - 4, height() - 4 }, white);
+
+    auto y = 8;
+    render_fixed(8, y, format("{} frames", m_profiler.frames()), white);
+    y += line_height;
+    for (auto p : { 50, 95, 99 }) {
+        render_fixed(8, y, format("p{}", p), white);
+        render_fixed(8 + 4 * App::instance().context()->character_width(), y, milliseconds(m_profiler.percentile(p)), white);
+        y += line_height;
+    }
+    char allocations[32];
+    snprintf(allocations, sizeof(allocations), "%.1f", m_profiler.allocations());
+    render_fixed(8, y, "allocs/frame", white);
+    render_fixed(8 + 20 * App::instance().context()->character_width(), y, allocations, white);
+    y += line_height;
+    for (auto phase = 0u; phase < (size_t)ProfilePhase::Max; ++phase) {
+        render_fixed(8, y, ProfilePhase_name(static_cast<ProfilePhase>(phase)), grey);
+        render_fixed(8 + 20 * App::instance().context()->character_width(), y, milliseconds(m_profiler.mean(static_cast<ProfilePhase>(phase))), grey);
+        y += line_height;
+    }
+    for (auto const& [name, mean] : m_profiler.widget_means()) {
+        render_fixed(8 + 2 * App::instance().context()->character_width(), y, name, grey);
+        render_fixed(8 + 20 * App::instance().context()->character_width(), y, milliseconds(mean), grey);
+        y += line_height;
+    }
+
+    // Sparkline of the frame times in the window, scaled to two frame
+    // budgets, with a line marking one budget:
+    y += 8;
+    SDL_Rect graph { 8, y, width() - 16, 56 };
+    auto times = m_profiler.frame_times();
+    auto bar_width = std::max(1, graph.w / SCRATCH_PROFILER_FRAMES);
+    auto bars = std::min(static_cast<int>(times.size()), graph.w / bar_width);
+    auto x = graph.x + graph.w - bar_width * bars;
+    for (auto ix = times.size() - bars; ix < times.size(); ++ix) {
+        auto t = times[ix];
+        auto h = std::clamp(static_cast<int>(t / (2 * budget) * graph.h), 1, graph.h);
+        PaletteIndex color = PaletteIndex::ANSIGreen;
+        if (t > budget)
+            color = PaletteIndex::ANSIBrightRed;
+        else if (t > budget / 2)
+            color = PaletteIndex::ANSIYellow;
+        box(SDL_Rect { x, graph.y + graph.h - h, bar_width, h }, App::instance().color(color));
+        x += bar_width;
+    }
+    box(SDL_Rect { graph.x, graph.y + graph.h / 2, graph.w, 1 }, grey);
+}
+
+}
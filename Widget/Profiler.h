@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2023, Jan de Visser <jan@finiandarcy.com>
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include <Widget/FrameArena.h>
+#include <Widget/Widget.h>
+
+#ifndef SCRATCH_PROFILER_FRAMES
+#define SCRATCH_PROFILER_FRAMES 300
+#endif /* SCRATCH_PROFILER_FRAMES */
+
+namespace Scratch {
+
+namespace fs = std::filesystem;
+
+#define ENUMERATE_PROFILE_PHASES(S) \
+    S(Events)                       \
+    S(Lexing)                       \
+    S(Render)                       \
+    S(Present)
+
+enum class ProfilePhase {
+#undef ENUM_PROFILE_PHASE
+#define ENUM_PROFILE_PHASE(phase) phase,
+    ENUMERATE_PROFILE_PHASES(ENUM_PROFILE_PHASE)
+#undef ENUM_PROFILE_PHASE
+        Max
+};
+
+constexpr char const* ProfilePhase_name(ProfilePhase phase)
+{
+    switch (phase) {
+#undef ENUM_PROFILE_PHASE
+#define ENUM_PROFILE_PHASE(phase) \
+    case ProfilePhase::phase:     \
+        return #phase;
+        ENUMERATE_PROFILE_PHASES(ENUM_PROFILE_PHASE)
+#undef ENUM_PROFILE_PHASE
+    default:
+        fatal("Unknown ProfilePhase value '{}'", (int)phase);
+    }
+}
+
+// Keeps a rolling window of per-frame timings. Nothing is recorded unless
+// the profiler is enabled.
+class FrameProfiler {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    FrameProfiler();
+
+    [[nodiscard]] bool enabled() const { return m_enabled; }
+    void enable(bool);
+    void begin_frame();
+    void end_frame(Milliseconds interval);
+    void add(ProfilePhase, Milliseconds);
+    void render(Widget*);
+
+    [[nodiscard]] size_t frames() const { return m_count; }
+    [[nodiscard]] double percentile(double) const;
+    [[nodiscard]] double mean(ProfilePhase) const;
+    [[nodiscard]] double allocations() const;
+    [[nodiscard]] std::vector<std::pair<std::string, double>> widget_means() const;
+    [[nodiscard]] std::vector<double> frame_times() const;
+    [[nodiscard]] std::string dump(fs::path const&) const;
+
+private:
+    struct Sample {
+        double interval { 0.0 };
+        size_t allocations { 0 };
+        std::array<double, (size_t)ProfilePhase::Max> phases {};
+        std::vector<double> widgets {};
+
+        [[nodiscard]] double total() const;
+    };
+
+    [[nodiscard]] Sample const& sample(size_t) const;
+
+    bool m_enabled { false };
+    std::vector<Sample> m_samples;
+    size_t m_next { 0 };
+    size_t m_count { 0 };
+    Sample m_current {};
+    size_t m_allocations_at_start { 0 };
+    std::vector<std::string> m_widget_names;
+    std::unordered_map<std::type_index, size_t> m_widget_slots;
+};
+
+class ProfileScope {
+public:
+    ProfileScope(FrameProfiler&, ProfilePhase);
+    ~ProfileScope();
+
+private:
+    FrameProfiler& m_profiler;
+    ProfilePhase m_phase;
+    FrameProfiler::Clock::time_point m_start;
+};
+
+class ProfilerOverlay : public WindowedWidget {
+public:
+    explicit ProfilerOverlay(FrameProfiler const&);
+    void render() override;
+
+    [[nodiscard]] int width() const override;
+    [[nodiscard]] int height() const override;
+    [[nodiscard]] int top() const override;
+    [[nodiscard]] int left() const override;
+
+private:
+    FrameProfiler const& m_profiler;
+};
+
+}
@@ -16,8 +16,12 @@ using namespace Obelix;
 
 namespace Scratch {
 
-SDLContext::SDLInit::SDLInit()
+SDLContext::SDLInit::SDLInit(bool headless)
 {
+    // The dummy video driver doesn't need a display. Rendering then goes to
+    // a software renderer, see SDLRenderer:
+    if (headless)
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
         fatal("Failed to initialize SDL system");
     init = true;
@@ -63,13 +67,14 @@ SDLContext::SDLIMG::~SDLIMG()
         IMG_Quit();
 }
 
-SDLContext::SDLWindow::SDLWindow(int width, int height)
+SDLContext::SDLWindow::SDLWindow(int width, int height, bool headless)
 {
     debug(scratch, "Creating SDL window with size {}x{}", width, height);
+    Uint32 flags = (headless) ? SDL_WINDOW_HIDDEN : SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
     if (window = SDL_CreateWindow(
             "Scratch",
             SDL_WINDOWPOS_CENTERED_DISPLAY(0), SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-            width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+            width, height, flags);
         window == nullptr)
         fatal("Could not create SDL window");
     SDL_SetWindowMinimumSize(window, width, height);
@@ -83,8 +88,18 @@ SDLContext::SDLWindow::~SDLWindow()
         SDL_DestroyWindow(window);
 }
 
-SDLContext::SDLRenderer::SDLRenderer(SDLWindow const& window)
+SDLContext::SDLRenderer::SDLRenderer(SDLWindow const& window, bool headless)
 {
+    if (headless) {
+        int width, height;
+        SDL_GetWindowSize(window, &width, &height);
+        if (surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA8888); surface == nullptr)
+            fatal("Could not create offscreen surface: {}", SDL_GetError());
+        if (renderer = SDL_CreateSoftwareRenderer(surface); renderer == nullptr)
+            fatal("Could not create SDL software renderer: {}", SDL_GetError());
+        debug(scratch, "SDL offscreen renderer initialized");
+        return;
+    }
     if (renderer = SDL_GetRenderer(window); renderer == nullptr) {
         if (renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED); renderer == nullptr)
             fatal("Could not create SDL renderer");
@@ -97,105 +112,56 @@ SDLContext::SDLRenderer::~SDLRenderer()
     debug(scratch, "Destroying SDL renderer");
     if (renderer)
         SDL_DestroyRenderer(renderer);
+    if (surface)
+        SDL_FreeSurface(surface);
 }
 
-SDLContext::SDLFont::SDLFont(SDLRenderer& renderer, std::string font_name, int point_size)
-    : renderer(renderer)
+SDLContext::SDLFont::SDLFont(FontManager& font_manager, std::string font_name, int point_size)
+    : manager(font_manager)
     , name(std::move(font_name))
     , initial_size(point_size)
     , size(point_size)
 {
     set_font(name);
-    debug(scratch, "Opened font '{}' w/ character size {}x{}", name, character_width, character_height);
-}
-
-SDLContext::SDLFont::~SDLFont()
-{
-    if (font)
-        TTF_CloseFont(font);
 }
 
 void SDLContext::SDLFont::set_size(int point_size)
 {
     size = point_size;
-    if (TTF_SetFontSize(font, size) != 0)
-        fatal("Error setting size of font {} to {}: {}", name, size, TTF_GetError());
-    if (TTF_SizeUTF8(font, "W", &character_width, &character_height) != 0)
-        fatal("Error getting size of text: {}", TTF_GetError());
-    if (character_height = TTF_FontHeight(font); character_height < 0)
-        fatal("Error getting font height: {}", TTF_GetError());
+    face = manager.face(name, size);
+    character_width = face->character_width();
+    character_height = face->character_height();
 }
 
 void SDLContext::SDLFont::set_font(std::string const& font_name)
 {
     name = font_name;
-    if (font = TTF_OpenFont(format("fonts/{}.ttf", name).c_str(), size); font == nullptr)
-        fatal("Could not load font '{}': {}", name, TTF_GetError());
     set_size(size);
 }
 
-SDL_Rect SDLContext::SDLFont::render(int x, int y, std::string const& text, SDL_Color color) const
+SDL_Rect SDLContext::SDLFont::render(int x, int y, std::string_view text, SDL_Color color) const
 {
-    SDL_Rect rect { x, y, 0, 0 };
-    if (text.empty()) {
-        return rect;
-    }
-
-    SDL_Surface* surface = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-    if (!surface)
-        fatal("Error rendering text: {}", TTF_GetError());
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_QueryTexture(texture, nullptr, nullptr, &rect.w, &rect.h);
-    SDL_RenderCopy(renderer, texture, nullptr, &rect);
-    SDL_DestroyTexture(texture);
-    return rect;
+    return face->render(x, y, text, color);
 }
 
-SDL_Rect SDLContext::SDLFont::render_right_aligned(int x, int y, std::string const& text, SDL_Color color) const
+SDL_Rect SDLContext::SDLFont::render_right_aligned(int x, int y, std::string_view text, SDL_Color color) const
 {
-    SDL_Rect rect { x, y, 0, 0 };
-    if (text.empty()) {
-        return rect;
-    }
-
-    SDL_Surface* surface = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-    if (!surface)
-        fatal("Error rendering text: {}", TTF_GetError());
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_QueryTexture(texture, nullptr, nullptr, &rect.w, &rect.h);
-    rect.x -= rect.w;
-    SDL_RenderCopy(renderer, texture, nullptr, &rect);
-    SDL_DestroyTexture(texture);
-    return rect;
+    return face->render(x - face->text_width(text), y, text, color);
 }
 
-SDL_Rect SDLContext::SDLFont::render_centered(int x, int y, std::string const& text, SDL_Color color) const
+SDL_Rect SDLContext::SDLFont::render_centered(int x, int y, std::string_view text, SDL_Color color) const
 {
-    SDL_Rect rect { x, y, 0, 0 };
-    if (text.empty()) {
-        return rect;
-    }
+    return face->render(x - face->text_width(text) / 2, y, text, color);
+}
 
-    SDL_Surface* surface = TTF_RenderUTF8_Blended(font, text.c_str(), color);
-    if (!surface)
-        fatal("Error rendering text: {}", TTF_GetError());
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-    SDL_QueryTexture(texture, nullptr, nullptr, &rect.w, &rect.h);
-    rect.x -= rect.w / 2;
-    SDL_RenderCopy(renderer, texture, nullptr, &rect);
-    SDL_DestroyTexture(texture);
-    return rect;
+SDL_Rect SDLContext::SDLFont::render_number(int x, int y, int number, int width, SDL_Color color) const
+{
+    return face->render_number(x, y, number, width, color);
 }
 
-int SDLContext::SDLFont::text_width(std::string const& text) const
+int SDLContext::SDLFont::text_width(std::string_view text) const
 {
-    int width, height;
-    if (TTF_SizeUTF8(font, text.c_str(), &width, &height) != 0)
-        fatal("Error getting text width: {}", TTF_GetError());
-    return width;
+    return face->text_width(text);
 }
 
 SDLContext::SDLCursor::SDLCursor(SDL_SystemCursor cursor_id)
@@ -213,11 +179,12 @@ SDLContext::SDLCursor::~SDLCursor()
         SDL_FreeCursor(cursor);
 }
 
-SDLContext::SDLContext(int width, int height)
+SDLContext::SDLContext(int width, int height, bool headless)
     : m_width(width)
     , m_height(height)
+    , m_headless(headless)
 {
-    if (!TTF_FontFaceIsFixedWidth(m_fonts[(size_t)SDLFontFamily::Fixed].font))
+    if (!m_fonts[(size_t)SDLFontFamily::Fixed].face->fixed_width())
         fatal("Font '{}' is proportional", m_fonts[(size_t)SDLFontFamily::Fixed].name);
     SDL_ShowCursor(1);
 }
@@ -228,6 +195,14 @@ void SDLContext::resize(int width, int height)
     m_height = height;
 }
 
+int SDLContext::refresh_rate() const
+{
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(m_window), &mode) != 0)
+        return 0;
+    return mode.refresh_rate;
+}
+
 int SDLContext::character_width() const
 {
     return m_fonts[(size_t)SDLFontFamily::Fixed].character_width;
@@ -263,22 +238,27 @@ void SDLContext::set_font_size(int points, SDLFontFamily family)
     m_fonts[(size_t)family].set_size(points);
 }
 
-SDL_Rect SDLContext::render_text(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily family) const
+SDL_Rect SDLContext::render_text(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily family) const
 {
     return m_fonts[(size_t)family].render(x, y, text, color);
 }
 
-SDL_Rect SDLContext::render_text_right_aligned(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily family) const
+SDL_Rect SDLContext::render_text_right_aligned(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily family) const
 {
     return m_fonts[(size_t)family].render_right_aligned(x, y, text, color);
 }
 
-SDL_Rect SDLContext::render_text_centered(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily family) const
+SDL_Rect SDLContext::render_text_centered(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily family) const
 {
     return m_fonts[(size_t)family].render_centered(x, y, text, color);
 }
 
-int SDLContext::text_width(std::string const& text, SDLFontFamily family) const
+SDL_Rect SDLContext::render_number(int x, int y, int number, int width, SDL_Color const& color, SDLFontFamily family) const
+{
+    return m_fonts[(size_t)family].render_number(x, y, number, width, color);
+}
+
+int SDLContext::text_width(std::string_view text, SDLFontFamily family) const
 {
     return m_fonts[(size_t)family].text_width(text);
 }
@@ -15,6 +15,7 @@
 
 #include "obelixlibs/core/Logging.h"
 
+#include "FontManager.h"
 #include "Geometry.h"
 
 using namespace Obelix;
@@ -31,16 +32,18 @@ public:
         Max
     };
 
-    SDLContext(int width, int height);
+    SDLContext(int width, int height, bool headless = false);
     ~SDLContext() = default;
 
     [[nodiscard]] int width() const { return m_width; }
     [[nodiscard]] int height() const { return m_height; }
+    [[nodiscard]] bool headless() const { return m_headless; }
     void resize(int, int);
     SDL_Window* window() { return m_window; }
     SDL_Renderer* renderer() { return m_renderer; }
     SDL_Cursor* arrow() { return m_arrow; }
     SDL_Cursor* input() { return m_arrow; }
+    [[nodiscard]] int refresh_rate() const;
     [[nodiscard]] int character_width() const;
     [[nodiscard]] int character_height() const;
     void enlarge_font(SDLFontFamily = SDLFontFamily::Fixed);
@@ -49,14 +52,15 @@ public:
     void set_font(std::string const&, SDLFontFamily = SDLFontFamily::Fixed);
     void set_font_size(int, SDLFontFamily = SDLFontFamily::Fixed);
 
-    SDL_Rect render_text(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
-    SDL_Rect render_text_right_aligned(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
-    SDL_Rect render_text_centered(int x, int y, std::string const& text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
-    int text_width(std::string const&, SDLFontFamily = SDLFontFamily::Fixed) const;
+    SDL_Rect render_text(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
+    SDL_Rect render_text_right_aligned(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
+    SDL_Rect render_text_centered(int x, int y, std::string_view text, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
+    SDL_Rect render_number(int x, int y, int number, int width, SDL_Color const& color, SDLFontFamily = SDLFontFamily::Fixed) const;
+    int text_width(std::string_view, SDLFontFamily = SDLFontFamily::Fixed) const;
 
 private:
     struct SDLInit {
-        SDLInit();
+        explicit SDLInit(bool headless);
         ~SDLInit();
         bool init { false };
     };
@@ -74,7 +78,7 @@ private:
     };
 
     struct SDLWindow {
-        SDLWindow(int width, int height);
+        SDLWindow(int width, int height, bool headless);
         ~SDLWindow();
         operator SDL_Window*() const { return window; }
 
@@ -82,28 +86,29 @@ private:
     };
 
     struct SDLRenderer {
-        explicit SDLRenderer(SDLWindow const& window);
+        SDLRenderer(SDLWindow const& window, bool headless);
         ~SDLRenderer();
         operator SDL_Renderer*() const { return renderer; }
 
-        SDL_Renderer* renderer;
+        SDL_Renderer* renderer { nullptr };
+        SDL_Surface* surface { nullptr };
     };
 
     struct SDLFont {
-        SDLFont(SDLRenderer&, std::string font_name, int point_size);
-        ~SDLFont();
+        SDLFont(FontManager&, std::string font_name, int point_size);
 
         void set_size(int);
         void set_font(std::string const&);
         [[nodiscard]] std::string to_string() const { return name; }
-        operator TTF_Font*() const { return font; }
-        SDL_Rect render(int, int, std::string const& text, SDL_Color color) const;
-        SDL_Rect render_right_aligned(int, int, std::string const& text, SDL_Color color) const;
-        SDL_Rect render_centered(int, int, std::string const& text, SDL_Color color) const;
-        int text_width(std::string const&) const;
-
-        SDLRenderer& renderer;
-        TTF_Font *font;
+        operator TTF_Font*() const { return face->font(); }
+        SDL_Rect render(int, int, std::string_view text, SDL_Color color) const;
+        SDL_Rect render_right_aligned(int, int, std::string_view text, SDL_Color color) const;
+        SDL_Rect render_centered(int, int, std::string_view text, SDL_Color color) const;
+        SDL_Rect render_number(int, int, int number, int width, SDL_Color color) const;
+        int text_width(std::string_view) const;
+
+        FontManager& manager;
+        std::shared_ptr<FontFace> face;
         std::string name;
         int initial_size;
         int size;
@@ -122,14 +127,16 @@ private:
 
     int m_width { 0 };
     int m_height { 0 };
-    SDLInit m_sdl {};
+    bool m_headless { false };
+    SDLInit m_sdl { m_headless };
     SDLTTF m_ttf {};
-    SDLWindow m_window { m_width, m_height };
-    SDLRenderer m_renderer { m_window };
+    SDLWindow m_window { m_width, m_height, m_headless };
+    SDLRenderer m_renderer { m_window, m_headless };
     SDLIMG m_img {};
+    FontManager m_font_manager { m_renderer };
     std::array<SDLFont, (size_t) SDLFontFamily::Max> m_fonts {
-        SDLFont { m_renderer, "JetBrainsMono", 18 },
-        SDLFont { m_renderer, "Swansea-q3pd", 15 }
+        SDLFont { m_font_manager, "JetBrainsMono", 18 },
+        SDLFont { m_font_manager, "Swansea-q3pd", 15 }
     };
     SDLCursor m_arrow { SDL_SYSTEM_CURSOR_ARROW };
     SDLCursor m_input { SDL_SYSTEM_CURSOR_IBEAM };
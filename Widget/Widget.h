@@ -97,29 +97,31 @@ public:
     void resize(Box const&) override;
     int calculate_size();
 
-    SDL_Rect render_text(int x, int y, std::string const& text,
+    SDL_Rect render_text(int x, int y, std::string_view text,
         SDL_Color const& color = SDL_Color { 255, 255, 255, 255 },
         TextAlignment = TextAlignment::Left,
         SDLContext::SDLFontFamily = SDLContext::SDLFontFamily::Fixed) const;
 
     template <class Str>
-    SDL_Rect render_fixed(int x, int y, Str text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
+    SDL_Rect render_fixed(int x, int y, Str const& text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
     {
-        return render_text(x, y, std::string(text), color, TextAlignment::Left, SDLContext::SDLFontFamily::Fixed);
+        return render_text(x, y, std::string_view(text), color, TextAlignment::Left, SDLContext::SDLFontFamily::Fixed);
     }
 
     template <class Str>
-    SDL_Rect render_fixed_right_aligned(int x, int y, Str text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
+    SDL_Rect render_fixed_right_aligned(int x, int y, Str const& text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
     {
-        return render_text(x, y, std::string(text), color, TextAlignment::Left, SDLContext::SDLFontFamily::Fixed);
+        return render_text(x, y, std::string_view(text), color, TextAlignment::Left, SDLContext::SDLFontFamily::Fixed);
     }
 
     template <class Str>
-    SDL_Rect render_fixed_centered(int y, Str text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
+    SDL_Rect render_fixed_centered(int y, Str const& text, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const
     {
-        return render_text(0, y, std::string(text), color, TextAlignment::Center, SDLContext::SDLFontFamily::Fixed);
+        return render_text(0, y, std::string_view(text), color, TextAlignment::Center, SDLContext::SDLFontFamily::Fixed);
     }
 
+    SDL_Rect render_number(int x, int y, int number, int width, SDL_Color const& color = SDL_Color { 255, 255, 255, 255 }) const;
+
     SDL_Rect normalize(SDL_Rect const&) const;
     void box(SDL_Rect const&, SDL_Color) const;
     void rectangle(SDL_Rect const&, SDL_Color) const;
@@ -155,7 +157,8 @@ public:
     explicit WidgetContainer(ContainerOrientation);
     void add_component(WindowedWidget*);
     void remove_component(WindowedWidget*);
-    [[nodiscard]] std::vector<Widget*> components() const;
+    void clear();
+    [[nodiscard]] std::vector<Widget*> const& components() const { return m_widgets; }
     void resize(Box const&);
 
     template <class ComponentClass>
@@ -177,6 +180,7 @@ public:
 private:
     ContainerOrientation m_orientation { ContainerOrientation::Vertical };
     std::vector<std::unique_ptr<WindowedWidget>> m_components;
+    std::vector<Widget*> m_widgets;
     std::vector<Box> m_outlines;
     Widget* m_mouse_focus { nullptr };
 };
@@ -187,7 +191,7 @@ public:
     void render() override;
     bool dispatch(SDL_Keysym) override;
     void resize(Box const&) override;
-    std::vector<Widget*> components();
+    std::vector<Widget*> const& components() const;
     void add_component(WindowedWidget*);
     void remove_component(WindowedWidget*);
     WidgetContainer const& container() const;
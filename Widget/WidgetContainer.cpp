@@ -5,6 +5,7 @@
  */
 
 #include "App.h"
+#include <Common/Logging.h>
 #include <Widget/Widget.h>
 
 namespace Scratch {
@@ -18,28 +19,28 @@ void WidgetContainer::add_component(WindowedWidget* widget)
 {
     widget->set_parent(this);
     m_components.emplace_back(widget);
+    m_widgets.push_back(widget);
 }
 
 void WidgetContainer::remove_component(WindowedWidget* widget)
 {
+    std::erase(m_widgets, widget);
     std::erase_if(m_components, [widget](auto& component) {
         return widget == component.get();
     });
 }
 
-std::vector<Widget*> WidgetContainer::components() const
+void WidgetContainer::clear()
 {
-    std::vector<Widget*> ret;
-    ret.reserve(m_components.size());
-    for (auto const& c : m_components) {
-        ret.push_back(c.get());
-    }
-    return ret;
+    m_mouse_focus = nullptr;
+    m_outlines.clear();
+    m_widgets.clear();
+    m_components.clear();
 }
 
 void WidgetContainer::resize(Box const& outline)
 {
-    debug(scratch, "Resizing container within outline '{}'", outline);
+    lazy_debug(scratch, "Resizing container within outline '{}'", outline);
     m_outlines.clear();
     m_outlines.resize(m_components.size());
     auto allocated = 0;
@@ -96,7 +97,7 @@ void WidgetContainer::resize(Box const& outline)
         o.position[var_pos_coord] = offset;
         offset += o.size[var_size_coord];
         m_components[ix]->resize(o);
-        debug(scratch, "Component {}: '{}'", ix, o);
+        lazy_debug(scratch, "Component {}: '{}'", ix, o);
     }
 }
 
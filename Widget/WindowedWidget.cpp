@@ -175,7 +175,7 @@ int WindowedWidget::calculate_size()
     return m_size_calculator(this);
 }
 
-SDL_Rect WindowedWidget::render_text(int x, int y, std::string const& text, SDL_Color const& color, TextAlignment alignment, SDLContext::SDLFontFamily family) const
+SDL_Rect WindowedWidget::render_text(int x, int y, std::string_view text, SDL_Color const& color, TextAlignment alignment, SDLContext::SDLFontFamily family) const
 {
     SDL_Rect ret;
     switch (alignment) {
@@ -195,6 +195,14 @@ SDL_Rect WindowedWidget::render_text(int x, int y, std::string const& text, SDL_
     return ret;
 }
 
+SDL_Rect WindowedWidget::render_number(int x, int y, int number, int width, SDL_Color const& color) const
+{
+    auto ret = App::instance().context()->render_number(left() + x, top() + y, number, width, color);
+    ret.x -= left();
+    ret.y -= top();
+    return ret;
+}
+
 SDL_Rect WindowedWidget::normalize(SDL_Rect const& rect) const
 {
     SDL_Rect r = rect;